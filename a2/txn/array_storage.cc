@@ -0,0 +1,122 @@
+
+#include "txn/array_storage.h"
+
+#include "utils/huge_pages.h"
+
+static_assert(sizeof(std::atomic<Value>) + sizeof(std::atomic<uint64>) == 16, "records should take 16 bytes");
+
+ArrayStorage::ArrayStorage(Key key_count) : key_count_(key_count)
+{
+    void* mem = MapHugePages(key_count_ * sizeof(Record), &mapped_bytes_);
+    if (mem == NULL) DIE("cannot map " << mapped_bytes_ << " bytes of storage");
+    records_ = reinterpret_cast<Record*>(mem);
+}
+
+ArrayStorage::~ArrayStorage() { UnmapHugePages(records_, mapped_bytes_); }
+bool ArrayStorage::Read(Key key, Value* result, uint64 txn_unique_id)
+{
+    if (key >= key_count_) return Storage::Read(key, result, txn_unique_id);
+    ReadStable(key, result);
+    return true;
+}
+
+void ArrayStorage::Write(Key key, Value value, uint64 txn_unique_id)
+{
+    if (key >= key_count_)
+    {
+        Storage::Write(key, value, txn_unique_id);
+        return;
+    }
+    // Take the version while the record is locked, so that a reader that
+    // started at or after it either waits for the new value or sees it, and
+    // ReadStable never pairs the new value with the old version.
+    LockRecord(key);
+    WriteLocked(key, value, clock_.Tick());
+}
+
+uint64 ArrayStorage::Timestamp(Key key)
+{
+    if (key >= key_count_) return Storage::Timestamp(key);
+    return records_[key].version_.load(std::memory_order_acquire) & ~kLockBit;
+}
+
+void ArrayStorage::InitStorage()
+{
+    // Fresh anonymous memory is already zero; writing it faults in every page
+    // now rather than during the first txns.
+    for (Key key = 0; key < key_count_; key++)
+    {
+        records_[key].value_.store(0, std::memory_order_relaxed);
+        records_[key].version_.store(0, std::memory_order_relaxed);
+    }
+}
+
+uint64 ArrayStorage::ReadStable(Key key, Value* result)
+{
+    assert(key < key_count_);
+    Record* record = &records_[key];
+    SpinWait spin;
+    while (true)
+    {
+        uint64 tid = record->version_.load(std::memory_order_acquire);
+        if (tid & kLockBit)
+        {
+            spin.Wait();
+            continue;
+        }
+        Value value = record->value_.load(std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (record->version_.load(std::memory_order_relaxed) != tid) continue;
+        *result = value;
+        return tid;
+    }
+}
+
+void ArrayStorage::LockRecord(Key key)
+{
+    assert(key < key_count_);
+    std::atomic<uint64>* tid = &records_[key].version_;
+    SpinWait spin;
+    while (true)
+    {
+        uint64 unlocked = tid->load(std::memory_order_relaxed);
+        if ((unlocked & kLockBit) == 0 &&
+            tid->compare_exchange_weak(unlocked, unlocked | kLockBit, std::memory_order_acquire))
+        {
+            return;
+        }
+        spin.Wait();
+    }
+}
+
+void ArrayStorage::UnlockRecord(Key key)
+{
+    assert(key < key_count_);
+    records_[key].version_.fetch_and(~kLockBit, std::memory_order_release);
+}
+
+bool ArrayStorage::ExtendRts(Key key, uint64 wts, uint64 ts)
+{
+    assert(key < key_count_);
+    std::atomic<uint64>* word = &records_[key].version_;
+    uint64 current            = word->load(std::memory_order_acquire);
+    while (true)
+    {
+        if (Wts(current) != wts) return false;
+        if (Rts(current) >= ts) return true;
+        if (current & kLockBit) return false;
+
+        uint64 new_wts = ts - wts > kMaxDelta ? ts - kMaxDelta : wts;
+        uint64 updated = new_wts | ((ts - new_wts) << kDeltaShift);
+        if (word->compare_exchange_weak(current, updated, std::memory_order_acq_rel)) return true;
+    }
+}
+
+void ArrayStorage::WriteLocked(Key key, Value value, uint64 tid)
+{
+    assert(key < key_count_);
+    // Order the value after the lock bit for ReadStable, as in a seqlock.
+    std::atomic_thread_fence(std::memory_order_release);
+    records_[key].value_.store(value, std::memory_order_relaxed);
+    records_[key].version_.store(tid, std::memory_order_release);
+}
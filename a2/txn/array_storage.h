@@ -0,0 +1,99 @@
+
+#ifndef _ARRAY_STORAGE_H_
+#define _ARRAY_STORAGE_H_
+
+#include <assert.h>
+#include <atomic>
+
+#include "txn/storage.h"
+
+// Storage for a dense key range [0, key_count). Each record's value and
+// version sit side by side in one 16-byte slot of a flat array indexed by
+// key. Four records share a cache line, and the array is
+// backed by huge pages where the system allows, so reading or writing a
+// record costs about one cache miss and no TLB miss.
+//
+// The array never moves, so reads are lock-free and safe against concurrent
+// writes to other records. Every write publishes its value and version under
+// the record's lock bit, like a seqlock, and reads wait while the bit is set
+// (see LockRecord), so a read racing with a write to the same record sees
+// either the old value and version or the new ones. Keys outside the range
+// fall back to the ConcurrentMap of the base Storage.
+class ArrayStorage : public Storage
+{
+   public:
+    explicit ArrayStorage(Key key_count = STORAGE_KEYS);
+    virtual ~ArrayStorage();
+
+    virtual bool Read(Key key, Value* result, uint64 txn_unique_id = 0);
+    virtual void Write(Key key, Value value, uint64 txn_unique_id = 0);
+    virtual uint64 Timestamp(Key key);
+
+    // Sets every record in the range to 0, with version 0.
+    virtual void InitStorage();
+
+    // The following functions treat each record's version as a Silo-style
+    // TID word: a version number, with kLockBit set while a committing txn
+    // holds the record. They require 'key' to be in the range.
+
+    static const uint64 kLockBit = 1ull << 63;
+
+    // Sets '*result' to the value of 'key' and returns the version it has,
+    // waiting while the record is locked. The two are read consistently: a
+    // value is only ever stored while the record is locked, and the version
+    // is checked again after it is read.
+    uint64 ReadStable(Key key, Value* result);
+
+    // Returns the TID word of 'key', lock bit included.
+    uint64 Tid(Key key)
+    {
+        assert(key < key_count_);
+        return records_[key].version_.load(std::memory_order_acquire);
+    }
+    // Returns a new version, larger than any time Now() has returned so far.
+    uint64 NextVersion() { return clock_.Tick(); }
+    // Locks 'key', waiting for its current holder to release it.
+    void LockRecord(Key key);
+
+    // Unlocks 'key' without changing it.
+    void UnlockRecord(Key key);
+
+    // Replaces the value of locked record 'key', gives it version 'tid' and
+    // unlocks it.
+    void WriteLocked(Key key, Value value, uint64 tid);
+
+    // TicToc packs its timestamps into the same word: the version's write
+    // timestamp (wts) in the low 48 bits, and the distance from it to the
+    // read timestamp (rts), up to which the version is known to be valid, in
+    // the 15 bits below the lock bit. A version written at time t has word t.
+
+    static const int kDeltaShift = 48;
+    static const uint64 kWtsMask = (1ull << kDeltaShift) - 1;
+    static const uint64 kMaxDelta = (1ull << 15) - 1;
+
+    static uint64 Wts(uint64 word) { return word & kWtsMask; }
+    static uint64 Rts(uint64 word) { return Wts(word) + ((word >> kDeltaShift) & kMaxDelta); }
+    // Makes version 'wts' of 'key' valid up to at least 'ts', raising its rts.
+    // Returns false if 'key' has another version by now, or if another txn
+    // holds it and may be about to write it before 'ts'. If the distance
+    // between the timestamps does not fit, wts is raised instead, which the
+    // TicToc protocol allows.
+    bool ExtendRts(Key key, uint64 wts, uint64 ts);
+
+   private:
+    struct Record
+    {
+        std::atomic<Value> value_;
+        std::atomic<uint64> version_;
+    };
+
+    // Disallow copying.
+    ArrayStorage(const ArrayStorage&);
+    ArrayStorage& operator=(const ArrayStorage&);
+
+    Key key_count_;
+    Record* records_;
+    size_t mapped_bytes_;
+};
+
+#endif  // _ARRAY_STORAGE_H_
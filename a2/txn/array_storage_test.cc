@@ -0,0 +1,208 @@
+#include "txn/array_storage.h"
+
+#include <pthread.h>
+#include <unistd.h>
+
+#include "utils/testing.h"
+
+TEST(ArrayStorage_ReadWrite)
+{
+    ArrayStorage storage(16);
+    storage.InitStorage();
+    Value value;
+    EXPECT_EQ(0, storage.ReadStable(1, &value));
+    EXPECT_EQ(0, value);
+
+    storage.Write(1, 10);
+    uint64 tid = storage.ReadStable(1, &value);
+    EXPECT_EQ(10, value);
+    EXPECT_EQ(tid, storage.Timestamp(1));
+    EXPECT_TRUE(tid > 0);
+
+    // Keys outside the range go to the base Storage.
+    storage.Write(20, 200);
+    EXPECT_TRUE(storage.Read(20, &value));
+    EXPECT_EQ(200, value);
+
+    END;
+}
+
+TEST(ArrayStorage_WriteLockedUnlocks)
+{
+    ArrayStorage storage(16);
+    storage.InitStorage();
+    storage.LockRecord(2);
+    EXPECT_TRUE(storage.Tid(2) & ArrayStorage::kLockBit);
+
+    storage.WriteLocked(2, 20, 7);
+    EXPECT_EQ(7, storage.Tid(2));
+    Value value;
+    EXPECT_EQ(7, storage.ReadStable(2, &value));
+    EXPECT_EQ(20, value);
+
+    // UnlockRecord leaves the version alone.
+    storage.LockRecord(2);
+    storage.UnlockRecord(2);
+    EXPECT_EQ(7, storage.Tid(2));
+
+    END;
+}
+
+struct StableRead
+{
+    ArrayStorage* storage_;
+    Key key_;
+    std::atomic<bool> done_;
+    Value value_;
+    uint64 tid_;
+};
+
+static void* ReadRecord(void* arg)
+{
+    StableRead* read = reinterpret_cast<StableRead*>(arg);
+    read->tid_       = read->storage_->ReadStable(read->key_, &read->value_);
+    read->done_.store(true);
+    return NULL;
+}
+
+TEST(ArrayStorage_LockBlocksReadStable)
+{
+    ArrayStorage storage(16);
+    storage.InitStorage();
+    storage.Write(3, 30);
+    storage.LockRecord(3);
+
+    StableRead read;
+    read.storage_ = &storage;
+    read.key_     = 3;
+    read.done_.store(false);
+    pthread_t reader;
+    pthread_create(&reader, NULL, ReadRecord, &read);
+
+    // The reader waits for as long as the record is locked, and then sees the
+    // value written under the lock.
+    usleep(20000);
+    EXPECT_FALSE(read.done_.load());
+    storage.WriteLocked(3, 31, 99);
+    pthread_join(reader, NULL);
+    EXPECT_TRUE(read.done_.load());
+    EXPECT_EQ(31, read.value_);
+    EXPECT_EQ(99, read.tid_);
+
+    END;
+}
+
+TEST(ArrayStorage_ExtendRts)
+{
+    ArrayStorage storage(16);
+    storage.InitStorage();
+    storage.LockRecord(4);
+    storage.WriteLocked(4, 40, 100);
+    EXPECT_EQ(100, ArrayStorage::Wts(storage.Tid(4)));
+    EXPECT_EQ(100, ArrayStorage::Rts(storage.Tid(4)));
+
+    EXPECT_TRUE(storage.ExtendRts(4, 100, 150));
+    EXPECT_EQ(100, ArrayStorage::Wts(storage.Tid(4)));
+    EXPECT_EQ(150, ArrayStorage::Rts(storage.Tid(4)));
+
+    // An rts already past 'ts' is left alone.
+    EXPECT_TRUE(storage.ExtendRts(4, 100, 120));
+    EXPECT_EQ(150, ArrayStorage::Rts(storage.Tid(4)));
+
+    // Refused for a version that is gone...
+    EXPECT_FALSE(storage.ExtendRts(4, 90, 200));
+    EXPECT_EQ(150, ArrayStorage::Rts(storage.Tid(4)));
+
+    // ...and while another txn holds the record, unless rts is already there.
+    storage.LockRecord(4);
+    EXPECT_FALSE(storage.ExtendRts(4, 100, 200));
+    EXPECT_TRUE(storage.ExtendRts(4, 100, 140));
+    storage.UnlockRecord(4);
+    EXPECT_EQ(150, ArrayStorage::Rts(storage.Tid(4)));
+
+    END;
+}
+
+TEST(ArrayStorage_ExtendRtsPastMaxDelta)
+{
+    ArrayStorage storage(16);
+    storage.InitStorage();
+    storage.LockRecord(5);
+    storage.WriteLocked(5, 50, 100);
+
+    // The largest distance that fits keeps wts.
+    EXPECT_TRUE(storage.ExtendRts(5, 100, 100 + ArrayStorage::kMaxDelta));
+    EXPECT_EQ(100, ArrayStorage::Wts(storage.Tid(5)));
+    EXPECT_EQ(100 + ArrayStorage::kMaxDelta, ArrayStorage::Rts(storage.Tid(5)));
+
+    // One more raises wts to keep the distance at the maximum.
+    uint64 ts = 101 + ArrayStorage::kMaxDelta;
+    EXPECT_TRUE(storage.ExtendRts(5, 100, ts));
+    EXPECT_EQ(101, ArrayStorage::Wts(storage.Tid(5)));
+    EXPECT_EQ(ts, ArrayStorage::Rts(storage.Tid(5)));
+    EXPECT_FALSE(storage.Tid(5) & ArrayStorage::kLockBit);
+
+    // The old wts no longer names the version.
+    EXPECT_FALSE(storage.ExtendRts(5, 100, ts + 1));
+
+    Value value;
+    storage.ReadStable(5, &value);
+    EXPECT_EQ(50, value);
+
+    END;
+}
+
+struct Writes
+{
+    ArrayStorage* storage_;
+    std::atomic<bool> done_;
+};
+
+static void* WriteRecord(void* arg)
+{
+    Writes* writes = reinterpret_cast<Writes*>(arg);
+    for (int i = 1; i <= 200000; i++) writes->storage_->Write(6, i);
+    writes->done_.store(true);
+    return NULL;
+}
+
+TEST(ArrayStorage_WriteRacesReadStable)
+{
+    ArrayStorage storage(16);
+    storage.InitStorage();
+    Writes writes;
+    writes.storage_ = &storage;
+    writes.done_.store(false);
+    pthread_t writer;
+    pthread_create(&writer, NULL, WriteRecord, &writes);
+
+    // Every value comes with its own version: reads that return the same
+    // version return the same value, and newer versions larger values.
+    uint64 last_tid  = 0;
+    Value last_value = 0;
+    int mismatches   = 0;
+    while (!writes.done_.load())
+    {
+        Value value;
+        uint64 tid = storage.ReadStable(6, &value);
+        if (tid == last_tid ? value != last_value : tid < last_tid || value < last_value) mismatches++;
+        last_tid   = tid;
+        last_value = value;
+    }
+    pthread_join(writer, NULL);
+    EXPECT_EQ(0, mismatches);
+    EXPECT_EQ(storage.Timestamp(6), storage.ReadStable(6, &last_value));
+    EXPECT_EQ(200000, last_value);
+
+    END;
+}
+
+int main(int argc, char** argv)
+{
+    ArrayStorage_ReadWrite();
+    ArrayStorage_WriteLockedUnlocks();
+    ArrayStorage_LockBlocksReadStable();
+    ArrayStorage_ExtendRts();
+    ArrayStorage_ExtendRtsPastMaxDelta();
+    ArrayStorage_WriteRacesReadStable();
+}
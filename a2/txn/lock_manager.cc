@@ -1,15 +1,32 @@
 
 // Lock manager implementing deterministic two-phase locking as described in
-// 'The Case for Determinism in Database Systems'.
+// 'The Case for Determinism in Database Systems', and a non-deterministic one
+// for comparison.
 
 #include "txn/lock_manager.h"
 
+#include <string.h>
+
+#include "utils/mutex.h"
+
+void LockManager::Grant(Txn* txn)
+{
+    if (txn_waits_.Decrement(txn)) ready_txns_->push_back(txn);
+}
+
+void LockManager::Prune(LockQueue* queue)
+{
+    if (queue->Size() == 0) lock_table_.Remove(queue);
+}
+
 LockManagerA::LockManagerA(deque<Txn*>* ready_txns) { ready_txns_ = ready_txns; }
 bool LockManagerA::WriteLock(Txn* txn, const Key& key)
 {
-    //
-    // Implement this method!
-    return true;
+    LockQueue* requests = lock_table_.Append(key, LockRequest(EXCLUSIVE, txn));
+    if (requests->Size() == 1) return true;
+
+    txn_waits_.Increment(txn);
+    return false;
 }
 
 bool LockManagerA::ReadLock(Txn* txn, const Key& key)
@@ -21,43 +38,305 @@ bool LockManagerA::ReadLock(Txn* txn, const Key& key)
 
 void LockManagerA::Release(Txn* txn, const Key& key)
 {
-    //
-    // Implement this method!
+    txn_waits_.Erase(txn);
+    LockQueue* requests = lock_table_.Find(key);
+    if (requests == NULL) return;
+
+    int i = requests->Find(txn);
+    if (i >= 0)
+    {
+        // If 'txn' owned the lock, it passes to the next request in line.
+        requests->Erase(i, lock_table_.Pool());
+        if (i == 0 && requests->Size() > 0) Grant(requests->At(0).txn_);
+    }
+    Prune(requests);
 }
 
 // NOTE: The owners input vector is NOT assumed to be empty.
 LockMode LockManagerA::Status(const Key& key, vector<Txn*>* owners)
 {
-    //
-    // Implement this method!
-    return UNLOCKED;
+    owners->clear();
+    LockQueue* requests = lock_table_.Find(key);
+    if (requests == NULL) return UNLOCKED;
+
+    owners->push_back(requests->At(0).txn_);
+    return EXCLUSIVE;
 }
 
 LockManagerB::LockManagerB(deque<Txn*>* ready_txns) { ready_txns_ = ready_txns; }
 bool LockManagerB::WriteLock(Txn* txn, const Key& key)
 {
-    //
-    // Implement this method!
-    return true;
+    LockQueue* requests = lock_table_.Append(key, LockRequest(EXCLUSIVE, txn));
+    if (requests->Size() == 1) return true;
+
+    txn_waits_.Increment(txn);
+    return false;
 }
 
 bool LockManagerB::ReadLock(Txn* txn, const Key& key)
 {
-    //
-    // Implement this method!
-    return true;
+    LockQueue* requests = lock_table_.Append(key, LockRequest(SHARED, txn));
+    if (requests->GrantedCount() == requests->Size()) return true;
+
+    txn_waits_.Increment(txn);
+    return false;
 }
 
 void LockManagerB::Release(Txn* txn, const Key& key)
 {
-    //
-    // Implement this method!
+    txn_waits_.Erase(txn);
+    LockQueue* requests = lock_table_.Find(key);
+    if (requests == NULL) return;
+
+    int i = requests->Find(txn);
+    if (i >= 0)
+    {
+        int granted_before = requests->GrantedCount();
+        requests->Erase(i, lock_table_.Pool());
+        int granted_after = requests->GrantedCount();
+
+        // Requests that moved into the granted prefix have acquired the lock.
+        // A request now at index j was at index j + 1 before if it came after
+        // the removed one.
+        for (int j = 0; j < granted_after; j++)
+        {
+            int before = j < i ? j : j + 1;
+            if (before >= granted_before) Grant(requests->At(j).txn_);
+        }
+    }
+    Prune(requests);
 }
 
 // NOTE: The owners input vector is NOT assumed to be empty.
 LockMode LockManagerB::Status(const Key& key, vector<Txn*>* owners)
 {
-    //
-    // Implement this method!
-    return UNLOCKED;
+    owners->clear();
+    LockQueue* requests = lock_table_.Find(key);
+    if (requests == NULL) return UNLOCKED;
+
+    int granted = requests->GrantedCount();
+    for (int i = 0; i < granted; i++) owners->push_back(requests->At(i).txn_);
+    return requests->At(0).mode_;
+}
+
+DenseLockManager::DenseLockManager(deque<Txn*>* ready_txns, Key key_begin, Key key_end)
+    : LockManagerB(ready_txns), key_begin_(key_begin), key_count_(key_end - key_begin)
+{
+    static_assert(sizeof(DenseLock) == 32, "dense lock headers should take 32 bytes");
+    void* mem;
+    if (posix_memalign(&mem, CACHE_LINE_SIZE, key_count_ * sizeof(DenseLock)) != 0) DIE("out of memory");
+    memset(mem, 0, key_count_ * sizeof(DenseLock));
+    locks_ = reinterpret_cast<DenseLock*>(mem);
+}
+
+DenseLockManager::~DenseLockManager() { free(locks_); }
+bool DenseLockManager::Lock(Txn* txn, const Key& key, LockMode mode)
+{
+    DenseLock* lock = Header(key);
+    if (lock != NULL && !lock->hashed_)
+    {
+        if (lock->count_ == 0 || (mode == SHARED && lock->mode_ == SHARED && lock->count_ < kHolders))
+        {
+            lock->holders_[lock->count_++] = txn;
+            lock->mode_                    = mode;
+            return true;
+        }
+
+        // The request has to wait, or there is no room for another holder:
+        // the current holders become the first requests in the hashed table.
+        for (int i = 0; i < lock->count_; i++)
+        {
+            lock_table_.Append(key, LockRequest(static_cast<LockMode>(lock->mode_), lock->holders_[i]));
+        }
+        lock->count_  = 0;
+        lock->hashed_ = 1;
+    }
+    return mode == EXCLUSIVE ? LockManagerB::WriteLock(txn, key) : LockManagerB::ReadLock(txn, key);
+}
+
+bool DenseLockManager::ReadLock(Txn* txn, const Key& key) { return Lock(txn, key, SHARED); }
+bool DenseLockManager::WriteLock(Txn* txn, const Key& key) { return Lock(txn, key, EXCLUSIVE); }
+void DenseLockManager::Release(Txn* txn, const Key& key)
+{
+    DenseLock* lock = Header(key);
+    if (lock == NULL || lock->hashed_)
+    {
+        LockManagerB::Release(txn, key);
+        if (lock == NULL) return;
+
+        // Once every request left holds the lock and they fit in the header,
+        // the key can go back to it.
+        LockQueue* requests = lock_table_.Find(key);
+        if (requests != NULL && (requests->Size() > kHolders || requests->GrantedCount() < requests->Size())) return;
+        if (requests != NULL)
+        {
+            lock->mode_ = requests->At(0).mode_;
+            for (int i = 0; i < requests->Size(); i++) lock->holders_[i] = requests->At(i).txn_;
+            lock->count_ = requests->Size();
+            while (requests->Size() > 0) requests->Erase(requests->Size() - 1, lock_table_.Pool());
+            lock_table_.Remove(requests);
+        }
+        lock->hashed_ = 0;
+        return;
+    }
+
+    if (!txn_waits_.Empty()) txn_waits_.Erase(txn);
+    for (int i = 0; i < lock->count_; i++)
+    {
+        if (lock->holders_[i] != txn) continue;
+        for (int j = i + 1; j < lock->count_; j++) lock->holders_[j - 1] = lock->holders_[j];
+        lock->count_--;
+        break;
+    }
+}
+
+// NOTE: The owners input vector is NOT assumed to be empty.
+LockMode DenseLockManager::Status(const Key& key, vector<Txn*>* owners)
+{
+    DenseLock* lock = Header(key);
+    if (lock == NULL || lock->hashed_) return LockManagerB::Status(key, owners);
+
+    owners->clear();
+    if (lock->count_ == 0) return UNLOCKED;
+    for (int i = 0; i < lock->count_; i++) owners->push_back(lock->holders_[i]);
+    return static_cast<LockMode>(lock->mode_);
+}
+
+bool DenseLockManager::Hashed(const Key& key)
+{
+    DenseLock* lock = Header(key);
+    return lock == NULL || lock->hashed_;
+}
+
+OnlineLockManager::OnlineLockManager(DeadlockPolicy policy, Key key_count) : policy_(policy), key_count_(key_count)
+{
+    static_assert(sizeof(Entry) == 16, "lock entries should take 16 bytes");
+    void* mem;
+    if (posix_memalign(&mem, CACHE_LINE_SIZE, key_count_ * sizeof(Entry)) != 0) DIE("out of memory");
+    memset(mem, 0, key_count_ * sizeof(Entry));
+    entries_ = reinterpret_cast<Entry*>(mem);
+    for (int i = 0; i < kMaxWorkers; i++)
+    {
+        workers_[i].ts_.store(0);
+        workers_[i].wounded_.store(false);
+        workers_[i].attempts_.store(0);
+        workers_[i].aborts_.store(0);
+        workers_[i].waits_.store(0);
+    }
+}
+
+OnlineLockManager::~OnlineLockManager() { free(entries_); }
+OnlineLockManager::Entry* OnlineLockManager::Latch(const Key& key)
+{
+    if (key >= key_count_) DIE("key " << key << " is out of range");
+    Entry* entry = &entries_[key];
+    SpinWait spin;
+    while (entry->latch_.exchange(1, std::memory_order_acquire) != 0) spin.Wait();
+    return entry;
+}
+
+void OnlineLockManager::Abort(Worker* worker)
+{
+    worker->aborts_.store(worker->aborts_.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+}
+
+void OnlineLockManager::Begin(int worker, uint64 ts)
+{
+    assert(worker < kMaxWorkers);
+    Worker* self = &workers_[worker];
+    self->ts_.store(ts);
+    self->wounded_.store(false);
+    self->attempts_.store(self->attempts_.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+}
+
+bool OnlineLockManager::Lock(int worker, const Key& key, LockMode mode)
+{
+    Worker* self = &workers_[worker];
+    uint64 me    = 1ull << worker;
+    uint16 tag   = worker + 1;
+    uint64 ts    = self->ts_.load(std::memory_order_relaxed);
+    bool waited  = false;
+    SpinWait spin;
+    while (true)
+    {
+        Entry* entry = Latch(key);
+
+        // An older txn waiting for the lock goes first. Waiters clear
+        // 'waiter_' whenever they stop waiting, so it is never stale.
+        uint16 waiter = entry->waiter_;
+        bool queued   = waiter != 0 && waiter != tag && workers_[waiter - 1].ts_.load() < ts;
+        uint64 others = entry->owners_ & ~me;
+        bool granted  = !queued && (others == 0 || (mode == SHARED && !entry->exclusive_));
+
+        // The holders cannot release the lock while the entry is latched, so
+        // they are still running the attempts whose timestamps they announced.
+        // A wounded txn gives up its locks as soon as it notices.
+        bool abort = policy_ == WOUND_WAIT && self->wounded_.load();
+        if (!granted && policy_ == NO_WAIT) abort = true;
+        if (!granted && policy_ == WAIT_DIE) abort |= queued;
+        for (uint64 bits = granted ? 0 : others; bits != 0 && policy_ != NO_WAIT; bits &= bits - 1)
+        {
+            Worker* holder = &workers_[__builtin_ctzll(bits)];
+            if (policy_ == WAIT_DIE && holder->ts_.load() < ts) abort = true;
+            if (policy_ == WOUND_WAIT && holder->ts_.load() > ts) holder->wounded_.store(true);
+        }
+
+        if (granted && !abort)
+        {
+            entry->owners_ |= me;
+            if (mode == EXCLUSIVE) entry->exclusive_ = 1;
+        }
+        if (granted || abort)
+        {
+            if (waiter == tag) entry->waiter_ = 0;
+            Unlatch(entry);
+            if (abort) Abort(self);
+            return !abort;
+        }
+        if (waiter == 0 || (waiter != tag && !queued)) entry->waiter_ = tag;
+        Unlatch(entry);
+
+        if (!waited) self->waits_.store(self->waits_.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+        waited = true;
+        spin.Wait();
+    }
+}
+
+void OnlineLockManager::Release(int worker, const Key& key)
+{
+    Entry* entry = Latch(key);
+    entry->owners_ &= ~(1ull << worker);
+    if (entry->owners_ == 0) entry->exclusive_ = 0;
+    Unlatch(entry);
+}
+
+bool OnlineLockManager::Wounded(int worker)
+{
+    Worker* self = &workers_[worker];
+    if (!self->wounded_.load()) return false;
+    Abort(self);
+    return true;
+}
+
+// NOTE: The owners input vector is NOT assumed to be empty.
+LockMode OnlineLockManager::Status(const Key& key, vector<int>* owners)
+{
+    owners->clear();
+    Entry* entry = Latch(key);
+    for (uint64 bits = entry->owners_; bits != 0; bits &= bits - 1) owners->push_back(__builtin_ctzll(bits));
+    LockMode mode = entry->owners_ == 0 ? UNLOCKED : entry->exclusive_ ? EXCLUSIVE : SHARED;
+    Unlatch(entry);
+    return mode;
+}
+
+LockingStats OnlineLockManager::Stats()
+{
+    LockingStats stats;
+    for (int i = 0; i < kMaxWorkers; i++)
+    {
+        stats.attempts_ += workers_[i].attempts_.load(std::memory_order_relaxed);
+        stats.aborts_ += workers_[i].aborts_.load(std::memory_order_relaxed);
+        stats.waits_ += workers_[i].waits_.load(std::memory_order_relaxed);
+    }
+    return stats;
 }
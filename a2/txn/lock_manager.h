@@ -4,33 +4,24 @@
 #ifndef _LOCK_MANAGER_H_
 #define _LOCK_MANAGER_H_
 
+#include <atomic>
 #include <deque>
-#include <map>
-#include <unordered_map>
 #include <vector>
 
 #include "txn/common.h"
+#include "txn/lock_table.h"
+#include "utils/mutex.h"
 
-using std::map;
 using std::deque;
 using std::vector;
-using std::unordered_map;
 
 class Txn;
 
-// This interface supports locks being held in both read/shared and
-// write/exclusive modes.
-enum LockMode
-{
-    UNLOCKED  = 0,
-    SHARED    = 1,
-    EXCLUSIVE = 2,
-};
-
 class LockManager
 {
    public:
     virtual ~LockManager() {}
+
     // Attempts to grant a read lock to the specified transaction, enqueueing
     // request in lock table. Returns true if lock is immediately granted, else
     // returns false.
@@ -68,16 +59,16 @@ class LockManager
 
    protected:
     // The LockManager's lock table tracks all lock requests. For a given key, if
-    // 'lock_table_' contains a nonempty deque, then the item with that key is
-    // locked and either:
+    // 'lock_table_' contains a queue, then the item with that key is locked and
+    // either:
     //
-    //  (a) first element in the deque specifies the owner if that item is a
+    //  (a) first element in the queue specifies the owner if that item is a
     //      request for an EXCLUSIVE lock, or
     //
     //  (b) a SHARED lock is held by all elements of the longest prefix of the
-    //      deque containing only SHARED lock requests.
+    //      queue containing only SHARED lock requests.
     //
-    // For example, if lock_table_["key1"] points to a deque containing
+    // For example, if the queue for "key1" contains
     //
     //    (&Txn1, SHARED), (&Txn2, SHARED), (&Txn3, EXCLUSIVE), (&Txn4, SHARED)
     //
@@ -87,19 +78,16 @@ class LockManager
     // cannot acquire a lock until after Txn3 has released its lock, so it cannot
     // share the lock with Txn1 and Txn2.)
     //
-    // As a second example, if lock_table_["key1"] points to a deque containing
+    // As a second example, if the queue for "key1" contains
     //
     //    (&Txn1, EXCLUSIVE), (&Txn2, SHARED), (&Txn3, SHARED), (Txn4, EXCLUSIVE)
     //
     // then Txn1 currently holds an EXCLUSIVE lock on "key1". When Txn1 releases
     // its lock, Txn2 and Txn3 will simultaneously acquire SHARED locks on "key1".
-    struct LockRequest
-    {
-        LockRequest(LockMode m, Txn* t) : txn_(t), mode_(m) {}
-        Txn* txn_;       // Pointer to txn requesting the lock.
-        LockMode mode_;  // Specifies whether this is a read or write lock request.
-    };
-    unordered_map<Key, deque<LockRequest>*> lock_table_;
+    //
+    // Queues are stored inline in a flat open-addressing table, and a queue
+    // only exists while it is non-empty (see LockTable).
+    LockTable lock_table_;
 
     // Queue of pointers to transactions that:
     //  (a) were previously blocked on acquiring at least one lock, and
@@ -109,7 +97,14 @@ class LockManager
     // Tracks all txns still waiting on acquiring at least one lock. Entries in
     // 'txn_waits_' are invalided by any call to Release() with the entry's
     // txn.
-    unordered_map<Txn*, int> txn_waits_;
+    WaitTable txn_waits_;
+
+    // Called when 'txn' was granted a lock it had to wait for. Appends 'txn'
+    // to 'ready_txns_' once it holds all of its locks.
+    void Grant(Txn* txn);
+
+    // Removes 'queue' from the lock table if it is empty.
+    void Prune(LockQueue* queue);
 };
 
 // Version of the LockManager implementing ONLY exclusive locks.
@@ -136,4 +131,160 @@ class LockManagerB : public LockManager
     virtual LockMode Status(const Key& key, vector<Txn*>* owners);
 };
 
+// Version of LockManagerB for a bounded key space [key_begin, key_end), such as
+// the keys created by Storage::InitStorage(). Every key in the range has a
+// 32-byte header in a flat array that is preallocated up front and indexed by
+// key. While the key is locked by one EXCLUSIVE holder or up to kHolders SHARED
+// holders and nobody waits for it, its header alone records the lock: locking
+// and releasing touch a single cache line and never allocate. A request that
+// would have to wait moves the key's requests into the hashed lock table of
+// LockManagerB, where they stay until every remaining request holds the lock
+// again. Keys outside the range always use the hashed table.
+class DenseLockManager : public LockManagerB
+{
+   public:
+    DenseLockManager(deque<Txn*>* ready_txns, Key key_begin, Key key_end);
+    virtual ~DenseLockManager();
+    virtual bool ReadLock(Txn* txn, const Key& key);
+    virtual bool WriteLock(Txn* txn, const Key& key);
+    virtual void Release(Txn* txn, const Key& key);
+    virtual LockMode Status(const Key& key, vector<Txn*>* owners);
+
+    // Returns true if the requests on 'key' are kept in the hashed lock table
+    // rather than in the key's header.
+    bool Hashed(const Key& key);
+
+   private:
+    static const int kHolders = 3;
+
+    // Lock state of one key in the range.
+    struct DenseLock
+    {
+        Txn* holders_[kHolders];  // Txns holding the lock, oldest first.
+        uint16 count_;            // Number of entries in 'holders_'.
+        uint16 mode_;             // LockMode in which 'holders_' hold the lock.
+        uint32 hashed_;           // Non-zero if the key's requests are in 'lock_table_'.
+    };
+
+    // Returns the header of 'key', or NULL if 'key' is outside the range.
+    DenseLock* Header(Key key)
+    {
+        return key - key_begin_ < key_count_ ? &locks_[key - key_begin_] : NULL;
+    }
+
+    // Grants 'txn' a lock on 'key', or queues its request in the hashed table
+    // if the lock is already held. Returns true if the lock was granted.
+    bool Lock(Txn* txn, const Key& key, LockMode mode);
+
+    // Disallow copying.
+    DenseLockManager(const DenseLockManager&);
+    DenseLockManager& operator=(const DenseLockManager&);
+
+    Key key_begin_;
+    uint64 key_count_;
+    DenseLock* locks_;
+};
+
+// How an OnlineLockManager keeps txns that request conflicting locks from
+// deadlocking. Txns are ordered by timestamp, smaller (older) first.
+enum DeadlockPolicy
+{
+    NO_WAIT    = 0,  // Requests that conflict abort right away
+    WAIT_DIE   = 1,  // Older requesters wait, younger ones abort
+    WOUND_WAIT = 2,  // Older requesters abort the younger holders and wait,
+                     // younger ones wait
+};
+
+// Counters of an OnlineLockManager.
+struct LockingStats
+{
+    LockingStats() : attempts_(0), aborts_(0), waits_(0) {}
+    uint64 attempts_;  // Attempts at running a txn
+    uint64 aborts_;    // Attempts aborted by the deadlock policy, and retried
+    uint64 waits_;     // Lock requests that had to wait
+};
+
+// Lock manager for non-deterministic two-phase locking over a bounded key
+// space [0, key_count). Unlike the LockManagers above, which are driven by a
+// single thread and queue every request of a txn up front, it is shared by the
+// worker threads, which request locks one at a time while they run a txn and
+// wait for them themselves. Conflicts are resolved by the DeadlockPolicy, and
+// a txn aborted by it releases its locks and is retried.
+//
+// Each key has a 16-byte entry holding a latch, and the set of workers holding
+// its lock as a bitmask, so workers are identified by ids below kMaxWorkers.
+// Waiting workers spin on the entry. There is no queue, but the entry records
+// the oldest waiter, and younger txns do not take the lock ahead of it, so the
+// oldest txn is never starved.
+class OnlineLockManager
+{
+   public:
+    static const int kMaxWorkers = 64;
+
+    OnlineLockManager(DeadlockPolicy policy, Key key_count);
+    ~OnlineLockManager();
+
+    // Starts an attempt by 'worker' at running a txn with timestamp 'ts'. A
+    // txn keeps its timestamp when it is retried, so it eventually becomes
+    // the oldest one and can no longer be aborted by WAIT_DIE or WOUND_WAIT.
+    //
+    // Requires: 'worker' holds no locks.
+    void Begin(int worker, uint64 ts);
+
+    // Grants 'worker' a lock on 'key' in 'mode', waiting for conflicting
+    // holders where the policy allows it. A SHARED lock held by 'worker' is
+    // upgraded to EXCLUSIVE. Returns false if the attempt must abort instead.
+    bool Lock(int worker, const Key& key, LockMode mode);
+
+    // Releases the lock 'worker' holds on 'key', if any.
+    void Release(int worker, const Key& key);
+
+    // Returns true if the attempt of 'worker' was wounded by an older txn
+    // (WOUND_WAIT only), in which case it must abort rather than commit.
+    bool Wounded(int worker);
+
+    // Sets '*owners' to the ids of the workers holding the lock on 'key', and
+    // returns its current LockMode.
+    LockMode Status(const Key& key, vector<int>* owners);
+
+    // Returns the counters, summed over all workers.
+    LockingStats Stats();
+
+   private:
+    // Lock state of one key.
+    struct Entry
+    {
+        std::atomic<uint32> latch_;
+        uint16 exclusive_;  // Non-zero if 'owners_' holds the lock EXCLUSIVE.
+        uint16 waiter_;     // 1 + id of the oldest waiting worker, or 0.
+        uint64 owners_;     // Bit i is set if worker i holds the lock.
+    };
+
+    // State of the attempt a worker is running, written by the worker only
+    // (except for 'wounded_'), and its counters.
+    struct Worker
+    {
+        std::atomic<uint64> ts_;
+        std::atomic<bool> wounded_;
+        std::atomic<uint64> attempts_;
+        std::atomic<uint64> aborts_;
+        std::atomic<uint64> waits_;
+        char pad_[CACHE_LINE_SIZE - 5 * sizeof(uint64)];
+    };
+
+    Entry* Latch(const Key& key);
+    void Unlatch(Entry* entry) { entry->latch_.store(0, std::memory_order_release); }
+    // Counts an aborted attempt of 'worker'.
+    void Abort(Worker* worker);
+
+    // Disallow copying.
+    OnlineLockManager(const OnlineLockManager&);
+    OnlineLockManager& operator=(const OnlineLockManager&);
+
+    DeadlockPolicy policy_;
+    Key key_count_;
+    Entry* entries_;
+    Worker workers_[kMaxWorkers];
+};
+
 #endif  // _LOCK_MANAGER_H_
@@ -187,10 +187,271 @@ TEST(LockManagerB_LocksReleasedOutOfOrder)
     END;
 }
 
+TEST(DenseLockManager_SimpleLocking)
+{
+    deque<Txn*> ready_txns;
+    DenseLockManager lm(&ready_txns, 0, 1000);
+    vector<Txn*> owners;
+
+    Txn* t1 = reinterpret_cast<Txn*>(1);
+    Txn* t2 = reinterpret_cast<Txn*>(2);
+    Txn* t3 = reinterpret_cast<Txn*>(3);
+
+    // Txn 1 acquires read lock.
+    EXPECT_TRUE(lm.ReadLock(t1, 101));
+    ready_txns.push_back(t1);  // Txn 1 is ready.
+    EXPECT_EQ(SHARED, lm.Status(101, &owners));
+    EXPECT_EQ(1, owners.size());
+    EXPECT_EQ(t1, owners[0]);
+
+    // Txn 2 requests write lock. Not granted.
+    EXPECT_FALSE(lm.WriteLock(t2, 101));
+    EXPECT_EQ(SHARED, lm.Status(101, &owners));
+    EXPECT_EQ(1, owners.size());
+    EXPECT_EQ(t1, owners[0]);
+
+    // Txn 3 requests read lock. Not granted.
+    EXPECT_FALSE(lm.ReadLock(t3, 101));
+    EXPECT_EQ(1, ready_txns.size());
+
+    // Txn 1 releases lock.  Txn 2 is granted write lock.
+    lm.Release(t1, 101);
+    EXPECT_EQ(EXCLUSIVE, lm.Status(101, &owners));
+    EXPECT_EQ(1, owners.size());
+    EXPECT_EQ(t2, owners[0]);
+    EXPECT_EQ(2, ready_txns.size());
+    EXPECT_EQ(t2, ready_txns.at(1));
+
+    // Txn 2 releases lock.  Txn 3 is granted read lock.
+    lm.Release(t2, 101);
+    EXPECT_EQ(SHARED, lm.Status(101, &owners));
+    EXPECT_EQ(1, owners.size());
+    EXPECT_EQ(t3, owners[0]);
+    EXPECT_EQ(3, ready_txns.size());
+    EXPECT_EQ(t3, ready_txns.at(2));
+
+    // Txn 3 releases lock.  Nobody holds it any more, and it can be taken
+    // again without waiting.
+    lm.Release(t3, 101);
+    EXPECT_EQ(UNLOCKED, lm.Status(101, &owners));
+    EXPECT_EQ(0, owners.size());
+    EXPECT_TRUE(lm.WriteLock(t1, 101));
+    EXPECT_EQ(EXCLUSIVE, lm.Status(101, &owners));
+    EXPECT_EQ(t1, owners[0]);
+
+    END;
+}
+
+TEST(DenseLockManager_SharedHolders)
+{
+    deque<Txn*> ready_txns;
+    DenseLockManager lm(&ready_txns, 0, 1000);
+    vector<Txn*> owners;
+
+    Txn* t1 = reinterpret_cast<Txn*>(1);
+    Txn* t2 = reinterpret_cast<Txn*>(2);
+    Txn* t3 = reinterpret_cast<Txn*>(3);
+    Txn* t4 = reinterpret_cast<Txn*>(4);
+    Txn* t5 = reinterpret_cast<Txn*>(5);
+
+    // Up to three readers share the lock in the key's header.
+    EXPECT_TRUE(lm.ReadLock(t1, 101));
+    EXPECT_TRUE(lm.ReadLock(t2, 101));
+    EXPECT_TRUE(lm.ReadLock(t3, 101));
+    EXPECT_FALSE(lm.Hashed(101));
+    EXPECT_EQ(SHARED, lm.Status(101, &owners));
+    EXPECT_EQ(3, owners.size());
+    EXPECT_EQ(t3, owners[2]);
+
+    // A fourth one moves the readers to the hashed table, and goes back once
+    // it is done.
+    EXPECT_TRUE(lm.ReadLock(t4, 101));
+    EXPECT_TRUE(lm.Hashed(101));
+    EXPECT_EQ(SHARED, lm.Status(101, &owners));
+    EXPECT_EQ(4, owners.size());
+    lm.Release(t4, 101);
+    EXPECT_FALSE(lm.Hashed(101));
+    EXPECT_EQ(SHARED, lm.Status(101, &owners));
+    EXPECT_EQ(3, owners.size());
+
+    // A writer waits in the hashed table until every reader is gone, and
+    // then holds the lock in the header.
+    EXPECT_FALSE(lm.WriteLock(t5, 101));
+    EXPECT_TRUE(lm.Hashed(101));
+    lm.Release(t2, 101);
+    lm.Release(t1, 101);
+    EXPECT_EQ(SHARED, lm.Status(101, &owners));
+    EXPECT_EQ(1, owners.size());
+    EXPECT_EQ(t3, owners[0]);
+    EXPECT_EQ(0, ready_txns.size());
+    lm.Release(t3, 101);
+    EXPECT_FALSE(lm.Hashed(101));
+    EXPECT_EQ(EXCLUSIVE, lm.Status(101, &owners));
+    EXPECT_EQ(t5, owners[0]);
+    EXPECT_EQ(1, ready_txns.size());
+
+    lm.Release(t5, 101);
+    EXPECT_EQ(UNLOCKED, lm.Status(101, &owners));
+
+    END;
+}
+
+TEST(DenseLockManager_KeysOutOfRange)
+{
+    deque<Txn*> ready_txns;
+    DenseLockManager lm(&ready_txns, 100, 200);
+    vector<Txn*> owners;
+
+    Txn* t1 = reinterpret_cast<Txn*>(1);
+    Txn* t2 = reinterpret_cast<Txn*>(2);
+    Txn* t3 = reinterpret_cast<Txn*>(3);
+
+    // Txn 1 locks a key below, in and above the range.
+    EXPECT_TRUE(lm.WriteLock(t1, 99));
+    EXPECT_TRUE(lm.WriteLock(t1, 150));
+    EXPECT_TRUE(lm.ReadLock(t1, 200));
+    ready_txns.push_back(t1);  // Txn 1 is ready.
+
+    // Txn 3 shares the key above the range, Txn 2 needs all three keys.
+    EXPECT_TRUE(lm.ReadLock(t3, 200));
+    ready_txns.push_back(t3);  // Txn 3 is ready.
+    EXPECT_FALSE(lm.ReadLock(t2, 99));
+    EXPECT_FALSE(lm.ReadLock(t2, 150));
+    EXPECT_FALSE(lm.WriteLock(t2, 200));
+
+    EXPECT_EQ(SHARED, lm.Status(200, &owners));
+    EXPECT_EQ(2, owners.size());
+    EXPECT_EQ(t1, owners[0]);
+    EXPECT_EQ(t3, owners[1]);
+
+    lm.Release(t1, 99);
+    lm.Release(t1, 150);
+    lm.Release(t1, 200);
+    EXPECT_EQ(SHARED, lm.Status(99, &owners));
+    EXPECT_EQ(t2, owners[0]);
+    EXPECT_EQ(SHARED, lm.Status(150, &owners));
+    EXPECT_EQ(t2, owners[0]);
+    EXPECT_EQ(SHARED, lm.Status(200, &owners));
+    EXPECT_EQ(1, owners.size());
+    EXPECT_EQ(t3, owners[0]);
+    EXPECT_EQ(2, ready_txns.size());
+
+    // Txn 2 gets its last lock once Txn 3 is done.
+    lm.Release(t3, 200);
+    EXPECT_EQ(EXCLUSIVE, lm.Status(200, &owners));
+    EXPECT_EQ(1, owners.size());
+    EXPECT_EQ(t2, owners[0]);
+    EXPECT_EQ(3, ready_txns.size());
+    EXPECT_EQ(t2, ready_txns.at(2));
+
+    END;
+}
+
+TEST(OnlineLockManager_NoWait)
+{
+    OnlineLockManager lm(NO_WAIT, 1000);
+    vector<int> owners;
+
+    lm.Begin(0, 10);
+    lm.Begin(1, 20);
+
+    // Shared locks are compatible; anything else aborts the requester.
+    EXPECT_TRUE(lm.Lock(0, 101, SHARED));
+    EXPECT_TRUE(lm.Lock(1, 101, SHARED));
+    EXPECT_EQ(SHARED, lm.Status(101, &owners));
+    EXPECT_EQ(2, owners.size());
+    EXPECT_FALSE(lm.Lock(0, 101, EXCLUSIVE));
+
+    // Once Worker 1 is gone, Worker 0 can upgrade its lock.
+    lm.Release(1, 101);
+    EXPECT_TRUE(lm.Lock(0, 101, EXCLUSIVE));
+    EXPECT_EQ(EXCLUSIVE, lm.Status(101, &owners));
+    EXPECT_EQ(1, owners.size());
+    EXPECT_EQ(0, owners[0]);
+    EXPECT_FALSE(lm.Lock(1, 101, SHARED));
+
+    lm.Release(0, 101);
+    EXPECT_EQ(UNLOCKED, lm.Status(101, &owners));
+    EXPECT_EQ(0, owners.size());
+
+    LockingStats stats = lm.Stats();
+    EXPECT_EQ(2, stats.attempts_);
+    EXPECT_EQ(2, stats.aborts_);
+    EXPECT_EQ(0, stats.waits_);
+
+    END;
+}
+
+TEST(OnlineLockManager_WaitDie)
+{
+    OnlineLockManager lm(WAIT_DIE, 1000);
+
+    // Worker 0 runs the older txn, and holds the lock.
+    lm.Begin(0, 10);
+    lm.Begin(1, 20);
+    EXPECT_TRUE(lm.Lock(0, 101, EXCLUSIVE));
+
+    // The younger txn dies rather than wait for it.
+    EXPECT_FALSE(lm.Lock(1, 101, SHARED));
+    EXPECT_FALSE(lm.Wounded(0));
+
+    // Retried with its old timestamp, it gets the lock once it is free.
+    lm.Release(0, 101);
+    lm.Begin(1, 20);
+    EXPECT_TRUE(lm.Lock(1, 101, SHARED));
+
+    LockingStats stats = lm.Stats();
+    EXPECT_EQ(3, stats.attempts_);
+    EXPECT_EQ(1, stats.aborts_);
+
+    END;
+}
+
+// Requests an exclusive lock on key 101 as worker 0, running the txn with
+// timestamp 10.
+static void* LockAsOldest(void* arg)
+{
+    OnlineLockManager* lm = reinterpret_cast<OnlineLockManager*>(arg);
+    lm->Begin(0, 10);
+    return reinterpret_cast<void*>(lm->Lock(0, 101, EXCLUSIVE));
+}
+
+TEST(OnlineLockManager_WoundWait)
+{
+    OnlineLockManager lm(WOUND_WAIT, 1000);
+    vector<int> owners;
+
+    // Worker 1 runs the younger txn, and holds the lock.
+    lm.Begin(1, 20);
+    EXPECT_TRUE(lm.Lock(1, 101, EXCLUSIVE));
+
+    // The older txn wounds it and waits until it has released the lock.
+    pthread_t oldest;
+    pthread_create(&oldest, NULL, LockAsOldest, &lm);
+    while (!lm.Wounded(1)) usleep(100);
+    EXPECT_FALSE(lm.Lock(1, 102, SHARED));
+    lm.Release(1, 101);
+
+    void* granted;
+    pthread_join(oldest, &granted);
+    EXPECT_TRUE(granted != NULL);
+    EXPECT_EQ(EXCLUSIVE, lm.Status(101, &owners));
+    EXPECT_EQ(0, owners[0]);
+    EXPECT_EQ(1, lm.Stats().waits_);
+
+    END;
+}
+
 int main(int argc, char** argv)
 {
     LockManagerA_SimpleLocking();
     LockManagerA_LocksReleasedOutOfOrder();
     LockManagerB_SimpleLocking();
     LockManagerB_LocksReleasedOutOfOrder();
+    DenseLockManager_SimpleLocking();
+    DenseLockManager_SharedHolders();
+    DenseLockManager_KeysOutOfRange();
+    OnlineLockManager_NoWait();
+    OnlineLockManager_WaitDie();
+    OnlineLockManager_WoundWait();
 }
@@ -0,0 +1,422 @@
+
+#include "txn/lock_table.h"
+
+#include <string.h>
+
+#include "utils/mutex.h"
+
+static_assert(sizeof(LockQueue) == CACHE_LINE_SIZE, "LockQueue should fill exactly one cache line");
+static_assert(sizeof(LockRequestNode) == CACHE_LINE_SIZE, "LockRequestNode should fill exactly one cache line");
+
+// Returns a zeroed, cache-line aligned block of 'size' bytes.
+static void* AllocAligned(size_t size)
+{
+    void* mem;
+    if (posix_memalign(&mem, CACHE_LINE_SIZE, size) != 0) DIE("out of memory");
+    memset(mem, 0, size);
+    return mem;
+}
+
+// Returns the smallest power of two that is at least 'capacity' and 16, and
+// sets '*shift' so that (hash >> *shift) indexes a table of that size.
+static size_t RoundCapacity(int capacity, int* shift)
+{
+    size_t size = 16;
+    *shift      = 60;
+    while (size < static_cast<size_t>(capacity))
+    {
+        size <<= 1;
+        (*shift)--;
+    }
+    return size;
+}
+
+// Returns the number of trailing SHARED requests among the lowest 'n' bits of
+// the EXCLUSIVE bitmask 'bits'.
+static inline int SharedPrefix(uint32 bits, int n)
+{
+    bits &= (1u << n) - 1;
+    return bits == 0 ? n : __builtin_ctz(bits);
+}
+
+LockRequestPool::~LockRequestPool()
+{
+    while (free_ != NULL)
+    {
+        LockRequestNode* node = free_;
+        free_                 = node->next_;
+        delete node;
+    }
+}
+
+LockRequestNode* LockRequestPool::Alloc()
+{
+    LockRequestNode* node;
+    if (free_ != NULL)
+    {
+        node  = free_;
+        free_ = node->next_;
+        free_count_--;
+    }
+    else
+    {
+        node = new LockRequestNode();
+    }
+    node->exclusive_ = 0;
+    node->next_      = NULL;
+    return node;
+}
+
+void LockRequestPool::Free(LockRequestNode* node)
+{
+    if (free_count_ == kMaxFree)
+    {
+        delete node;
+        return;
+    }
+    node->next_ = free_;
+    free_       = node;
+    free_count_++;
+}
+
+// Position of a request in a LockQueue: a slot of the queue itself, or a slot
+// of one of its overflow nodes. Walking a queue with a cursor visits each node
+// once, instead of once per request.
+class LockQueueCursor
+{
+   public:
+    // Positions the cursor at request 'i' of 'queue'.
+    LockQueueCursor(LockQueue* queue, int i) : queue_(queue), node_(NULL), prev_(NULL), index_(i), inline_(true)
+    {
+        if (i < LockQueue::kInline) return;
+        inline_ = false;
+        node_   = queue->overflow_;
+        index_  = i - LockQueue::kInline;
+        while (index_ >= LockRequestNode::kRequests)
+        {
+            prev_ = node_;
+            node_ = node_->next_;
+            index_ -= LockRequestNode::kRequests;
+        }
+    }
+
+    LockRequest Get() const
+    {
+        Txn* txn    = inline_ ? queue_->txns_[index_] : node_->txns_[index_];
+        uint32 bits = inline_ ? queue_->exclusive_ : node_->exclusive_;
+        return LockRequest((bits >> index_) & 1 ? EXCLUSIVE : SHARED, txn);
+    }
+
+    void Put(const LockRequest& request)
+    {
+        Txn** txns   = inline_ ? queue_->txns_ : node_->txns_;
+        uint32* bits = inline_ ? &queue_->exclusive_ : &node_->exclusive_;
+        txns[index_] = request.txn_;
+        if (request.mode_ == EXCLUSIVE)
+        {
+            *bits |= 1u << index_;
+        }
+        else
+        {
+            *bits &= ~(1u << index_);
+        }
+    }
+
+    // Moves to the next request. May step past the last allocated node, after
+    // which only Next() may be called.
+    void Next()
+    {
+        index_++;
+        if (inline_ && index_ == LockQueue::kInline)
+        {
+            inline_ = false;
+            node_   = queue_->overflow_;
+            index_  = 0;
+        }
+        else if (!inline_ && index_ == LockRequestNode::kRequests)
+        {
+            prev_  = node_;
+            node_  = node_ != NULL ? node_->next_ : NULL;
+            index_ = 0;
+        }
+    }
+
+    // If the cursor is at the first slot of an overflow node, unlinks that node
+    // from the queue and returns it to 'pool'.
+    void FreeNodeIfFirst(LockRequestPool* pool)
+    {
+        if (inline_ || index_ != 0 || node_ == NULL) return;
+        if (prev_ != NULL)
+        {
+            prev_->next_ = NULL;
+        }
+        else
+        {
+            queue_->overflow_ = NULL;
+        }
+        pool->Free(node_);
+        node_ = NULL;
+    }
+
+   private:
+    LockQueue* queue_;
+    LockRequestNode* node_;
+    LockRequestNode* prev_;
+    int index_;
+    bool inline_;
+};
+
+LockRequest LockQueue::At(int i) const
+{
+    return LockQueueCursor(const_cast<LockQueue*>(this), i).Get();
+}
+
+int LockQueue::Find(Txn* txn) const
+{
+    int n = size_ < static_cast<uint32>(kInline) ? size_ : kInline;
+    for (int i = 0; i < n; i++)
+    {
+        if (txns_[i] == txn) return i;
+    }
+
+    int base = kInline;
+    for (LockRequestNode* node = overflow_; node != NULL; node = node->next_)
+    {
+        n = size_ - base < static_cast<uint32>(LockRequestNode::kRequests) ? size_ - base : LockRequestNode::kRequests;
+        for (int i = 0; i < n; i++)
+        {
+            if (node->txns_[i] == txn) return base + i;
+        }
+        base += LockRequestNode::kRequests;
+    }
+    return -1;
+}
+
+int LockQueue::GrantedCount() const
+{
+    if (size_ == 0) return 0;
+    if (exclusive_ & 1) return 1;
+
+    int n       = size_ < static_cast<uint32>(kInline) ? size_ : kInline;
+    int granted = SharedPrefix(exclusive_, n);
+    if (granted < n) return granted;
+
+    for (LockRequestNode* node = overflow_; granted < static_cast<int>(size_); node = node->next_)
+    {
+        n          = size_ - granted < static_cast<uint32>(LockRequestNode::kRequests) ? size_ - granted
+                                                                                      : LockRequestNode::kRequests;
+        int shared = SharedPrefix(node->exclusive_, n);
+        granted += shared;
+        if (shared < n) break;
+    }
+    return granted;
+}
+
+void LockQueue::PushBack(const LockRequest& request, LockRequestPool* pool)
+{
+    if (size_ >= static_cast<uint32>(kInline))
+    {
+        // The node for the new request is the last one, or a new one if the
+        // last one is full. Erase() frees nodes as soon as they are empty, so
+        // that is exactly when the link is NULL.
+        LockRequestNode** link = &overflow_;
+        for (int i = size_ - kInline; i >= LockRequestNode::kRequests; i -= LockRequestNode::kRequests)
+        {
+            link = &(*link)->next_;
+        }
+        if (*link == NULL) *link = pool->Alloc();
+    }
+    LockQueueCursor(this, size_).Put(request);
+    size_++;
+}
+
+void LockQueue::Erase(int i, LockRequestPool* pool)
+{
+    LockQueueCursor dst(this, i);
+    LockQueueCursor src(this, i);
+    src.Next();
+    for (int j = i + 1; j < static_cast<int>(size_); j++)
+    {
+        dst.Put(src.Get());
+        dst.Next();
+        src.Next();
+    }
+    size_--;
+
+    // 'dst' is now at the slot freed up at the end of the queue.
+    dst.FreeNodeIfFirst(pool);
+}
+
+LockTable::LockTable(int capacity) : count_(0)
+{
+    size_t size = RoundCapacity(capacity, &shift_);
+    mask_       = size - 1;
+    buckets_    = reinterpret_cast<LockQueue*>(AllocAligned(size * sizeof(LockQueue)));
+}
+
+LockTable::~LockTable()
+{
+    for (size_t i = 0; i <= mask_; i++)
+    {
+        LockRequestNode* node = buckets_[i].size_ > 0 ? buckets_[i].overflow_ : NULL;
+        while (node != NULL)
+        {
+            LockRequestNode* next = node->next_;
+            delete node;
+            node = next;
+        }
+    }
+    free(buckets_);
+}
+
+LockQueue* LockTable::Find(Key key)
+{
+    for (size_t i = Home(key);; i = (i + 1) & mask_)
+    {
+        LockQueue* queue = &buckets_[i];
+        if (queue->size_ == 0) return NULL;
+        if (queue->key_ == key) return queue;
+    }
+}
+
+LockQueue* LockTable::Append(Key key, const LockRequest& request)
+{
+    LockQueue* queue = Find(key);
+    if (queue == NULL)
+    {
+        // Keep the table at most half full.
+        if (2 * (count_ + 1) > mask_ + 1) Grow();
+        size_t i = Home(key);
+        while (buckets_[i].size_ != 0) i = (i + 1) & mask_;
+
+        queue             = &buckets_[i];
+        queue->key_       = key;
+        queue->exclusive_ = 0;
+        queue->overflow_  = NULL;
+        count_++;
+    }
+    queue->PushBack(request, &pool_);
+    return queue;
+}
+
+void LockTable::Remove(LockQueue* queue)
+{
+    assert(queue->size_ == 0 && queue->overflow_ == NULL);
+    count_--;
+
+    // Move later entries of the probe run into the hole, unless that would put
+    // them before their home bucket.
+    size_t hole = queue - buckets_;
+    for (size_t i = (hole + 1) & mask_; buckets_[i].size_ != 0; i = (i + 1) & mask_)
+    {
+        size_t home = Home(buckets_[i].key_);
+        bool stays  = hole <= i ? (hole < home && home <= i) : (hole < home || home <= i);
+        if (stays) continue;
+
+        buckets_[hole] = buckets_[i];
+        hole           = i;
+    }
+    buckets_[hole].size_     = 0;
+    buckets_[hole].overflow_ = NULL;
+}
+
+void LockTable::Grow()
+{
+    LockQueue* old  = buckets_;
+    size_t old_size = mask_ + 1;
+    buckets_        = reinterpret_cast<LockQueue*>(AllocAligned(2 * old_size * sizeof(LockQueue)));
+    mask_           = 2 * old_size - 1;
+    shift_--;
+
+    for (size_t j = 0; j < old_size; j++)
+    {
+        if (old[j].size_ == 0) continue;
+        size_t i = Home(old[j].key_);
+        while (buckets_[i].size_ != 0) i = (i + 1) & mask_;
+        buckets_[i] = old[j];
+    }
+    free(old);
+}
+
+WaitTable::WaitTable(int capacity) : count_(0)
+{
+    size_t size = RoundCapacity(capacity, &shift_);
+    mask_       = size - 1;
+    entries_    = reinterpret_cast<Entry*>(AllocAligned(size * sizeof(Entry)));
+}
+
+WaitTable::~WaitTable() { free(entries_); }
+WaitTable::Entry* WaitTable::Find(Txn* txn)
+{
+    for (size_t i = Home(txn);; i = (i + 1) & mask_)
+    {
+        if (entries_[i].txn_ == txn) return &entries_[i];
+        if (entries_[i].txn_ == NULL) return NULL;
+    }
+}
+
+void WaitTable::Increment(Txn* txn)
+{
+    Entry* entry = Find(txn);
+    if (entry == NULL)
+    {
+        if (2 * (count_ + 1) > mask_ + 1) Grow();
+        size_t i = Home(txn);
+        while (entries_[i].txn_ != NULL) i = (i + 1) & mask_;
+
+        entry         = &entries_[i];
+        entry->txn_   = txn;
+        entry->waits_ = 0;
+        count_++;
+    }
+    entry->waits_++;
+}
+
+bool WaitTable::Decrement(Txn* txn)
+{
+    Entry* entry = Find(txn);
+    if (entry == NULL) return false;
+    if (--entry->waits_ > 0) return false;
+    Remove(entry);
+    return true;
+}
+
+void WaitTable::Erase(Txn* txn)
+{
+    Entry* entry = Find(txn);
+    if (entry != NULL) Remove(entry);
+}
+
+void WaitTable::Remove(Entry* entry)
+{
+    count_--;
+    size_t hole = entry - entries_;
+    for (size_t i = (hole + 1) & mask_; entries_[i].txn_ != NULL; i = (i + 1) & mask_)
+    {
+        size_t home = Home(entries_[i].txn_);
+        bool stays  = hole <= i ? (hole < home && home <= i) : (hole < home || home <= i);
+        if (stays) continue;
+
+        entries_[hole] = entries_[i];
+        hole           = i;
+    }
+    entries_[hole].txn_ = NULL;
+}
+
+void WaitTable::Grow()
+{
+    Entry* old      = entries_;
+    size_t old_size = mask_ + 1;
+    entries_        = reinterpret_cast<Entry*>(AllocAligned(2 * old_size * sizeof(Entry)));
+    mask_           = 2 * old_size - 1;
+    shift_--;
+
+    for (size_t j = 0; j < old_size; j++)
+    {
+        if (old[j].txn_ == NULL) continue;
+        size_t i = Home(old[j].txn_);
+        while (entries_[i].txn_ != NULL) i = (i + 1) & mask_;
+        entries_[i] = old[j];
+    }
+    free(old);
+}
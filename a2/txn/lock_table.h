@@ -0,0 +1,192 @@
+
+// Flat, cache-friendly lock table used by the lock managers.
+
+#ifndef _LOCK_TABLE_H_
+#define _LOCK_TABLE_H_
+
+#include "txn/common.h"
+#include "utils/slab_allocator.h"
+
+class Txn;
+
+// This interface supports locks being held in both read/shared and
+// write/exclusive modes.
+enum LockMode
+{
+    UNLOCKED  = 0,
+    SHARED    = 1,
+    EXCLUSIVE = 2,
+};
+
+// A single request for a lock on some key.
+struct LockRequest
+{
+    LockRequest(LockMode m, Txn* t) : txn_(t), mode_(m) {}
+    Txn* txn_;       // Pointer to txn requesting the lock.
+    LockMode mode_;  // Specifies whether this is a read or write lock request.
+};
+
+// Block of requests that did not fit in their LockQueue. One cache line, and
+// cache-line aligned.
+struct LockRequestNode
+{
+    static void* operator new(size_t size) { return SlabAllocator::Allocate(size); }
+    static void operator delete(void* ptr, size_t size) { SlabAllocator::Free(ptr, size); }
+    static const int kRequests = 6;
+    Txn* txns_[kRequests];
+    uint32 exclusive_;  // Bit i is set if request i is EXCLUSIVE.
+    LockRequestNode* next_;
+};
+
+// Free list of LockRequestNodes in front of the slab allocator. Keeps up to
+// kMaxFree freed nodes for reuse by the same lock table, and returns the rest
+// to the slab allocator.
+class LockRequestPool
+{
+   public:
+    LockRequestPool() : free_(NULL), free_count_(0) {}
+    ~LockRequestPool();
+
+    LockRequestNode* Alloc();
+    void Free(LockRequestNode* node);
+
+   private:
+    static const int kMaxFree = 256;
+
+    // Disallow copying.
+    LockRequestPool(const LockRequestPool&);
+    LockRequestPool& operator=(const LockRequestPool&);
+
+    LockRequestNode* free_;
+    int free_count_;
+};
+
+// FIFO of the lock requests on one key, oldest first. The first kInline
+// requests are stored in the queue itself and the rest in a chain of
+// LockRequestNodes, so a key with a handful of requests takes up a single cache
+// line. The Txn pointers are only compared, never dereferenced.
+//
+// A LockQueue is plain data: it lives inside a LockTable bucket and is moved
+// around with the bucket.
+struct LockQueue
+{
+    static const int kInline = 5;
+
+    // Returns the number of requests in the queue.
+    int Size() const { return size_; }
+    // Returns the i-th oldest request.
+    LockRequest At(int i) const;
+
+    // Returns the position of the request by 'txn', or -1 if there is none.
+    int Find(Txn* txn) const;
+
+    // Returns the number of requests at the front of the queue that currently
+    // hold the lock: the first one if it is EXCLUSIVE, otherwise the longest
+    // run of SHARED requests.
+    int GrantedCount() const;
+
+    // Appends 'request', taking a node from 'pool' if the queue overflows.
+    void PushBack(const LockRequest& request, LockRequestPool* pool);
+
+    // Removes the i-th oldest request, returning nodes that are no longer
+    // needed to 'pool'.
+    void Erase(int i, LockRequestPool* pool);
+
+    Key key_;
+    uint32 size_;
+    uint32 exclusive_;  // Bit i is set if inline request i is EXCLUSIVE.
+    Txn* txns_[kInline];
+    LockRequestNode* overflow_;
+};
+
+// Map from keys to their LockQueues, stored inline in one open-addressing
+// table with linear probing. A key is in the table exactly while its queue is
+// non-empty: Append adds it with its first request, and Remove must be called
+// as soon as its queue becomes empty. Removal shifts later entries back rather
+// than leaving tombstones, so probe sequences stay short.
+//
+// Pointers returned by Find and Append are invalidated by the next Append or
+// Remove.
+class LockTable
+{
+   public:
+    explicit LockTable(int capacity = 1024);
+    ~LockTable();
+
+    // Returns the queue for 'key', or NULL if no txn holds or waits for a lock
+    // on it.
+    LockQueue* Find(Key key);
+
+    // Appends 'request' to the queue for 'key', creating the queue if needed,
+    // and returns the queue.
+    LockQueue* Append(Key key, const LockRequest& request);
+
+    // Removes 'queue', which must be empty.
+    void Remove(LockQueue* queue);
+
+    // Pool that queues of this table take their overflow nodes from.
+    LockRequestPool* Pool() { return &pool_; }
+   private:
+    size_t Home(Key key) const { return (key * 0x9E3779B97F4A7C15ull) >> shift_; }
+    // Doubles the number of buckets.
+    void Grow();
+
+    // Disallow copying.
+    LockTable(const LockTable&);
+    LockTable& operator=(const LockTable&);
+
+    LockQueue* buckets_;
+    size_t mask_;
+    int shift_;
+    size_t count_;
+    LockRequestPool pool_;
+};
+
+// Number of locks each txn is still waiting for, in an open-addressing table
+// keyed by Txn pointer. It sits next to the lock table rather than inside the
+// Txn, since lock managers never dereference the Txn pointers they are given.
+class WaitTable
+{
+   public:
+    explicit WaitTable(int capacity = 256);
+    ~WaitTable();
+
+    // Records that 'txn' waits for one more lock.
+    void Increment(Txn* txn);
+
+    // Records that 'txn' was granted a lock it waited for. Returns true, and
+    // forgets 'txn', if it is no longer waiting for any lock; returns false if
+    // it still is or was not waiting at all.
+    bool Decrement(Txn* txn);
+
+    // Forgets 'txn'.
+    void Erase(Txn* txn);
+
+    // Returns true if no txn is waiting for a lock.
+    bool Empty() const { return count_ == 0; }
+
+   private:
+    struct Entry
+    {
+        Txn* txn_;  // NULL if the entry is empty.
+        int waits_;
+    };
+
+    size_t Home(Txn* txn) const { return (reinterpret_cast<uintptr_t>(txn) * 0x9E3779B97F4A7C15ull) >> shift_; }
+    // Returns the entry for 'txn', or NULL if there is none.
+    Entry* Find(Txn* txn);
+    void Remove(Entry* entry);
+    // Doubles the number of entries.
+    void Grow();
+
+    // Disallow copying.
+    WaitTable(const WaitTable&);
+    WaitTable& operator=(const WaitTable&);
+
+    Entry* entries_;
+    size_t mask_;
+    int shift_;
+    size_t count_;
+};
+
+#endif  // _LOCK_TABLE_H_
@@ -1,77 +1,284 @@
 
-
 #include "txn/mvcc_storage.h"
 
-// Init the storage
-void MVCCStorage::InitStorage()
+#include <new>
+
+#include "utils/huge_pages.h"
+
+void VersionStats::AddChain(uint64 length)
+{
+    int bucket = 0;
+    while (bucket < kChainBuckets - 1 && length > (1ull << bucket)) bucket++;
+    chain_lengths_[bucket]++;
+    versions_ += length;
+}
+
+template <typename KeyLock>
+MVCCStorage<KeyLock>::MVCCStorage(Key key_count) : key_count_(key_count)
 {
-    for (int i = 0; i < 1000000; i++)
+    static_assert(sizeof(KeyLock) > 16 || sizeof(Slot) == CACHE_LINE_SIZE,
+                  "slots with small locks should take one cache line");
+    void* mem = MapHugePages(key_count_ * sizeof(Slot), &mapped_bytes_);
+    if (mem == NULL) DIE("cannot map " << mapped_bytes_ << " bytes of storage");
+    slots_ = reinterpret_cast<Slot*>(mem);
+    for (Key key = 0; key < key_count_; key++)
     {
-        Write(i, 0, 0);
-        Mutex* key_mutex = new Mutex();
-        mutexs_[i]       = key_mutex;
+        new (&slots_[key].lock_) KeyLock();
+        slots_[key].version_id_.store(kNoVersion, std::memory_order_relaxed);
     }
 }
 
+// Init the storage
+template <typename KeyLock>
+void MVCCStorage<KeyLock>::InitStorage()
+{
+    for (Key key = 0; key < key_count_; key++) Write(key, 0, 0);
+}
+
 // Free memory.
-MVCCStorage::~MVCCStorage()
+template <typename KeyLock>
+MVCCStorage<KeyLock>::~MVCCStorage()
 {
-    for (unordered_map<Key, deque<Version*>*>::iterator it = mvcc_data_.begin(); it != mvcc_data_.end(); ++it)
+    for (Key key = 0; key < key_count_; key++)
     {
-        delete it->second;
+        Version* version = slots_[key].older_.load(std::memory_order_relaxed);
+        while (version != NULL)
+        {
+            Version* next = version->next_.load(std::memory_order_relaxed);
+            delete version;
+            version = next;
+        }
+        slots_[key].lock_.~KeyLock();
     }
+    UnmapHugePages(slots_, mapped_bytes_);
+}
+
+// Lock the key against other writers.
+template <typename KeyLock>
+void MVCCStorage<KeyLock>::Lock(Key key)
+{
+    if (key >= key_count_) DIE("key " << key << " is out of range");
+    slots_[key].lock_.Lock();
+    slots_[key].writer_.store(kUnchecked, std::memory_order_relaxed);
+}
+
+// Unlock the key.
+template <typename KeyLock>
+void MVCCStorage<KeyLock>::Unlock(Key key)
+{
+    slots_[key].writer_.store(0, std::memory_order_release);
+    slots_[key].lock_.Unlock();
+}
+
+template <typename KeyLock>
+std::atomic<uint64>* MVCCStorage<KeyLock>::Predecessor(Slot* slot, uint64 id)
+{
+    uint64 newest = slot->version_id_.load(std::memory_order_relaxed);
+    if (newest == kNoVersion) return NULL;
+    if (newest <= id) return &slot->max_read_id_;
+    Version* version = slot->older_.load(std::memory_order_relaxed);
+    while (version != NULL && version->version_id_ > id) version = version->next_.load(std::memory_order_relaxed);
+    return version == NULL ? NULL : &version->max_read_id_;
+}
 
-    mvcc_data_.clear();
+template <typename KeyLock>
+bool MVCCStorage<KeyLock>::Find(Slot* slot, uint64 id, uint64* seq, Value* value, std::atomic<uint64>** max_read_id)
+{
+    *seq = slot->seq_.load(std::memory_order_acquire);
+    if (*seq & 1) return false;
+    uint64 newest  = slot->version_id_.load(std::memory_order_relaxed);
+    *value         = slot->value_.load(std::memory_order_relaxed);
+    Version* older = slot->older_.load(std::memory_order_acquire);
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if (slot->seq_.load(std::memory_order_relaxed) != *seq) return false;
 
-    for (unordered_map<Key, Mutex*>::iterator it = mutexs_.begin(); it != mutexs_.end(); ++it)
+    // Find the version whose version_id is the largest one less than or equal
+    // to id.
+    if (newest != kNoVersion && newest <= id)
     {
-        delete it->second;
+        *max_read_id = &slot->max_read_id_;
+        return true;
     }
-
-    mutexs_.clear();
+    while (older != NULL && older->version_id_ > id) older = older->next_.load(std::memory_order_acquire);
+    if (older == NULL)
+    {
+        *max_read_id = NULL;
+        return true;
+    }
+    *value       = older->value_;
+    *max_read_id = &older->max_read_id_;
+    return true;
 }
 
-// Lock the key to protect its version_list. Remember to lock the key when you read/update the version_list
-void MVCCStorage::Lock(Key key) { mutexs_[key]->Lock(); }
-// Unlock the key.
-void MVCCStorage::Unlock(Key key) { mutexs_[key]->Unlock(); }
 // MVCC Read
-bool MVCCStorage::Read(Key key, Value* result, int txn_unique_id)
+template <typename KeyLock>
+bool MVCCStorage<KeyLock>::Read(Key key, Value* result, uint64 txn_unique_id)
 {
-    //
-    // Implement this method!
+    if (key >= key_count_) return false;
+    Slot* slot = &slots_[key];
 
-    // Hint: Iterate the version_lists and return the verion whose write timestamp
-    // (version_id) is the largest write timestamp less than or equal to txn_unique_id.
+    SpinWait spin;
+    while (true)
+    {
+        uint64 seq;
+        Value value;
+        std::atomic<uint64>* max_read_id;
+        if (!Find(slot, txn_unique_id, &seq, &value, &max_read_id))
+        {
+            spin.Wait();
+            continue;
+        }
+
+        // Record the read, then make sure no writer that this read should
+        // have seen got past CheckWrite in the meantime.
+        if (max_read_id != NULL)
+        {
+            uint64 read_id = max_read_id->load();
+            while (read_id < txn_unique_id && !max_read_id->compare_exchange_weak(read_id, txn_unique_id))
+            {
+            }
+        }
+        uint64 writer = slot->writer_.load();
+        if (writer != 0 && writer <= txn_unique_id)
+        {
+            while (slot->writer_.load(std::memory_order_acquire) == writer) spin.Wait();
+            continue;
+        }
+        // A write that moved the inline version may have lost the raise.
+        if (slot->seq_.load(std::memory_order_acquire) != seq) continue;
+
+        if (max_read_id == NULL) return false;
+        *result = value;
+        return true;
+    }
+}
+
+template <typename KeyLock>
+bool MVCCStorage<KeyLock>::ReadSnapshot(Key key, Value* result, uint64 snapshot)
+{
+    if (key >= key_count_) return false;
+    Slot* slot = &slots_[key];
 
+    SpinWait spin;
+    uint64 seq;
+    Value value;
+    std::atomic<uint64>* max_read_id;
+    while (!Find(slot, snapshot, &seq, &value, &max_read_id)) spin.Wait();
+    if (max_read_id == NULL) return false;
+    *result = value;
     return true;
 }
 
-// Check whether apply or abort the write
-bool MVCCStorage::CheckWrite(Key key, int txn_unique_id)
+template <typename KeyLock>
+uint64 MVCCStorage<KeyLock>::Timestamp(Key key)
 {
-    //
-    // Implement this method!
+    if (key >= key_count_) return 0;
+    uint64 newest = slots_[key].version_id_.load(std::memory_order_acquire);
+    return newest == kNoVersion ? 0 : newest;
+}
 
-    // Hint: Before all writes are applied, we need to make sure that each write
-    // can be safely applied based on MVCC timestamp ordering protocol. This method
-    // only checks one key, so you should call this method for each key in the
-    // write_set. Return true if this key passes the check, return false if not.
-    // Note that you don't have to call Lock(key) in this method, just
-    // call Lock(key) before you call this method and call Unlock(key) afterward.
+// Check whether apply or abort the write
+template <typename KeyLock>
+bool MVCCStorage<KeyLock>::CheckWrite(Key key, uint64 txn_unique_id)
+{
+    Slot* slot = &slots_[key];
 
-    return true;
+    // Announce the write before looking at the reads (see class comment).
+    slot->writer_.store(txn_unique_id);
+    std::atomic<uint64>* max_read_id = Predecessor(slot, txn_unique_id);
+    return max_read_id == NULL || max_read_id->load() <= txn_unique_id;
 }
 
 // MVCC Write, call this method only if CheckWrite return true.
-void MVCCStorage::Write(Key key, Value value, int txn_unique_id)
+template <typename KeyLock>
+void MVCCStorage<KeyLock>::Write(Key key, Value value, uint64 txn_unique_id)
+{
+    if (key >= key_count_) DIE("key " << key << " is out of range");
+    Slot* slot    = &slots_[key];
+    uint64 newest = slot->version_id_.load(std::memory_order_relaxed);
+
+    if (newest != kNoVersion && newest > txn_unique_id)
+    {
+        // Rare: a newer version already exists, so link the new one into the
+        // list of older versions, in order.
+        std::atomic<Version*>* link = &slot->older_;
+        Version* next               = link->load(std::memory_order_relaxed);
+        while (next != NULL && next->version_id_ > txn_unique_id)
+        {
+            link = &next->next_;
+            next = link->load(std::memory_order_relaxed);
+        }
+        Version* version     = new Version;
+        version->value_      = value;
+        version->version_id_ = txn_unique_id;
+        version->max_read_id_.store(txn_unique_id, std::memory_order_relaxed);
+        version->next_.store(next, std::memory_order_relaxed);
+        link->store(version, std::memory_order_release);
+        return;
+    }
+
+    // Move the inline version to the front of the list and replace it.
+    Version* older = slot->older_.load(std::memory_order_relaxed);
+    if (newest != kNoVersion && newest != txn_unique_id)
+    {
+        Version* version     = new Version;
+        version->value_      = slot->value_.load(std::memory_order_relaxed);
+        version->version_id_ = newest;
+        version->max_read_id_.store(slot->max_read_id_.load(), std::memory_order_relaxed);
+        version->next_.store(older, std::memory_order_relaxed);
+        older = version;
+    }
+
+    uint64 seq = slot->seq_.load(std::memory_order_relaxed);
+    slot->seq_.store(seq + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    slot->value_.store(value, std::memory_order_relaxed);
+    slot->version_id_.store(txn_unique_id, std::memory_order_relaxed);
+    slot->max_read_id_.store(txn_unique_id, std::memory_order_relaxed);
+    slot->older_.store(older, std::memory_order_release);
+    slot->seq_.store(seq + 2, std::memory_order_release);
+}
+
+template <typename KeyLock>
+void MVCCStorage<KeyLock>::CollectGarbage(Key begin, Key end, uint64 watermark, std::vector<Version*>* garbage,
+                                 VersionStats* stats)
 {
-    //
-    // Implement this method!
-
-    // Hint: Insert a new version (malloc a Version and specify its value/version_id/max_read_id)
-    // into the version_lists. Note that InitStorage() also calls this method to init storage.
-    // Note that you don't have to call Lock(key) in this method, just
-    // call Lock(key) before you call this method and call Unlock(key) afterward.
-    // Note that the performance would be much better if you organize the versions in decreasing order.
+    if (end > key_count_) end = key_count_;
+    for (Key key = begin; key < end; key++)
+    {
+        Slot* slot = &slots_[key];
+        if (!slot->lock_.TryLock()) continue;
+
+        // Find the newest version no newer than the watermark; everything
+        // after it goes.
+        uint64 newest = slot->version_id_.load(std::memory_order_relaxed);
+        uint64 length = newest == kNoVersion ? 0 : 1;
+        std::atomic<Version*>* cut = newest <= watermark ? &slot->older_ : NULL;
+        for (Version* version = slot->older_.load(std::memory_order_relaxed); cut == NULL && version != NULL;
+             version          = version->next_.load(std::memory_order_relaxed))
+        {
+            length++;
+            if (version->version_id_ <= watermark) cut = &version->next_;
+        }
+
+        Version* chain = cut == NULL ? NULL : cut->load(std::memory_order_relaxed);
+        if (chain != NULL)
+        {
+            cut->store(NULL, std::memory_order_release);
+            garbage->push_back(chain);
+            for (Version* version = chain; version != NULL; version = version->next_.load(std::memory_order_relaxed))
+            {
+                stats->unlinked_++;
+            }
+        }
+        stats->AddChain(length);
+
+        slot->lock_.Unlock();
+    }
 }
+
+// Key lock types MVCCStorage can be built with.
+template class MVCCStorage<Mutex>;
+template class MVCCStorage<TTASLock>;
+template class MVCCStorage<TicketLock>;
+template class MVCCStorage<MCSLock>;
@@ -2,54 +2,161 @@
 #ifndef _MVCC_STORAGE_H_
 #define _MVCC_STORAGE_H_
 
+#include <atomic>
+#include <vector>
+
 #include "txn/storage.h"
+#include "utils/mutex.h"
+#include "utils/slab_allocator.h"
 
-// MVCC 'version' structure
+// MVCC 'version' structure. Older versions of a record form a singly linked
+// list, newest first. Apart from 'max_read_id_', a version never changes once
+// it is linked in. Versions come from the slab allocator, whose per-thread
+// caches serve as each writer's arena.
 struct Version
 {
-    Value value_;      // The value of this version
-    int max_read_id_;  // Largest timestamp of a transaction that read the version
-    int version_id_;   // Timestamp of the transaction that created(wrote) the version
+    static void* operator new(size_t size) { return SlabAllocator::Allocate(size); }
+    static void operator delete(void* ptr, size_t size) { SlabAllocator::Free(ptr, size); }
+    Value value_;                      // The value of this version
+    std::atomic<uint64> max_read_id_;  // Largest timestamp of a transaction that read the version
+    uint64 version_id_;                // Timestamp of the transaction that created(wrote) the version
+    std::atomic<Version*> next_;       // Next older version, or NULL
+};
+
+// Versions and version list lengths seen by the garbage collector.
+struct VersionStats
+{
+    static const int kChainBuckets = 8;
+
+    VersionStats() : versions_(0), unlinked_(0)
+    {
+        for (int i = 0; i < kChainBuckets; i++) chain_lengths_[i] = 0;
+    }
+
+    // Counts a key with 'length' versions left after collection.
+    void AddChain(uint64 length);
+
+    uint64 versions_;  // Versions left
+    uint64 unlinked_;  // Versions unlinked for reclamation
+    // Number of keys with 1, 2, 3-4, 5-8, ... versions left; the last bucket
+    // also counts all longer lists.
+    uint64 chain_lengths_[kChainBuckets];
 };
 
-// MVCC storage
+// MVCC storage for a dense key range [0, key_count). Each key has a
+// cache-line-aligned slot in a flat array (backed by huge pages where the
+// system allows), holding its newest version inline and a pointer to the list
+// of its older versions. A slot takes one cache line for 'KeyLock' types of up
+// to 16 bytes, and two for larger ones such as Mutex.
+//
+// Reads take no latches: they read the inline version under a sequence
+// counter, walk the list if the inline version is too new, and raise the
+// chosen version's max_read_id_ with a CAS. Writers to a key are serialized by
+// a 'KeyLock' in its slot (Lock/Unlock), and publish new versions with
+// release stores, so readers never see a partly built version.
+//
+// Timestamp ordering requires a write at timestamp w to fail if a txn with a
+// larger timestamp already read the version w would follow. To close the race
+// between CheckWrite reading max_read_id_ and a concurrent reader raising it,
+// CheckWrite first stores w in the slot's lock word. A reader that raised
+// max_read_id_ past w and then sees w there waits for the write to finish and
+// reads again; otherwise, CheckWrite sees the raised max_read_id_ and fails.
+// So only readers that must see a pending version ever wait for it.
+template <typename KeyLock = TTASLock>
 class MVCCStorage : public Storage
 {
    public:
+    explicit MVCCStorage(Key key_count = STORAGE_KEYS);
+    virtual ~MVCCStorage();
+
     // If there exists a record for the specified key, sets '*result' equal to
     // the value associated with the key and returns true, else returns false;
     // The third parameter is the txn_unique_id(txn timestamp), which is used for MVCC.
-    virtual bool Read(Key key, Value* result, int txn_unique_id = 0);
+    virtual bool Read(Key key, Value* result, uint64 txn_unique_id = 0);
 
     // Inserts a new version with key and value
     // The third parameter is the txn_unique_id(txn timestamp), which is used for MVCC.
-    virtual void Write(Key key, Value value, int txn_unique_id = 0);
+    //
+    // Requires: the caller holds Lock(key), except during InitStorage.
+    virtual void Write(Key key, Value value, uint64 txn_unique_id = 0);
 
-    // Returns the timestamp at which the record with the specified key was last
-    // updated (returns 0 if the record has never been updated). This is used for OCC.
-    virtual double Timestamp(Key key) { return 0; }
-    // Init storage
+    // Returns the version_id of the newest version of the record with the
+    // specified key (returns 0 if there is none).
+    virtual uint64 Timestamp(Key key);
+    // Gives every key in the range the value 0, as version 0.
     virtual void InitStorage();
 
-    // Lock the version_list of key
+    // Lock the version_list of key against other writers. Readers are never
+    // blocked by it.
     virtual void Lock(Key key);
 
     // Unlock the version_list of key
     virtual void Unlock(Key key);
 
     // Check whether apply or abort the write
-    virtual bool CheckWrite(Key key, int txn_unique_id);
+    //
+    // Requires: the caller holds Lock(key).
+    virtual bool CheckWrite(Key key, uint64 txn_unique_id);
 
-    virtual ~MVCCStorage();
+    // Sets '*result' to the value of the newest version of 'key' no newer
+    // than 'snapshot' and returns true, or returns false if there is none.
+    // Unlike Read, does not record the read, so it never affects writers.
+    //
+    // Requires: no write of a version no newer than 'snapshot' is pending.
+    bool ReadSnapshot(Key key, Value* result, uint64 snapshot);
 
+    // Returns true if some writer holds Lock(key).
+    bool Locked(Key key) { return slots_[key].writer_.load() != 0; }
+    // Unlinks the versions of keys [begin, end) that no txn with a timestamp
+    // of at least 'watermark' can read, that is, all versions older than the
+    // newest one no newer than 'watermark'. Appends the heads of the unlinked
+    // lists to '*garbage' and counts what is left in '*stats'.
+    //
+    // Readers may still be walking the unlinked versions, so they must only
+    // be freed once no reader that started before the call is left. Keys that
+    // a writer holds locked are skipped rather than waited for.
+    void CollectGarbage(Key begin, Key end, uint64 watermark, std::vector<Version*>* garbage, VersionStats* stats);
+
+    // Returns the number of keys in the range.
+    Key KeyCount() const { return key_count_; }
    private:
     friend class TxnProcessor;
 
-    // Storage for MVCC, each key has a linklist of versions
-    unordered_map<Key, deque<Version*>*> mvcc_data_;
+    // 'version_id_' of a slot that has no version yet.
+    static const uint64 kNoVersion = ~0ull;
+
+    // 'writer_' of a locked slot whose writer has not called CheckWrite yet.
+    // It is larger than any txn timestamp, so no reader waits for it.
+    static const uint64 kUnchecked = ~0ull;
+
+    struct alignas(CACHE_LINE_SIZE) Slot
+    {
+        KeyLock lock_;                // Held by the key's writer
+        std::atomic<uint64> writer_;  // 0 if no writer holds 'lock_'
+        std::atomic<uint64> seq_;     // Odd while Write replaces the inline version
+        std::atomic<Value> value_;    // Newest version, inline
+        std::atomic<uint64> max_read_id_;
+        std::atomic<uint64> version_id_;
+        std::atomic<Version*> older_;
+    };
+
+    // Finds the newest version of 'slot' no newer than 'id', reading the
+    // inline version under the sequence counter. Sets '*seq' to the counter
+    // it read, and '*value' and '*max_read_id' to the version's (NULL if there
+    // is none). Returns false if a concurrent Write got in the way.
+    bool Find(Slot* slot, uint64 id, uint64* seq, Value* value, std::atomic<uint64>** max_read_id);
+
+    // Returns the max_read_id_ of the newest version of 'slot' no newer than
+    // 'id', or NULL if there is none. Caller holds the slot's lock.
+    std::atomic<uint64>* Predecessor(Slot* slot, uint64 id);
+
+    // Disallow copying.
+    MVCCStorage(const MVCCStorage&);
+    MVCCStorage& operator=(const MVCCStorage&);
 
-    // Mutexs for each key
-    unordered_map<Key, Mutex*> mutexs_;
+    Key key_count_;
+    Slot* slots_;
+    size_t mapped_bytes_;
 };
 
 #endif  // _MVCC_STORAGE_H_
@@ -0,0 +1,174 @@
+#include "txn/mvcc_storage.h"
+
+#include <vector>
+
+#include "utils/testing.h"
+
+using std::vector;
+
+// Writes 'value' to 'key' as the version of txn 'id', the way the MVCC
+// scheduler does. Returns false if the write was refused.
+template <typename KeyLock>
+static bool WriteVersion(MVCCStorage<KeyLock>* storage, Key key, Value value, uint64 id)
+{
+    storage->Lock(key);
+    bool ok = storage->CheckWrite(key, id);
+    if (ok) storage->Write(key, value, id);
+    storage->Unlock(key);
+    return ok;
+}
+
+// Returns the value txn 'id' reads from 'key', or -1 if there is none.
+template <typename KeyLock>
+static Value ReadAt(MVCCStorage<KeyLock>* storage, Key key, uint64 id)
+{
+    Value value;
+    return storage->Read(key, &value, id) ? value : static_cast<Value>(-1);
+}
+
+template <typename KeyLock>
+void CheckReadsAcrossVersions()
+{
+    MVCCStorage<KeyLock> storage(16);
+    storage.InitStorage();
+    EXPECT_TRUE(WriteVersion(&storage, 1, 100, 10));
+    EXPECT_TRUE(WriteVersion(&storage, 1, 200, 20));
+    EXPECT_TRUE(WriteVersion(&storage, 1, 300, 30));
+    EXPECT_EQ(30, storage.Timestamp(1));
+
+    // The newest version is inline, the older ones are in the list.
+    EXPECT_EQ(300, ReadAt(&storage, 1, 35));
+    EXPECT_EQ(300, ReadAt(&storage, 1, 30));
+    EXPECT_EQ(200, ReadAt(&storage, 1, 29));
+    EXPECT_EQ(100, ReadAt(&storage, 1, 15));
+    EXPECT_EQ(0, ReadAt(&storage, 1, 5));
+
+    // Snapshot reads see the same versions.
+    Value value;
+    EXPECT_TRUE(storage.ReadSnapshot(1, &value, 25));
+    EXPECT_EQ(200, value);
+
+    // Keys outside the range have no versions at all.
+    EXPECT_FALSE(storage.Read(16, &value, 50));
+}
+
+TEST(MVCCStorage_ReadsAcrossVersions)
+{
+    CheckReadsAcrossVersions<TTASLock>();
+    CheckReadsAcrossVersions<Mutex>();
+    CheckReadsAcrossVersions<TicketLock>();
+    CheckReadsAcrossVersions<MCSLock>();
+
+    END;
+}
+
+TEST(MVCCStorage_CheckWriteAfterLaterRead)
+{
+    MVCCStorage<> storage(16);
+    storage.InitStorage();
+
+    // Txn 50 read version 0, so txn 40 may no longer write after it.
+    EXPECT_EQ(0, ReadAt(&storage, 2, 50));
+    EXPECT_FALSE(WriteVersion(&storage, 2, 400, 40));
+    EXPECT_EQ(0, storage.Timestamp(2));
+
+    // Txns after the read can.
+    EXPECT_TRUE(WriteVersion(&storage, 2, 600, 60));
+    EXPECT_EQ(600, ReadAt(&storage, 2, 70));
+
+    // A read of a version in the list blocks writes right after it too.
+    EXPECT_EQ(0, ReadAt(&storage, 2, 55));
+    EXPECT_FALSE(WriteVersion(&storage, 2, 520, 52));
+    EXPECT_TRUE(WriteVersion(&storage, 2, 570, 57));
+
+    END;
+}
+
+TEST(MVCCStorage_OutOfOrderWrite)
+{
+    MVCCStorage<> storage(16);
+    storage.InitStorage();
+
+    // Txn 20 writes after txn 30 already did: its version goes into the list
+    // and the inline version stays the newest.
+    EXPECT_TRUE(WriteVersion(&storage, 3, 300, 30));
+    EXPECT_TRUE(WriteVersion(&storage, 3, 200, 20));
+    EXPECT_TRUE(WriteVersion(&storage, 3, 100, 10));
+    EXPECT_EQ(30, storage.Timestamp(3));
+    EXPECT_EQ(300, ReadAt(&storage, 3, 31));
+    EXPECT_EQ(200, ReadAt(&storage, 3, 25));
+    EXPECT_EQ(100, ReadAt(&storage, 3, 19));
+    EXPECT_EQ(0, ReadAt(&storage, 3, 9));
+
+    // Writers are still locked out while they run.
+    storage.Lock(3);
+    EXPECT_TRUE(storage.Locked(3));
+    storage.Unlock(3);
+    EXPECT_FALSE(storage.Locked(3));
+
+    END;
+}
+
+// Frees the version lists unlinked by CollectGarbage.
+static void FreeVersions(vector<Version*>* garbage)
+{
+    for (size_t i = 0; i < garbage->size(); i++)
+    {
+        Version* version = (*garbage)[i];
+        while (version != NULL)
+        {
+            Version* next = version->next_.load();
+            delete version;
+            version = next;
+        }
+    }
+    garbage->clear();
+}
+
+TEST(MVCCStorage_CollectGarbage)
+{
+    MVCCStorage<> storage(16);
+    storage.InitStorage();
+    for (uint64 id = 10; id <= 40; id += 10) WriteVersion(&storage, 4, id * 10, id);
+
+    // Versions 40 (inline), 30 and 20 (the newest one no newer than 25) stay;
+    // 10 and 0 go.
+    vector<Version*> garbage;
+    VersionStats stats;
+    storage.CollectGarbage(4, 5, 25, &garbage, &stats);
+    EXPECT_EQ(1, garbage.size());
+    EXPECT_EQ(2, stats.unlinked_);
+    EXPECT_EQ(3, stats.versions_);
+    FreeVersions(&garbage);
+    EXPECT_EQ(200, ReadAt(&storage, 4, 25));
+    EXPECT_EQ(300, ReadAt(&storage, 4, 35));
+    EXPECT_EQ(400, ReadAt(&storage, 4, 45));
+
+    // Once the watermark passes the inline version, the whole list goes.
+    VersionStats later;
+    storage.CollectGarbage(0, 16, 50, &garbage, &later);
+    EXPECT_EQ(1, garbage.size());
+    EXPECT_EQ(2, later.unlinked_);
+    EXPECT_EQ(16, later.versions_);
+    FreeVersions(&garbage);
+    EXPECT_EQ(400, ReadAt(&storage, 4, 60));
+
+    // Keys that a writer holds are skipped.
+    WriteVersion(&storage, 5, 1, 70);
+    storage.Lock(5);
+    VersionStats locked;
+    storage.CollectGarbage(5, 6, 80, &garbage, &locked);
+    storage.Unlock(5);
+    EXPECT_EQ(0, garbage.size());
+    EXPECT_EQ(0, locked.versions_);
+
+    END;
+}
+
+int main(int argc, char** argv)
+{
+    MVCCStorage_ReadsAcrossVersions();
+    MVCCStorage_CheckWriteAfterLaterRead();
+    MVCCStorage_OutOfOrderWrite();
+    MVCCStorage_CollectGarbage();
+}
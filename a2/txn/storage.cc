@@ -1,11 +1,12 @@
 
 #include "txn/storage.h"
 
-bool Storage::Read(Key key, Value* result, int txn_unique_id)
+bool Storage::Read(Key key, Value* result, uint64 txn_unique_id)
 {
-    if (data_.count(key))
+    Record record;
+    if (data_.Lookup(key, &record))
     {
-        *result = data_[key];
+        *result = record.value_;
         return true;
     }
     else
@@ -14,23 +15,24 @@ bool Storage::Read(Key key, Value* result, int txn_unique_id)
     }
 }
 
-// Write value and timestamps
-void Storage::Write(Key key, Value value, int txn_unique_id)
+// Write value and version
+void Storage::Write(Key key, Value value, uint64 txn_unique_id)
 {
-    data_[key]       = value;
-    timestamps_[key] = GetTime();
+    Record record = {value, clock_.Tick()};
+    data_.Insert(key, record);
 }
 
-double Storage::Timestamp(Key key)
+uint64 Storage::Timestamp(Key key)
 {
-    if (timestamps_.count(key) == 0) return 0;
-    return timestamps_[key];
+    Record record;
+    if (!data_.Lookup(key, &record)) return 0;
+    return record.version_;
 }
 
 // Init the storage
 void Storage::InitStorage()
 {
-    for (int i = 0; i < 1000000; i++)
+    for (int i = 0; i < STORAGE_KEYS; i++)
     {
         Write(i, 0, 0);
     }
@@ -5,32 +5,41 @@
 #include <limits.h>
 #include <deque>
 #include <map>
-#include <unordered_map>
 
 #include "txn/common.h"
 #include "txn/txn.h"
+#include "utils/clock.h"
+#include "utils/concurrent_map.h"
 #include "utils/mutex.h"
 
-using std::unordered_map;
 using std::deque;
 using std::map;
 
+// Number of records created by Storage::InitStorage(), with keys 0 through
+// STORAGE_KEYS - 1.
+#define STORAGE_KEYS 1000000
+
 class Storage
 {
    public:
     // If there exists a record for the specified key, sets '*result' equal to
     // the value associated with the key and returns true, else returns false;
     // Note that the third parameter is only used for MVCC, the default vaule is 0.
-    virtual bool Read(Key key, Value* result, int txn_unique_id = 0);
+    virtual bool Read(Key key, Value* result, uint64 txn_unique_id = 0);
 
     // Inserts the record <key, value>, replacing any previous record with the
     // same key.
     // Note that the third parameter is only used for MVCC, the default vaule is 0.
-    virtual void Write(Key key, Value value, int txn_unique_id = 0);
+    virtual void Write(Key key, Value value, uint64 txn_unique_id = 0);
+
+    // Returns the version of the record with the specified key: the logical
+    // time of its last update (0 if the record has never been updated). This is
+    // used for OCC.
+    virtual uint64 Timestamp(Key key);
 
-    // Returns the timestamp at which the record with the specified key was last
-    // updated (returns 0 if the record has never been updated). This is used for OCC.
-    virtual double Timestamp(Key key);
+    // Returns the current logical time. Every update made after this call
+    // gives its record a larger version than the time returned.
+    uint64 Now() { return clock_.Now(); }
 
     // Init storage
     virtual void InitStorage();
@@ -39,15 +48,25 @@ class Storage
     // The following methods are only used for MVCC
     virtual void Lock(Key key) {}
     virtual void Unlock(Key key) {}
-    virtual bool CheckWrite(Key key, int txn_unique_id) { return true; }
+    virtual bool CheckWrite(Key key, uint64 txn_unique_id) { return true; }
+   protected:
+    // Source of record versions.
+    LogicalClock clock_;
+
    private:
     friend class TxnProcessor;
 
-    // Collection of <key, value> pairs. Use this for single-version storage
-    unordered_map<Key, Value> data_;
+    // A record's value and version.
+    struct Record
+    {
+        Value value_;
+        uint64 version_;
+    };
 
-    // Timestamps at which each key was last updated.
-    unordered_map<Key, double> timestamps_;
+    // Collection of <key, record> pairs. Use this for single-version storage.
+    // Worker threads read and write it concurrently, so lookups go through the
+    // map's latch-free read path.
+    ConcurrentMap<Key, Record> data_;
 };
 
 #endif  // _STORAGE_H_
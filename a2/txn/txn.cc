@@ -11,9 +11,10 @@ bool Txn::Read(const Key& key, Value* value)
 
     // 'reads_' has already been populated by TxnProcessor, so it should contain
     // the target value iff the record appears in the database.
-    if (reads_.count(key))
+    KeyValueMap::iterator it = reads_.find(key);
+    if (it != reads_.end())
     {
-        *value = reads_[key];
+        *value = it->second;
         return true;
     }
     else
@@ -40,7 +41,7 @@ void Txn::Write(const Key& key, const Value& value)
 
 void Txn::CheckReadWriteSets()
 {
-    for (set<Key>::iterator it = writeset_.begin(); it != writeset_.end(); ++it)
+    for (KeySet::iterator it = writeset_.begin(); it != writeset_.end(); ++it)
     {
         if (readset_.count(*it) > 0)
         {
@@ -51,10 +52,10 @@ void Txn::CheckReadWriteSets()
 
 void Txn::CopyTxnInternals(Txn* txn) const
 {
-    txn->readset_        = set<Key>(this->readset_);
-    txn->writeset_       = set<Key>(this->writeset_);
-    txn->reads_          = map<Key, Value>(this->reads_);
-    txn->writes_         = map<Key, Value>(this->writes_);
+    txn->readset_        = this->readset_;
+    txn->writeset_       = this->writeset_;
+    txn->reads_          = this->reads_;
+    txn->writes_         = this->writes_;
     txn->status_         = this->status_;
     txn->unique_id_      = this->unique_id_;
     txn->occ_start_time_ = this->occ_start_time_;
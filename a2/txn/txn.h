@@ -2,11 +2,14 @@
 #ifndef _TXN_H_
 #define _TXN_H_
 
+#include <atomic>
 #include <map>
 #include <set>
 #include <vector>
 
 #include "txn/common.h"
+#include "utils/flat_map.h"
+#include "utils/slab_allocator.h"
 
 using std::map;
 using std::set;
@@ -22,19 +25,41 @@ enum TxnStatus
     ABORTED     = 4,  // Aborted
 };
 
+// Number of keys a txn's read and write sets, read results and write buffers
+// hold without allocating.
+#define TXN_INLINE_KEYS 8
+
+// Sets of keys and key-value maps of a txn. Sorted flat containers, with room
+// for TXN_INLINE_KEYS entries inside the Txn itself.
+typedef FlatSet<Key, TXN_INLINE_KEYS> KeySet;
+typedef FlatMap<Key, Value, TXN_INLINE_KEYS> KeyValueMap;
+
+class Txn;
+
+// Completion callback for a transaction submitted with one. Invoked exactly
+// once with the COMMITTED or ABORTED txn and the 'arg' given at submission;
+// the callback takes ownership of the txn.
+typedef void (*TxnCallback)(Txn* txn, void* arg);
+
 class Txn
 {
    public:
     // Commit vote defauls to false. Only by calling "commit"
-    Txn() : status_(INCOMPLETE) {}
+    Txn() : status_(INCOMPLETE), callback_(NULL), callback_arg_(NULL), lock_partitions_(0), pending_partitions_(0) {}
     virtual ~Txn() {}
     virtual Txn* clone() const = 0;  // Virtual constructor (copying)
 
+    // Txns of every type are allocated from the thread-caching slab allocator.
+    static void* operator new(size_t size) { return SlabAllocator::Allocate(size); }
+    static void operator delete(void* ptr, size_t size) { SlabAllocator::Free(ptr, size); }
+
     // Method containing all the transaction's method logic.
     virtual void Run() = 0;
 
     // Returns the Txn's current execution status.
     TxnStatus Status() { return status_; }
+    // Returns the id assigned by the TxnProcessor when the txn was submitted.
+    uint64 UniqueId() { return unique_id_; }
     // Checks for overlap in read and write sets. If any key appears in both,
     // an error occurs.
     void CheckReadWriteSets();
@@ -86,16 +111,16 @@ class Txn
 
     // Set of all keys that may need to be read in order to execute the
     // transaction.
-    set<Key> readset_;
+    KeySet readset_;
 
     // Set of all keys that may be updated when executing the transaction.
-    set<Key> writeset_;
+    KeySet writeset_;
 
     // Results of reads performed by the transaction.
-    map<Key, Value> reads_;
+    KeyValueMap reads_;
 
     // Key, Value pairs WRITTEN by the transaction.
-    map<Key, Value> writes_;
+    KeyValueMap writes_;
 
     // Transaction's current execution status.
     TxnStatus status_;
@@ -103,8 +128,22 @@ class Txn
     // Unique, monotonically increasing transaction ID, assigned by TxnProcessor.
     uint64 unique_id_;
 
-    // Start time (used for OCC).
-    double occ_start_time_;
+    // Logical time at which the txn started reading (used for OCC).
+    uint64 occ_start_time_;
+
+    // Where to deliver the txn once it has committed or aborted. If NULL, it
+    // is returned through TxnProcessor::GetTxnResult(s).
+    TxnCallback callback_;
+    void* callback_arg_;
+
+    // Partitioned locking (P_LOCKING): bit i is set if the txn touches keys
+    // owned by lock partition i, and the number of those partitions that have
+    // yet to grant (and later, to release) its locks.
+    uint64 lock_partitions_;
+    std::atomic<int> pending_partitions_;
+
+    // VLL: position of the txn in the scheduler's queue of active txns.
+    uint64 vll_position_;
 };
 
 #endif  // _TXN_H_
@@ -1,24 +1,117 @@
 
 #include "txn/txn_processor.h"
 #include <stdio.h>
+#include <algorithm>
 #include <set>
 
 #include "txn/lock_manager.h"
 
-// Thread & queue counts for StaticThreadPool initialization.
-#define THREAD_COUNT 8
+// Execute transactions on a WorkStealingThreadPool (true) or on a
+// StaticThreadPool (false).
+#define WORK_STEALING_POOL true
 
-TxnProcessor::TxnProcessor(CCMode mode) : mode_(mode), tp_(THREAD_COUNT), next_unique_id_(1)
+// Source of TxnProcessor generation numbers.
+static std::atomic<uint64> next_generation(1);
+
+// Ids a thread was given by the TxnProcessors it used most recently, tagged
+// with the generation of the TxnProcessor that handed them out.
+struct ThreadIdCache
+{
+    static const int kEntries = 4;
+    struct Entry
+    {
+        uint64 generation_;
+        int id_;
+    };
+    Entry entries_[kEntries];
+    int next_;
+};
+static thread_local ThreadIdCache client_ids;
+static thread_local ThreadIdCache worker_ids;
+
+// Returns the id the calling thread has in the TxnProcessor of 'generation'
+// according to 'cache'. If it has none yet, claims the next one from 'counter',
+// remembers it and sets '*claimed'.
+static int ThreadId(ThreadIdCache* cache, uint64 generation, std::atomic<int>* counter, bool* claimed)
+{
+    *claimed = false;
+    for (int i = 0; i < ThreadIdCache::kEntries; i++)
+    {
+        if (cache->entries_[i].generation_ == generation) return cache->entries_[i].id_;
+    }
+
+    *claimed                    = true;
+    ThreadIdCache::Entry& entry = cache->entries_[cache->next_++ % ThreadIdCache::kEntries];
+    entry.generation_           = generation;
+    entry.id_                   = counter->fetch_add(1, std::memory_order_relaxed);
+    return entry.id_;
+}
+
+// Entry of TxnProcessor::mvcc_active_ids_ of an idle worker.
+static const uint64 kNoActiveTxn = ~0ull;
+
+// Returns the lock partition (in P_LOCKING mode) that owns 'key'.
+static inline int PartitionOf(Key key) { return (key * 0x9E3779B97F4A7C15ull >> 32) % LOCK_PARTITIONS; }
+
+TxnProcessor::TxnProcessor(CCMode mode, int thread_count, PinPolicy pin)
+    : mode_(mode),
+      next_unique_id_(1),
+      generation_(next_generation.fetch_add(1)),
+      client_count_(0),
+      next_client_(0),
+      result_waiters_(0),
+      next_validation_seq_(0),
+      next_commit_ts_(1),
+      snapshot_ts_(0),
+      silo_epoch_(1),
+      background_stopped_(false),
+      worker_count_(0),
+      partitions_stopped_(false),
+      stopped_(false)
 {
+    for (int i = 0; i < kMaxClients; i++) client_queues_[i].store(NULL, std::memory_order_relaxed);
+    for (int i = 0; i < EpochManager::kMaxThreads; i++) mvcc_active_ids_[i].id_.store(kNoActiveTxn);
+    for (int i = 0; i < EpochManager::kMaxThreads; i++) snapshot_installing_[i].id_.store(kNoActiveTxn);
+    for (int i = 0; i < EpochManager::kMaxThreads; i++) silo_tids_[i].tid_ = 0;
+    for (int i = 0; i < EpochManager::kMaxThreads; i++) restarts_[i].restarts_.store(0);
+    scheduler_restarts_.restarts_.store(0);
+
+    // In P_LOCKING mode the lock partitions' CC threads get the CPUs right
+    // after the scheduler's.
+    int cc_threads   = mode_ == P_LOCKING ? LOCK_PARTITIONS : 0;
+    vector<int> cpus = CpuLayout(thread_count + cc_threads, pin);
+    vector<int> worker_cpus(cpus.begin() + 1 + cc_threads, cpus.end());
+    if (WORK_STEALING_POOL)
+        tp_ = new WorkStealingThreadPool(thread_count, worker_cpus);
+    else
+        tp_ = new StaticThreadPool(thread_count, worker_cpus);
+
     if (mode_ == LOCKING_EXCLUSIVE_ONLY)
         lm_ = new LockManagerA(&ready_txns_);
+    else if (mode_ == LOCKING && DENSE_LOCK_MANAGER)
+        lm_ = new DenseLockManager(&ready_txns_, 0, STORAGE_KEYS);
     else if (mode_ == LOCKING)
         lm_ = new LockManagerB(&ready_txns_);
+    else if (mode_ == LOCKING_NO_WAIT)
+        online_lm_ = new OnlineLockManager(NO_WAIT, STORAGE_KEYS);
+    else if (mode_ == LOCKING_WAIT_DIE)
+        online_lm_ = new OnlineLockManager(WAIT_DIE, STORAGE_KEYS);
+    else if (mode_ == LOCKING_WOUND_WAIT)
+        online_lm_ = new OnlineLockManager(WOUND_WAIT, STORAGE_KEYS);
 
     // Create the storage
-    if (mode_ == MVCC)
+    if (mode_ == MVCC || mode_ == SNAPSHOT || mode_ == SNAPSHOT_VALIDATED)
+    {
+        storage_ = new MVCCStorage<MVCC_KEY_LOCK>();
+    }
+    else if (mode_ == VLL)
+    {
+        storage_ = new VLLStorage();
+    }
+    else if (mode_ == SILO || mode_ == TICTOC || (mode_ == P_OCC && P_OCC_RECORD_LOCKS) ||
+             (ARRAY_STORAGE && mode_ != SERIAL))
     {
-        storage_ = new MVCCStorage();
+        storage_ = new ArrayStorage();
     }
     else
     {
@@ -27,66 +120,258 @@ TxnProcessor::TxnProcessor(CCMode mode) : mode_(mode), tp_(THREAD_COUNT), next_u
 
     storage_->InitStorage();
 
-    // Start 'RunScheduler()' running.
+    if (mode_ == P_LOCKING)
+    {
+        for (int i = 0; i < LOCK_PARTITIONS; i++)
+        {
+            LockPartition* partition = new LockPartition(this);
+            for (int j = 0; j < thread_count; j++) partition->releases_.push_back(new SPSCQueue<Txn*>());
+            partitions_.push_back(partition);
 
-    pthread_attr_t attr;
-    pthread_attr_init(&attr);
+            pthread_attr_t attr;
+            pthread_attr_init(&attr);
+            SetThreadAffinity(&attr, cpus[1 + i]);
+            pthread_create(&partition->thread_, &attr, StartLockPartition, reinterpret_cast<void*>(partition));
+            pthread_attr_destroy(&attr);
+        }
+    }
 
-    #if !defined(_MSC_VER) && !defined(__APPLE__)
-    cpu_set_t cpuset;
-    CPU_ZERO(&cpuset);
-    for (int i = 0; i < 7; i++)
+    // The MVCC garbage collector runs in the background, wherever the OS
+    // finds room for it.
+    if (mode_ == MVCC || mode_ == SNAPSHOT || mode_ == SNAPSHOT_VALIDATED)
     {
-        CPU_SET(i, &cpuset);
+        pthread_create(&gc_thread_, NULL, StartGarbageCollection, reinterpret_cast<void*>(this));
     }
-    pthread_attr_setaffinity_np(&attr, sizeof(cpu_set_t), &cpuset);
-    #endif
+    if (mode_ == SILO) pthread_create(&epoch_thread_, NULL, StartEpochAdvancer, reinterpret_cast<void*>(this));
+
+    // Start 'RunScheduler()' running.
+
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
+    SetThreadAffinity(&attr, cpus[0]);
 
     pthread_t scheduler_;
     pthread_create(&scheduler_, &attr, StartScheduler, reinterpret_cast<void*>(this));
+    pthread_attr_destroy(&attr);
 
-    stopped_          = false;
     scheduler_thread_ = scheduler_;
 }
 
+vector<int> TxnProcessor::CpuLayout(int thread_count, PinPolicy pin)
+{
+    return CpuLayout(CpuTopology::Get(), thread_count, pin);
+}
+
+vector<int> TxnProcessor::CpuLayout(const CpuTopology& topology, int thread_count, PinPolicy pin)
+{
+    vector<int> order = topology.Layout(topology.CpuCount(), pin);
+
+    // Reserve the first CPU in 'pin' order for the scheduler, and hand the rest
+    // out to the workers.
+    int first_worker_cpu = order.size() > 1 ? 1 : 0;
+    int worker_cpus      = order.size() - first_worker_cpu;
+
+    vector<int> cpus;
+    cpus.push_back(order[0]);
+    for (int i = 0; i < thread_count; i++) cpus.push_back(order[first_worker_cpu + i % worker_cpus]);
+    return cpus;
+}
+
 void* TxnProcessor::StartScheduler(void* arg)
 {
     reinterpret_cast<TxnProcessor*>(arg)->RunScheduler();
     return NULL;
 }
 
+void* TxnProcessor::StartLockPartition(void* arg)
+{
+    LockPartition* partition = reinterpret_cast<LockPartition*>(arg);
+    partition->processor_->RunLockPartition(partition);
+    return NULL;
+}
+
+void* TxnProcessor::StartGarbageCollection(void* arg)
+{
+    reinterpret_cast<TxnProcessor*>(arg)->GarbageCollection();
+    return NULL;
+}
+
+void* TxnProcessor::StartEpochAdvancer(void* arg)
+{
+    reinterpret_cast<TxnProcessor*>(arg)->RunEpochAdvancer();
+    return NULL;
+}
+
 TxnProcessor::~TxnProcessor()
 {
     // Wait for the scheduler thread to join back before destroying the object and its thread pool.
     stopped_ = true;
     pthread_join(scheduler_thread_, NULL);
 
+    // Stop the lock partitions before the workers that they hand txns to.
+    partitions_stopped_.store(true);
+    for (size_t i = 0; i < partitions_.size(); i++) pthread_join(partitions_[i]->thread_, NULL);
+
+    // Let the workers finish any remaining transactions before the storage
+    // they use goes away.
+    delete tp_;
+
+    // Return the P_LOCKING txns that finished after their partitions stopped
+    // taking releases.
+    for (size_t i = 0; i < partitions_.size(); i++)
+    {
+        for (size_t j = 0; j < partitions_[i]->releases_.size(); j++)
+        {
+            Txn* txn;
+            while (partitions_[i]->releases_[j]->Pop(&txn))
+            {
+                if (txn->pending_partitions_.fetch_sub(1, std::memory_order_acq_rel) == 1) ReturnResult(txn);
+            }
+        }
+    }
+
+    if (mode_ == MVCC || mode_ == SNAPSHOT || mode_ == SNAPSHOT_VALIDATED)
+    {
+        background_stopped_.store(true);
+        pthread_join(gc_thread_, NULL);
+        FreeGarbage(~0ull);
+    }
+    if (mode_ == SILO)
+    {
+        background_stopped_.store(true);
+        pthread_join(epoch_thread_, NULL);
+    }
+
     if (mode_ == LOCKING_EXCLUSIVE_ONLY || mode_ == LOCKING) delete lm_;
+    if (mode_ == LOCKING_NO_WAIT || mode_ == LOCKING_WAIT_DIE || mode_ == LOCKING_WOUND_WAIT) delete online_lm_;
 
     delete storage_;
+
+    for (int i = 0; i < kMaxClients; i++) delete client_queues_[i].load();
+    for (size_t i = 0; i < partitions_.size(); i++)
+    {
+        for (size_t j = 0; j < partitions_[i]->releases_.size(); j++) delete partitions_[i]->releases_[j];
+        delete partitions_[i];
+    }
 }
 
 void TxnProcessor::NewTxnRequest(Txn* txn)
 {
-    // Atomically assign the txn a new number and add it to the incoming txn
-    // requests queue.
-    mutex_.Lock();
-    txn->unique_id_ = next_unique_id_;
-    next_unique_id_++;
-    txn_requests_.Push(txn);
-    mutex_.Unlock();
+    // Atomically assign the txn a new number and add it to this client's
+    // incoming txn requests queue.
+    txn->unique_id_            = next_unique_id_.fetch_add(1, std::memory_order_relaxed);
+    LockFreeQueue<Txn*>* queue = ClientQueue();
+    if (queue != NULL)
+        queue->Push(txn);
+    else
+        txn_requests_.Push(txn);
+}
+
+void TxnProcessor::NewTxnRequests(Txn** txns, int n)
+{
+    uint64 first = next_unique_id_.fetch_add(n, std::memory_order_relaxed);
+    for (int i = 0; i < n; i++) txns[i]->unique_id_ = first + i;
+
+    LockFreeQueue<Txn*>* queue = ClientQueue();
+    if (queue != NULL)
+        queue->PushBulk(txns, n);
+    else
+        txn_requests_.PushBulk(txns, n);
+}
+
+LockFreeQueue<Txn*>* TxnProcessor::ClientQueue()
+{
+    bool claimed;
+    int id = ThreadId(&client_ids, generation_, &client_count_, &claimed);
+    if (id >= kMaxClients) return NULL;
+
+    // First request from this thread: set up its queue.
+    if (claimed) client_queues_[id].store(new LockFreeQueue<Txn*>(kClientQueueCapacity), std::memory_order_release);
+    return client_queues_[id].load(std::memory_order_relaxed);
+}
+
+bool TxnProcessor::NextTxnRequest(Txn** txn)
+{
+    int clients = client_count_.load(std::memory_order_acquire);
+    if (clients > kMaxClients) clients = kMaxClients;
+    for (int i = 0; i < clients; i++)
+    {
+        int id                     = (next_client_ + i) % clients;
+        LockFreeQueue<Txn*>* queue = client_queues_[id].load(std::memory_order_acquire);
+        if (queue != NULL && queue->Pop(txn))
+        {
+            next_client_ = id + 1;
+            return true;
+        }
+    }
+    return txn_requests_.Pop(txn);
+}
+
+void TxnProcessor::NewTxnRequest(Txn* txn, TxnCallback callback, void* arg)
+{
+    txn->callback_     = callback;
+    txn->callback_arg_ = arg;
+    NewTxnRequest(txn);
 }
 
 Txn* TxnProcessor::GetTxnResult()
 {
     Txn* txn;
-    while (!txn_results_.Pop(&txn))
+    while (!txn_results_.Pop(&txn)) WaitForResults();
+    return txn;
+}
+
+int TxnProcessor::GetTxnResults(vector<Txn*>* results, int max)
+{
+    Txn* batch[64];
+    int total = 0;
+    while (total < max)
     {
-        // No result yet. Wait a bit before trying again (to reduce contention on
-        // atomic queues).
-        usleep(1);
+        int n = txn_results_.PopBulk(batch, std::min(max - total, 64));
+        if (n == 0 && total > 0) break;
+        if (n == 0) WaitForResults();
+        results->insert(results->end(), batch, batch + n);
+        total += n;
+    }
+    return total;
+}
+
+void TxnProcessor::WaitForResults()
+{
+    // Results usually arrive within microseconds under load, so spin briefly
+    // before paying for a futex sleep and wake-up.
+    SpinWait spin;
+    for (int i = 0; i < 8; i++)
+    {
+        if (txn_results_.Size() > 0) return;
+        spin.Wait();
+    }
+
+    int epoch = results_ready_.Load();
+    result_waiters_.fetch_add(1, std::memory_order_seq_cst);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    // Re-check after announcing ourselves, so a result pushed concurrently with
+    // the announcement is not missed (pairs with the fence in ReturnResult()).
+    if (txn_results_.Size() == 0) results_ready_.Wait(epoch);
+    result_waiters_.fetch_sub(1, std::memory_order_relaxed);
+}
+
+void TxnProcessor::ReturnResult(Txn* txn)
+{
+    if (txn->callback_ != NULL)
+    {
+        txn->callback_(txn, txn->callback_arg_);
+        return;
+    }
+
+    txn_results_.Push(txn);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    // Only results that arrive while a client is asleep pay for a wake-up.
+    if (result_waiters_.load(std::memory_order_relaxed) > 0)
+    {
+        results_ready_.Increment();
+        results_ready_.WakeAll();
     }
-    return txn;
 }
 
 void TxnProcessor::RunScheduler()
@@ -110,6 +395,28 @@ void TxnProcessor::RunScheduler()
             break;
         case MVCC:
             RunMVCCScheduler();
+            break;
+        case SNAPSHOT:
+        case SNAPSHOT_VALIDATED:
+            RunSnapshotScheduler();
+            break;
+        case SILO:
+            RunSiloScheduler();
+            break;
+        case TICTOC:
+            RunTicTocScheduler();
+            break;
+        case LOCKING_NO_WAIT:
+        case LOCKING_WAIT_DIE:
+        case LOCKING_WOUND_WAIT:
+            RunOnlineLockingScheduler();
+            break;
+        case P_LOCKING:
+            RunPartitionedLockingScheduler();
+            break;
+        case VLL:
+            RunVLLScheduler();
+            break;
     }
 }
 
@@ -119,7 +426,7 @@ void TxnProcessor::RunSerialScheduler()
     while (!stopped_)
     {
         // Get next txn request.
-        if (txn_requests_.Pop(&txn))
+        if (NextTxnRequest(&txn))
         {
             // Execute txn.
             ExecuteTxn(txn);
@@ -141,7 +448,7 @@ void TxnProcessor::RunSerialScheduler()
             }
 
             // Return result to client.
-            txn_results_.Push(txn);
+            ReturnResult(txn);
         }
     }
 }
@@ -152,11 +459,11 @@ void TxnProcessor::RunLockingScheduler()
     while (!stopped_)
     {
         // Start processing the next incoming transaction request.
-        if (txn_requests_.Pop(&txn))
+        if (NextTxnRequest(&txn))
         {
             bool blocked = false;
             // Request read locks.
-            for (set<Key>::iterator it = txn->readset_.begin(); it != txn->readset_.end(); ++it)
+            for (KeySet::iterator it = txn->readset_.begin(); it != txn->readset_.end(); ++it)
             {
                 if (!lm_->ReadLock(txn, *it))
                 {
@@ -165,7 +472,7 @@ void TxnProcessor::RunLockingScheduler()
             }
 
             // Request write locks.
-            for (set<Key>::iterator it = txn->writeset_.begin(); it != txn->writeset_.end(); ++it)
+            for (KeySet::iterator it = txn->writeset_.begin(); it != txn->writeset_.end(); ++it)
             {
                 if (!lm_->WriteLock(txn, *it))
                 {
@@ -201,18 +508,18 @@ void TxnProcessor::RunLockingScheduler()
             }
 
             // Release read locks.
-            for (set<Key>::iterator it = txn->readset_.begin(); it != txn->readset_.end(); ++it)
+            for (KeySet::iterator it = txn->readset_.begin(); it != txn->readset_.end(); ++it)
             {
                 lm_->Release(txn, *it);
             }
             // Release write locks.
-            for (set<Key>::iterator it = txn->writeset_.begin(); it != txn->writeset_.end(); ++it)
+            for (KeySet::iterator it = txn->writeset_.begin(); it != txn->writeset_.end(); ++it)
             {
                 lm_->Release(txn, *it);
             }
 
             // Return result to client.
-            txn_results_.Push(txn);
+            ReturnResult(txn);
         }
 
         // Start executing all transactions that have newly acquired all their
@@ -224,7 +531,166 @@ void TxnProcessor::RunLockingScheduler()
             ready_txns_.pop_front();
 
             // Start txn running in its own thread.
-            tp_.AddTask([this, txn]() { this->ExecuteTxn(txn); });
+            tp_->AddTask(TxnTask(this, &TxnProcessor::ExecuteTxn, txn));
+        }
+    }
+}
+
+void TxnProcessor::RunPartitionedLockingScheduler()
+{
+    Txn* txn;
+    SpinWait spin;
+    while (!stopped_)
+    {
+        if (!NextTxnRequest(&txn))
+        {
+            spin.Wait();
+            continue;
+        }
+        spin.Reset();
+
+        // Find the partitions owning the txn's keys.
+        uint64 partitions = 0;
+        for (KeySet::iterator it = txn->readset_.begin(); it != txn->readset_.end(); ++it)
+        {
+            partitions |= 1ull << PartitionOf(*it);
+        }
+        for (KeySet::iterator it = txn->writeset_.begin(); it != txn->writeset_.end(); ++it)
+        {
+            partitions |= 1ull << PartitionOf(*it);
+        }
+        txn->lock_partitions_ = partitions;
+
+        if (partitions == 0)
+        {
+            tp_->AddTask(TxnTask(this, &TxnProcessor::ExecuteTxnPartitioned, txn));
+            continue;
+        }
+
+        // Every partition sees txns in the order they leave this thread, so a
+        // txn only ever waits for earlier ones and there are no deadlocks.
+        txn->pending_partitions_.store(__builtin_popcountll(partitions), std::memory_order_relaxed);
+        for (int i = 0; i < LOCK_PARTITIONS; i++)
+        {
+            if (partitions & (1ull << i)) partitions_[i]->lock_requests_.Push(txn);
+        }
+    }
+}
+
+void TxnProcessor::RunLockPartition(LockPartition* partition)
+{
+    const int id    = std::find(partitions_.begin(), partitions_.end(), partition) - partitions_.begin();
+    LockManager& lm = partition->lm_;
+    Txn* txn;
+    SpinWait spin;
+    while (!partitions_stopped_.load(std::memory_order_relaxed))
+    {
+        bool idle = true;
+
+        // Acquire this partition's share of newly scheduled txns' locks.
+        while (partition->lock_requests_.Pop(&txn))
+        {
+            idle         = false;
+            bool blocked = false;
+            for (KeySet::iterator it = txn->readset_.begin(); it != txn->readset_.end(); ++it)
+            {
+                if (PartitionOf(*it) == id && !lm.ReadLock(txn, *it)) blocked = true;
+            }
+            for (KeySet::iterator it = txn->writeset_.begin(); it != txn->writeset_.end(); ++it)
+            {
+                if (PartitionOf(*it) == id && !lm.WriteLock(txn, *it)) blocked = true;
+            }
+            if (!blocked) partition->ready_txns_.push_back(txn);
+        }
+
+        // Release the locks of txns that finished executing.
+        for (size_t i = 0; i < partition->releases_.size(); i++)
+        {
+            while (partition->releases_[i]->Pop(&txn))
+            {
+                idle = false;
+                for (KeySet::iterator it = txn->readset_.begin(); it != txn->readset_.end(); ++it)
+                {
+                    if (PartitionOf(*it) == id) lm.Release(txn, *it);
+                }
+                for (KeySet::iterator it = txn->writeset_.begin(); it != txn->writeset_.end(); ++it)
+                {
+                    if (PartitionOf(*it) == id) lm.Release(txn, *it);
+                }
+
+                // The last partition to let go of the txn returns it.
+                if (txn->pending_partitions_.fetch_sub(1, std::memory_order_acq_rel) == 1) ReturnResult(txn);
+            }
+        }
+
+        // Txns holding all of their locks in this partition are ready here;
+        // the last partition to get there starts them.
+        while (!partition->ready_txns_.empty())
+        {
+            txn = partition->ready_txns_.front();
+            partition->ready_txns_.pop_front();
+            if (txn->pending_partitions_.fetch_sub(1, std::memory_order_acq_rel) == 1)
+            {
+                tp_->AddTask(TxnTask(this, &TxnProcessor::ExecuteTxnPartitioned, txn));
+            }
+        }
+
+        if (idle)
+            spin.Wait();
+        else
+            spin.Reset();
+    }
+}
+
+void TxnProcessor::ExecuteTxnPartitioned(Txn* txn)
+{
+    // The txn holds all of its locks, so it can commit right here, without a
+    // round trip through the scheduler thread.
+    ReadTxnKeys(txn);
+    txn->Run();
+
+    if (txn->Status() == COMPLETED_C)
+    {
+        ApplyWrites(txn);
+        txn->status_ = COMMITTED;
+    }
+    else if (txn->Status() == COMPLETED_A)
+    {
+        txn->status_ = ABORTED;
+    }
+    else
+    {
+        // Invalid TxnStatus!
+        DIE("Completed Txn has invalid TxnStatus: " << txn->Status());
+    }
+
+    uint64 partitions = txn->lock_partitions_;
+    if (partitions == 0)
+    {
+        ReturnResult(txn);
+        return;
+    }
+
+    // Ask each partition to release the txn's locks, through this worker's own
+    // queue to it.
+    bool claimed;
+    int worker = ThreadId(&worker_ids, generation_, &worker_count_, &claimed);
+    assert(worker < static_cast<int>(partitions_[0]->releases_.size()));
+    txn->pending_partitions_.store(__builtin_popcountll(partitions), std::memory_order_relaxed);
+    for (int i = 0; i < LOCK_PARTITIONS; i++)
+    {
+        if ((partitions & (1ull << i)) == 0) continue;
+        SPSCQueue<Txn*>* releases = partitions_[i]->releases_[worker];
+        while (!releases->PushNonBlocking(txn))
+        {
+            // Shutting down: the partition is gone, so let go of the txn on its
+            // behalf.
+            if (partitions_stopped_.load(std::memory_order_relaxed))
+            {
+                if (txn->pending_partitions_.fetch_sub(1, std::memory_order_acq_rel) == 1) ReturnResult(txn);
+                break;
+            }
+            sched_yield();
         }
     }
 }
@@ -232,10 +698,21 @@ void TxnProcessor::RunLockingScheduler()
 void TxnProcessor::ExecuteTxn(Txn* txn)
 {
     // Get the start time
-    txn->occ_start_time_ = GetTime();
+    txn->occ_start_time_ = storage_->Now();
+
+    ReadTxnKeys(txn);
+
+    // Execute txn's program logic.
+    txn->Run();
+
+    // Hand the txn back to the RunScheduler thread.
+    completed_txns_.Push(txn);
+}
 
+void TxnProcessor::ReadTxnKeys(Txn* txn)
+{
     // Read everything in from readset.
-    for (set<Key>::iterator it = txn->readset_.begin(); it != txn->readset_.end(); ++it)
+    for (KeySet::iterator it = txn->readset_.begin(); it != txn->readset_.end(); ++it)
     {
         // Save each read result iff record exists in storage.
         Value result;
@@ -243,63 +720,982 @@ void TxnProcessor::ExecuteTxn(Txn* txn)
     }
 
     // Also read everything in from writeset.
-    for (set<Key>::iterator it = txn->writeset_.begin(); it != txn->writeset_.end(); ++it)
+    for (KeySet::iterator it = txn->writeset_.begin(); it != txn->writeset_.end(); ++it)
     {
         // Save each read result iff record exists in storage.
         Value result;
         if (storage_->Read(*it, &result)) txn->reads_[*it] = result;
     }
-
-    // Execute txn's program logic.
-    txn->Run();
-
-    // Hand the txn back to the RunScheduler thread.
-    completed_txns_.Push(txn);
 }
 
 void TxnProcessor::ApplyWrites(Txn* txn)
 {
     // Write buffered writes out to storage.
-    for (map<Key, Value>::iterator it = txn->writes_.begin(); it != txn->writes_.end(); ++it)
+    for (KeyValueMap::iterator it = txn->writes_.begin(); it != txn->writes_.end(); ++it)
     {
         storage_->Write(it->first, it->second, txn->unique_id_);
     }
 }
 
-void TxnProcessor::RunOCCScheduler()
+// Entry of the VLL scheduler's queue of active txns. 'txn_' is reset to NULL
+// once the txn has finished.
+struct VLLQueueEntry
+{
+    VLLQueueEntry(Txn* txn, bool blocked) : txn_(txn), blocked_(blocked) {}
+    Txn* txn_;
+    bool blocked_;  // Waiting to become the oldest active txn.
+};
+
+void TxnProcessor::RunVLLScheduler()
 {
-    //
-    // Implement this method!
-    //
-    // [For now, run serial scheduler in order to make it through the test
-    // suite]
+    VLLStorage* storage = static_cast<VLLStorage*>(storage_);
+
+    // Active txns in the order they were scheduled. 'queue[i]' is the txn at
+    // position 'queue_begin + i'.
+    deque<VLLQueueEntry> queue;
+    uint64 queue_begin = 0;
+
+    Txn* txn;
+    while (!stopped_)
+    {
+        // Count the new txn's lock requests. It conflicts with an active txn
+        // iff one of the counters was already non-zero in a conflicting mode.
+        if (NextTxnRequest(&txn))
+        {
+            bool blocked = false;
+            for (KeySet::iterator it = txn->readset_.begin(); it != txn->readset_.end(); ++it)
+            {
+                if (!storage->RequestShared(*it)) blocked = true;
+            }
+            for (KeySet::iterator it = txn->writeset_.begin(); it != txn->writeset_.end(); ++it)
+            {
+                if (!storage->RequestExclusive(*it)) blocked = true;
+            }
+
+            txn->vll_position_ = queue_begin + queue.size();
+            queue.push_back(VLLQueueEntry(txn, blocked));
+            if (!blocked) tp_->AddTask(TxnTask(this, &TxnProcessor::ExecuteTxn, txn));
+        }
+
+        // Process and commit all transactions that have finished running.
+        while (completed_txns_.Pop(&txn))
+        {
+            // Commit/abort txn according to program logic's commit/abort decision.
+            if (txn->Status() == COMPLETED_C)
+            {
+                ApplyWrites(txn);
+                txn->status_ = COMMITTED;
+            }
+            else if (txn->Status() == COMPLETED_A)
+            {
+                txn->status_ = ABORTED;
+            }
+            else
+            {
+                // Invalid TxnStatus!
+                DIE("Completed Txn has invalid TxnStatus: " << txn->Status());
+            }
+
+            for (KeySet::iterator it = txn->readset_.begin(); it != txn->readset_.end(); ++it)
+            {
+                storage->ReleaseShared(*it);
+            }
+            for (KeySet::iterator it = txn->writeset_.begin(); it != txn->writeset_.end(); ++it)
+            {
+                storage->ReleaseExclusive(*it);
+            }
+            queue[txn->vll_position_ - queue_begin].txn_ = NULL;
+
+            // Return result to client.
+            ReturnResult(txn);
+        }
 
-    RunSerialScheduler();
+        // The oldest active txn cannot conflict with any txn scheduled before
+        // it, since they have all finished, nor with a txn running after it,
+        // since that one would have counted its requests. So it can run even
+        // if it was blocked.
+        while (!queue.empty() && queue.front().txn_ == NULL)
+        {
+            queue.pop_front();
+            queue_begin++;
+        }
+        if (!queue.empty() && queue.front().blocked_)
+        {
+            queue.front().blocked_ = false;
+            tp_->AddTask(TxnTask(this, &TxnProcessor::ExecuteTxn, queue.front().txn_));
+        }
+    }
 }
 
-void TxnProcessor::RunOCCParallelScheduler()
+// Returns true if 'a' and 'b' have a key in common.
+static bool Intersects(const KeySet& a, const KeySet& b)
 {
-    //
-    // Implement this method! Note that implementing OCC with parallel
-    // validation may need to create another method, like
-    // TxnProcessor::ExecuteTxnParallel.
-    // Note that you can use active_set_ and active_set_mutex_ we provided
-    // for you in the txn_processor.h
-    //
-    // [For now, run serial scheduler in order to make it through the test
-    // suite]
-    RunSerialScheduler();
+    KeySet::const_iterator i = a.begin();
+    KeySet::const_iterator j = b.begin();
+    while (i != a.end() && j != b.end())
+    {
+        if (*i < *j)
+            ++i;
+        else if (*j < *i)
+            ++j;
+        else
+            return true;
+    }
+    return false;
 }
 
-void TxnProcessor::RunMVCCScheduler()
+bool TxnProcessor::SerialValidate(Txn* txn)
 {
-    //
-    // Implement this method!
-
-    // Hint:Pop a txn from txn_requests_, and pass it to a thread to execute.
-    // Note that you may need to create another execute method, like TxnProcessor::MVCCExecuteTxn.
-    //
-    // [For now, run serial scheduler in order to make it through the test
-    // suite]
-    RunSerialScheduler();
+    // Every record the txn touched must still have the version it had when
+    // the txn started reading.
+    for (KeySet::iterator it = txn->readset_.begin(); it != txn->readset_.end(); ++it)
+    {
+        if (storage_->Timestamp(*it) > txn->occ_start_time_) return false;
+    }
+    for (KeySet::iterator it = txn->writeset_.begin(); it != txn->writeset_.end(); ++it)
+    {
+        if (storage_->Timestamp(*it) > txn->occ_start_time_) return false;
+    }
+    return true;
+}
+
+void TxnProcessor::RunOCCScheduler()
+{
+    Txn* txn;
+    while (!stopped_)
+    {
+        // Start the next incoming transaction request running right away.
+        if (NextTxnRequest(&txn))
+        {
+            tp_->AddTask(TxnTask(this, &TxnProcessor::ExecuteTxn, txn));
+        }
+
+        // Validate and commit all transactions that have finished running.
+        while (completed_txns_.Pop(&txn))
+        {
+            if (txn->Status() == COMPLETED_A)
+            {
+                txn->status_ = ABORTED;
+            }
+            else if (txn->Status() != COMPLETED_C)
+            {
+                // Invalid TxnStatus!
+                DIE("Completed Txn has invalid TxnStatus: " << txn->Status());
+            }
+            else if (SerialValidate(txn))
+            {
+                ApplyWrites(txn);
+                txn->status_ = COMMITTED;
+            }
+            else
+            {
+                // Another txn wrote a record this one depends on: run it
+                // again from scratch.
+                scheduler_restarts_.restarts_.fetch_add(1, std::memory_order_relaxed);
+                txn->reads_.clear();
+                txn->writes_.clear();
+                txn->status_ = INCOMPLETE;
+                tp_->AddTask(TxnTask(this, &TxnProcessor::ExecuteTxn, txn));
+                continue;
+            }
+
+            // Return result to client.
+            ReturnResult(txn);
+        }
+    }
+}
+
+void TxnProcessor::RunOCCParallelScheduler()
+{
+    Txn* txn;
+    while (!stopped_)
+    {
+        // Workers execute, validate and commit txns on their own.
+        if (NextTxnRequest(&txn))
+        {
+            tp_->AddTask(TxnTask(this, &TxnProcessor::ExecuteTxnParallel, txn));
+        }
+    }
+}
+
+void TxnProcessor::ExecuteTxnParallel(Txn* txn)
+{
+    while (true)
+    {
+        // Get the start time, read everything in and run the program logic.
+        txn->occ_start_time_ = storage_->Now();
+        ReadTxnKeys(txn);
+        txn->Run();
+
+        if (txn->Status() == COMPLETED_A)
+        {
+            txn->status_ = ABORTED;
+            break;
+        }
+        else if (txn->Status() != COMPLETED_C)
+        {
+            // Invalid TxnStatus!
+            DIE("Completed Txn has invalid TxnStatus: " << txn->Status());
+        }
+
+        bool valid = P_OCC_RECORD_LOCKS ? CommitWithRecordLocks(txn) : CommitWithActiveSet(txn);
+        if (valid)
+        {
+            txn->status_ = COMMITTED;
+            break;
+        }
+
+        // Run it again from scratch.
+        CountRestart();
+        txn->reads_.clear();
+        txn->writes_.clear();
+        txn->status_ = INCOMPLETE;
+    }
+
+    // Return result to client.
+    ReturnResult(txn);
+}
+
+bool TxnProcessor::CommitWithRecordLocks(Txn* txn)
+{
+    ArrayStorage* storage = static_cast<ArrayStorage*>(storage_);
+
+    // Lock the writeset in key order, so that validating txns cannot
+    // deadlock.
+    for (KeySet::iterator it = txn->writeset_.begin(); it != txn->writeset_.end(); ++it)
+    {
+        storage->LockRecord(*it);
+    }
+
+    // A record read must not have changed since the txn started, nor be
+    // locked by a txn that may be about to change it.
+    bool valid = true;
+    for (KeySet::iterator it = txn->readset_.begin(); valid && it != txn->readset_.end(); ++it)
+    {
+        uint64 word = storage->Tid(*it);
+        if ((word & ~ArrayStorage::kLockBit) > txn->occ_start_time_) valid = false;
+        if ((word & ArrayStorage::kLockBit) && !txn->writeset_.count(*it)) valid = false;
+    }
+    for (KeySet::iterator it = txn->writeset_.begin(); valid && it != txn->writeset_.end(); ++it)
+    {
+        if ((storage->Tid(*it) & ~ArrayStorage::kLockBit) > txn->occ_start_time_) valid = false;
+    }
+
+    // The new version is taken while the records are locked, so a txn that
+    // starts after it either waits for the writes or sees them.
+    uint64 version = valid ? storage->NextVersion() : 0;
+    for (KeySet::iterator it = txn->writeset_.begin(); it != txn->writeset_.end(); ++it)
+    {
+        KeyValueMap::iterator write = valid ? txn->writes_.find(*it) : txn->writes_.end();
+        if (write != txn->writes_.end())
+            storage->WriteLocked(*it, write->second, version);
+        else
+            storage->UnlockRecord(*it);
+    }
+    return valid;
+}
+
+bool TxnProcessor::CommitWithActiveSet(Txn* txn)
+{
+    // Join the active set. Only joining needs the mutex; the checks below run
+    // in parallel.
+    active_set_mutex_.Lock();
+    std::pair<uint64, Txn*> entry(next_validation_seq_++, txn);
+    active_set_.Insert(entry);
+    active_set_mutex_.Unlock();
+
+    // Txns that joined before this one may not have written yet, so none of
+    // their writes may touch a key this txn uses. Txns that joined before and
+    // have already left wrote before leaving, and are caught by the record
+    // versions, which must therefore be checked afterwards.
+    bool valid = true;
+    active_set_.ForEach([&](const std::pair<uint64, Txn*>& other) {
+        if (other.first >= entry.first) return false;
+        if (Intersects(txn->readset_, other.second->writeset_) || Intersects(txn->writeset_, other.second->writeset_))
+        {
+            valid = false;
+        }
+        return valid;
+    });
+    if (valid) valid = SerialValidate(txn);
+
+    if (valid) ApplyWrites(txn);
+    active_set_.Erase(entry);
+    return valid;
+}
+
+void TxnProcessor::RunMVCCScheduler()
+{
+    Txn* txn;
+    while (!stopped_)
+    {
+        // Workers execute and commit txns on their own.
+        if (NextTxnRequest(&txn))
+        {
+            tp_->AddTask(TxnTask(this, &TxnProcessor::MVCCExecuteTxn, txn));
+        }
+    }
+}
+
+void TxnProcessor::MVCCExecuteTxn(Txn* txn)
+{
+    MVCCStorage<MVCC_KEY_LOCK>* storage = static_cast<MVCCStorage<MVCC_KEY_LOCK>*>(storage_);
+
+    // Let the garbage collector know that this worker reads from now on, and
+    // at which timestamps. Announcing a lower bound before taking the txn's
+    // timestamp guarantees that the collector either sees the announcement or
+    // computes a watermark no larger than the timestamp.
+    bool claimed;
+    int worker = ThreadId(&worker_ids, generation_, &worker_count_, &claimed);
+    assert(worker < EpochManager::kMaxThreads);
+    mvcc_epochs_.Enter(worker);
+    mvcc_active_ids_[worker].id_.store(next_unique_id_.load());
+    txn->unique_id_ = next_unique_id_.fetch_add(1);
+
+    while (true)
+    {
+        // Read everything in from readset and writeset as of the txn's
+        // timestamp.
+        for (KeySet::iterator it = txn->readset_.begin(); it != txn->readset_.end(); ++it)
+        {
+            Value result;
+            if (storage->Read(*it, &result, txn->unique_id_)) txn->reads_[*it] = result;
+        }
+        for (KeySet::iterator it = txn->writeset_.begin(); it != txn->writeset_.end(); ++it)
+        {
+            Value result;
+            if (storage->Read(*it, &result, txn->unique_id_)) txn->reads_[*it] = result;
+        }
+
+        // Execute txn's program logic.
+        txn->Run();
+
+        if (txn->Status() == COMPLETED_A)
+        {
+            txn->status_ = ABORTED;
+            break;
+        }
+        else if (txn->Status() != COMPLETED_C)
+        {
+            // Invalid TxnStatus!
+            DIE("Completed Txn has invalid TxnStatus: " << txn->Status());
+        }
+
+        MVCCLockWriteKeys(txn);
+        if (MVCCCheckWrites(txn))
+        {
+            ApplyWrites(txn);
+            MVCCUnlockWriteKeys(txn);
+            txn->status_ = COMMITTED;
+            break;
+        }
+        MVCCUnlockWriteKeys(txn);
+
+        // A younger txn read a version this one would overwrite: run it again
+        // from scratch, with a new timestamp.
+        CountRestart();
+        txn->reads_.clear();
+        txn->writes_.clear();
+        txn->status_    = INCOMPLETE;
+        txn->unique_id_ = next_unique_id_.fetch_add(1);
+    }
+
+    mvcc_active_ids_[worker].id_.store(kNoActiveTxn, std::memory_order_release);
+    mvcc_epochs_.Exit(worker);
+
+    // Return result to client.
+    ReturnResult(txn);
+}
+
+bool TxnProcessor::MVCCCheckWrites(Txn* txn)
+{
+    MVCCStorage<MVCC_KEY_LOCK>* storage = static_cast<MVCCStorage<MVCC_KEY_LOCK>*>(storage_);
+    for (KeySet::iterator it = txn->writeset_.begin(); it != txn->writeset_.end(); ++it)
+    {
+        if (!storage->CheckWrite(*it, txn->unique_id_)) return false;
+    }
+    return true;
+}
+
+void TxnProcessor::MVCCLockWriteKeys(Txn* txn)
+{
+    // The writeset is sorted, so txns take their locks in the same order and
+    // cannot deadlock.
+    MVCCStorage<MVCC_KEY_LOCK>* storage = static_cast<MVCCStorage<MVCC_KEY_LOCK>*>(storage_);
+    for (KeySet::iterator it = txn->writeset_.begin(); it != txn->writeset_.end(); ++it)
+    {
+        storage->Lock(*it);
+    }
+}
+
+void TxnProcessor::MVCCUnlockWriteKeys(Txn* txn)
+{
+    MVCCStorage<MVCC_KEY_LOCK>* storage = static_cast<MVCCStorage<MVCC_KEY_LOCK>*>(storage_);
+    for (KeySet::iterator it = txn->writeset_.begin(); it != txn->writeset_.end(); ++it)
+    {
+        storage->Unlock(*it);
+    }
+}
+
+void TxnProcessor::RunSnapshotScheduler()
+{
+    Txn* txn;
+    while (!stopped_)
+    {
+        // Workers execute and commit txns on their own.
+        if (NextTxnRequest(&txn))
+        {
+            tp_->AddTask(TxnTask(this, &TxnProcessor::SnapshotExecuteTxn, txn));
+        }
+    }
+}
+
+void TxnProcessor::SnapshotExecuteTxn(Txn* txn)
+{
+    MVCCStorage<MVCC_KEY_LOCK>* storage = static_cast<MVCCStorage<MVCC_KEY_LOCK>*>(storage_);
+
+    // Announce a lower bound on the snapshot to the garbage collector, as in
+    // MVCCExecuteTxn.
+    bool claimed;
+    int worker = ThreadId(&worker_ids, generation_, &worker_count_, &claimed);
+    assert(worker < EpochManager::kMaxThreads);
+    mvcc_epochs_.Enter(worker);
+    mvcc_active_ids_[worker].id_.store(snapshot_ts_.load());
+
+    while (true)
+    {
+        // Read everything in from readset and writeset as of the latest
+        // snapshot.
+        txn->occ_start_time_ = snapshot_ts_.load();
+        for (KeySet::iterator it = txn->readset_.begin(); it != txn->readset_.end(); ++it)
+        {
+            Value result;
+            if (storage->ReadSnapshot(*it, &result, txn->occ_start_time_)) txn->reads_[*it] = result;
+        }
+        for (KeySet::iterator it = txn->writeset_.begin(); it != txn->writeset_.end(); ++it)
+        {
+            Value result;
+            if (storage->ReadSnapshot(*it, &result, txn->occ_start_time_)) txn->reads_[*it] = result;
+        }
+
+        // Execute txn's program logic.
+        txn->Run();
+
+        if (txn->Status() == COMPLETED_A)
+        {
+            txn->status_ = ABORTED;
+            break;
+        }
+        else if (txn->Status() != COMPLETED_C)
+        {
+            // Invalid TxnStatus!
+            DIE("Completed Txn has invalid TxnStatus: " << txn->Status());
+        }
+
+        // A snapshot is consistent, so read-only txns need no validation.
+        if (txn->writeset_.empty())
+        {
+            txn->status_ = COMMITTED;
+            break;
+        }
+
+        // First committer wins: no key in the writeset may have a version
+        // newer than the snapshot.
+        MVCCLockWriteKeys(txn);
+        bool valid = true;
+        for (KeySet::iterator it = txn->writeset_.begin(); valid && it != txn->writeset_.end(); ++it)
+        {
+            if (storage->Timestamp(*it) > txn->occ_start_time_) valid = false;
+        }
+
+        // Serializable readset validation: neither may any key in the
+        // readset, nor may it be about to get one from a txn that is
+        // committing.
+        if (mode_ == SNAPSHOT_VALIDATED)
+        {
+            for (KeySet::iterator it = txn->readset_.begin(); valid && it != txn->readset_.end(); ++it)
+            {
+                if (txn->writeset_.count(*it)) continue;
+                if (storage->Timestamp(*it) > txn->occ_start_time_ || storage->Locked(*it)) valid = false;
+            }
+        }
+
+        if (valid)
+        {
+            // Install the writes at a new commit timestamp. The slot holds a
+            // lower bound on it before the timestamp is even taken, so that a
+            // PublishSnapshot that sees the timestamp taken also sees it being
+            // installed.
+            snapshot_installing_[worker].id_.store(next_commit_ts_.load());
+            uint64 commit_ts = next_commit_ts_.fetch_add(1);
+            snapshot_installing_[worker].id_.store(commit_ts);
+            for (KeyValueMap::iterator it = txn->writes_.begin(); it != txn->writes_.end(); ++it)
+            {
+                storage->Write(it->first, it->second, commit_ts);
+            }
+            MVCCUnlockWriteKeys(txn);
+
+            snapshot_installing_[worker].id_.store(kNoActiveTxn);
+            PublishSnapshot();
+            txn->status_ = COMMITTED;
+            break;
+        }
+        MVCCUnlockWriteKeys(txn);
+
+        // Run it again from scratch, on a newer snapshot.
+        CountRestart();
+        txn->reads_.clear();
+        txn->writes_.clear();
+        txn->status_ = INCOMPLETE;
+    }
+
+    mvcc_active_ids_[worker].id_.store(kNoActiveTxn, std::memory_order_release);
+    mvcc_epochs_.Exit(worker);
+
+    // Return result to client.
+    ReturnResult(txn);
+}
+
+void TxnProcessor::PublishSnapshot()
+{
+    // Every commit below both the next timestamp and those still being
+    // installed is in, as all of them were taken before the former was read.
+    uint64 oldest = next_commit_ts_.load();
+    for (int i = 0; i < EpochManager::kMaxThreads; i++)
+    {
+        uint64 installing = snapshot_installing_[i].id_.load();
+        if (installing < oldest) oldest = installing;
+    }
+
+    // Snapshots only ever move forward, since the garbage collector may
+    // already have dropped versions only an older one would read.
+    uint64 snapshot = snapshot_ts_.load();
+    while (snapshot < oldest - 1 && !snapshot_ts_.compare_exchange_weak(snapshot, oldest - 1))
+    {
+    }
+}
+
+void TxnProcessor::RunSiloScheduler()
+{
+    Txn* txn;
+    while (!stopped_)
+    {
+        // Workers execute and commit txns on their own.
+        if (NextTxnRequest(&txn))
+        {
+            tp_->AddTask(TxnTask(this, &TxnProcessor::SiloExecuteTxn, txn));
+        }
+    }
+}
+
+void TxnProcessor::SiloExecuteTxn(Txn* txn)
+{
+    ArrayStorage* storage = static_cast<ArrayStorage*>(storage_);
+    bool claimed;
+    int worker = ThreadId(&worker_ids, generation_, &worker_count_, &claimed);
+    assert(worker < EpochManager::kMaxThreads);
+
+    // TIDs of the records read, readset first, then writeset.
+    SmallVector<uint64, 2 * TXN_INLINE_KEYS> tids;
+    while (true)
+    {
+        // Read phase.
+        tids.clear();
+        for (KeySet::iterator it = txn->readset_.begin(); it != txn->readset_.end(); ++it)
+        {
+            Value result;
+            tids.push_back(storage->ReadStable(*it, &result));
+            txn->reads_[*it] = result;
+        }
+        for (KeySet::iterator it = txn->writeset_.begin(); it != txn->writeset_.end(); ++it)
+        {
+            Value result;
+            tids.push_back(storage->ReadStable(*it, &result));
+            txn->reads_[*it] = result;
+        }
+
+        // Execute txn's program logic.
+        txn->Run();
+
+        if (txn->Status() == COMPLETED_A)
+        {
+            txn->status_ = ABORTED;
+            break;
+        }
+        else if (txn->Status() != COMPLETED_C)
+        {
+            // Invalid TxnStatus!
+            DIE("Completed Txn has invalid TxnStatus: " << txn->Status());
+        }
+
+        // Validation phase. Lock the writeset in key order, so that
+        // committing txns cannot deadlock, then take the epoch: this is the
+        // txn's serialization point.
+        for (KeySet::iterator it = txn->writeset_.begin(); it != txn->writeset_.end(); ++it)
+        {
+            storage->LockRecord(*it);
+        }
+        uint64 epoch = silo_epoch_.load();
+
+        bool valid = true;
+        uint64 tid = silo_tids_[worker].tid_;
+        int i      = 0;
+        for (KeySet::iterator it = txn->readset_.begin(); it != txn->readset_.end(); ++it, ++i)
+        {
+            uint64 now = storage->Tid(*it);
+            if ((now & ~ArrayStorage::kLockBit) != tids[i]) valid = false;
+            if ((now & ArrayStorage::kLockBit) && !txn->writeset_.count(*it)) valid = false;
+            tid = std::max(tid, tids[i]);
+        }
+        for (KeySet::iterator it = txn->writeset_.begin(); it != txn->writeset_.end(); ++it, ++i)
+        {
+            if ((storage->Tid(*it) & ~ArrayStorage::kLockBit) != tids[i]) valid = false;
+            tid = std::max(tid, tids[i]);
+        }
+
+        if (valid)
+        {
+            // Write phase. The new TID is larger than that of every record
+            // read or written and than the worker's previous one, and lies in
+            // the current epoch.
+            tid                     = std::max(tid + 1, epoch << SILO_EPOCH_SHIFT);
+            silo_tids_[worker].tid_ = tid;
+            for (KeySet::iterator it = txn->writeset_.begin(); it != txn->writeset_.end(); ++it)
+            {
+                KeyValueMap::iterator write = txn->writes_.find(*it);
+                if (write != txn->writes_.end())
+                    storage->WriteLocked(*it, write->second, tid);
+                else
+                    storage->UnlockRecord(*it);
+            }
+            txn->status_ = COMMITTED;
+            break;
+        }
+
+        // Run it again from scratch.
+        for (KeySet::iterator it = txn->writeset_.begin(); it != txn->writeset_.end(); ++it)
+        {
+            storage->UnlockRecord(*it);
+        }
+        CountRestart();
+        txn->reads_.clear();
+        txn->writes_.clear();
+        txn->status_ = INCOMPLETE;
+    }
+
+    // Return result to client.
+    ReturnResult(txn);
+}
+
+void TxnProcessor::RunTicTocScheduler()
+{
+    Txn* txn;
+    while (!stopped_)
+    {
+        // Workers execute and commit txns on their own.
+        if (NextTxnRequest(&txn))
+        {
+            tp_->AddTask(TxnTask(this, &TxnProcessor::TicTocExecuteTxn, txn));
+        }
+    }
+}
+
+void TxnProcessor::TicTocExecuteTxn(Txn* txn)
+{
+    ArrayStorage* storage = static_cast<ArrayStorage*>(storage_);
+
+    // Timestamp words of the records read, readset first, then writeset.
+    SmallVector<uint64, 2 * TXN_INLINE_KEYS> words;
+    while (true)
+    {
+        // Read phase.
+        words.clear();
+        for (KeySet::iterator it = txn->readset_.begin(); it != txn->readset_.end(); ++it)
+        {
+            Value result;
+            words.push_back(storage->ReadStable(*it, &result));
+            txn->reads_[*it] = result;
+        }
+        for (KeySet::iterator it = txn->writeset_.begin(); it != txn->writeset_.end(); ++it)
+        {
+            Value result;
+            words.push_back(storage->ReadStable(*it, &result));
+            txn->reads_[*it] = result;
+        }
+
+        // Execute txn's program logic.
+        txn->Run();
+
+        if (txn->Status() == COMPLETED_A)
+        {
+            txn->status_ = ABORTED;
+            break;
+        }
+        else if (txn->Status() != COMPLETED_C)
+        {
+            // Invalid TxnStatus!
+            DIE("Completed Txn has invalid TxnStatus: " << txn->Status());
+        }
+
+        // Lock the writeset in key order, so that committing txns cannot
+        // deadlock.
+        for (KeySet::iterator it = txn->writeset_.begin(); it != txn->writeset_.end(); ++it)
+        {
+            storage->LockRecord(*it);
+        }
+
+        // The commit timestamp must not precede any version read, and must
+        // follow every read of the versions the txn replaces.
+        uint64 commit_ts = 0;
+        for (int i = 0; i < words.size(); i++) commit_ts = std::max(commit_ts, ArrayStorage::Wts(words[i]));
+        for (KeySet::iterator it = txn->writeset_.begin(); it != txn->writeset_.end(); ++it)
+        {
+            commit_ts = std::max(commit_ts, ArrayStorage::Rts(storage->Tid(*it)) + 1);
+        }
+
+        // Every version read must still be current at the commit timestamp.
+        // Records in the writeset are locked, so they only need to be
+        // unchanged; the others get their rts extended.
+        bool valid = true;
+        int i      = 0;
+        for (KeySet::iterator it = txn->readset_.begin(); valid && it != txn->readset_.end(); ++it, ++i)
+        {
+            if (txn->writeset_.count(*it))
+            {
+                valid = ArrayStorage::Wts(storage->Tid(*it)) == ArrayStorage::Wts(words[i]);
+            }
+            else if (ArrayStorage::Rts(words[i]) < commit_ts)
+            {
+                valid = storage->ExtendRts(*it, ArrayStorage::Wts(words[i]), commit_ts);
+            }
+        }
+        i = txn->readset_.size();
+        for (KeySet::iterator it = txn->writeset_.begin(); valid && it != txn->writeset_.end(); ++it, ++i)
+        {
+            valid = ArrayStorage::Wts(storage->Tid(*it)) == ArrayStorage::Wts(words[i]);
+        }
+
+        if (valid)
+        {
+            for (KeySet::iterator it = txn->writeset_.begin(); it != txn->writeset_.end(); ++it)
+            {
+                KeyValueMap::iterator write = txn->writes_.find(*it);
+                if (write != txn->writes_.end())
+                    storage->WriteLocked(*it, write->second, commit_ts);
+                else
+                    storage->UnlockRecord(*it);
+            }
+            txn->status_ = COMMITTED;
+            break;
+        }
+
+        // Run it again from scratch.
+        for (KeySet::iterator it = txn->writeset_.begin(); it != txn->writeset_.end(); ++it)
+        {
+            storage->UnlockRecord(*it);
+        }
+        CountRestart();
+        txn->reads_.clear();
+        txn->writes_.clear();
+        txn->status_ = INCOMPLETE;
+    }
+
+    // Return result to client.
+    ReturnResult(txn);
+}
+
+void TxnProcessor::RunOnlineLockingScheduler()
+{
+    Txn* txn;
+    while (!stopped_)
+    {
+        // Workers lock, execute and commit txns on their own.
+        if (NextTxnRequest(&txn))
+        {
+            tp_->AddTask(TxnTask(this, &TxnProcessor::OnlineLockingExecuteTxn, txn));
+        }
+    }
+}
+
+void TxnProcessor::OnlineLockingExecuteTxn(Txn* txn)
+{
+    bool claimed;
+    int worker = ThreadId(&worker_ids, generation_, &worker_count_, &claimed);
+    assert(worker < OnlineLockManager::kMaxWorkers);
+
+    while (true)
+    {
+        // The txn keeps its unique_id_ across retries, so that it ages.
+        online_lm_->Begin(worker, txn->unique_id_);
+
+        // Lock each key right before reading it. Keys in both sets are
+        // locked EXCLUSIVE from the start rather than upgraded.
+        bool locked = true;
+        for (KeySet::iterator it = txn->readset_.begin(); locked && it != txn->readset_.end(); ++it)
+        {
+            locked = online_lm_->Lock(worker, *it, txn->writeset_.count(*it) ? EXCLUSIVE : SHARED);
+            Value result;
+            if (locked && storage_->Read(*it, &result)) txn->reads_[*it] = result;
+        }
+        for (KeySet::iterator it = txn->writeset_.begin(); locked && it != txn->writeset_.end(); ++it)
+        {
+            locked = online_lm_->Lock(worker, *it, EXCLUSIVE);
+            Value result;
+            if (locked && storage_->Read(*it, &result)) txn->reads_[*it] = result;
+        }
+
+        if (locked)
+        {
+            // Execute txn's program logic.
+            txn->Run();
+
+            if (txn->Status() == COMPLETED_A)
+            {
+                txn->status_ = ABORTED;
+            }
+            else if (txn->Status() != COMPLETED_C)
+            {
+                // Invalid TxnStatus!
+                DIE("Completed Txn has invalid TxnStatus: " << txn->Status());
+            }
+            else if (!online_lm_->Wounded(worker))
+            {
+                ApplyWrites(txn);
+                txn->status_ = COMMITTED;
+            }
+        }
+
+        // Release all locks, including those of keys the txn did not get to.
+        for (KeySet::iterator it = txn->readset_.begin(); it != txn->readset_.end(); ++it)
+        {
+            online_lm_->Release(worker, *it);
+        }
+        for (KeySet::iterator it = txn->writeset_.begin(); it != txn->writeset_.end(); ++it)
+        {
+            online_lm_->Release(worker, *it);
+        }
+        if (txn->status_ == COMMITTED || txn->status_ == ABORTED) break;
+
+        // Run it again from scratch, but first let the txn that made it abort
+        // get the locks it gave up.
+        txn->reads_.clear();
+        txn->writes_.clear();
+        txn->status_ = INCOMPLETE;
+        sched_yield();
+    }
+
+    // Return result to client.
+    ReturnResult(txn);
+}
+
+void TxnProcessor::RunEpochAdvancer()
+{
+    while (!background_stopped_.load(std::memory_order_relaxed))
+    {
+        usleep(SILO_EPOCH_US);
+        silo_epoch_.fetch_add(1);
+    }
+}
+
+uint64 TxnProcessor::MVCCWatermark()
+{
+    uint64 watermark = mode_ == SNAPSHOT || mode_ == SNAPSHOT_VALIDATED ? snapshot_ts_.load() : next_unique_id_.load();
+    for (int i = 0; i < EpochManager::kMaxThreads; i++)
+    {
+        uint64 id = mvcc_active_ids_[i].id_.load();
+        if (id < watermark) watermark = id;
+    }
+    return watermark;
+}
+
+void TxnProcessor::GarbageCollection()
+{
+    MVCCStorage<MVCC_KEY_LOCK>* storage = static_cast<MVCCStorage<MVCC_KEY_LOCK>*>(storage_);
+    VersionStats pass;
+    Key next = 0;
+    while (!background_stopped_.load(std::memory_order_relaxed))
+    {
+        vector<Version*> garbage;
+        storage->CollectGarbage(next, next + GC_SLICE_KEYS, MVCCWatermark(), &garbage, &pass);
+        if (!garbage.empty())
+        {
+            gc_limbo_.push_back(std::make_pair(mvcc_epochs_.Advance(), vector<Version*>()));
+            gc_limbo_.back().second.swap(garbage);
+        }
+        FreeGarbage(mvcc_epochs_.SafeEpoch());
+
+        next += GC_SLICE_KEYS;
+        if (next >= storage->KeyCount())
+        {
+            gc_stats_mutex_.Lock();
+            gc_stats_.passes_++;
+            gc_stats_.last_pass_ = pass;
+            gc_stats_mutex_.Unlock();
+            pass = VersionStats();
+            next = 0;
+        }
+
+        usleep(GC_INTERVAL_US);
+    }
+}
+
+void TxnProcessor::FreeGarbage(uint64 safe_epoch)
+{
+    uint64 freed = 0;
+    while (!gc_limbo_.empty() && gc_limbo_.front().first < safe_epoch)
+    {
+        vector<Version*>& chains = gc_limbo_.front().second;
+        for (size_t i = 0; i < chains.size(); i++)
+        {
+            Version* version = chains[i];
+            while (version != NULL)
+            {
+                Version* next = version->next_.load(std::memory_order_relaxed);
+                delete version;
+                version = next;
+                freed++;
+            }
+        }
+        gc_limbo_.pop_front();
+    }
+    if (freed == 0) return;
+
+    gc_stats_mutex_.Lock();
+    gc_stats_.reclaimed_versions_ += freed;
+    gc_stats_.reclaimed_bytes_ += freed * sizeof(Version);
+    gc_stats_mutex_.Unlock();
+}
+
+GCStats TxnProcessor::GarbageCollectionStats()
+{
+    gc_stats_mutex_.Lock();
+    GCStats stats = gc_stats_;
+    gc_stats_mutex_.Unlock();
+    return stats;
+}
+
+LockingStats TxnProcessor::OnlineLockingStats()
+{
+    if (mode_ != LOCKING_NO_WAIT && mode_ != LOCKING_WAIT_DIE && mode_ != LOCKING_WOUND_WAIT) return LockingStats();
+    return online_lm_->Stats();
+}
+
+uint64 TxnProcessor::Restarts()
+{
+    uint64 restarts = scheduler_restarts_.restarts_.load(std::memory_order_relaxed);
+    for (int i = 0; i < EpochManager::kMaxThreads; i++)
+    {
+        restarts += restarts_[i].restarts_.load(std::memory_order_relaxed);
+    }
+    return restarts;
+}
+
+void TxnProcessor::CountRestart()
+{
+    // Only the thread itself writes its counter.
+    bool claimed;
+    int worker = ThreadId(&worker_ids, generation_, &worker_count_, &claimed);
+    assert(worker < EpochManager::kMaxThreads);
+    std::atomic<uint64>* restarts = &restarts_[worker].restarts_;
+    restarts->store(restarts->load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
 }
@@ -6,21 +6,67 @@
 #include <map>
 #include <string>
 
+#include "txn/array_storage.h"
 #include "txn/common.h"
 #include "txn/lock_manager.h"
 #include "txn/mvcc_storage.h"
 #include "txn/storage.h"
 #include "txn/txn.h"
+#include "txn/vll_storage.h"
 #include "utils/atomic.h"
+#include "utils/cpu_topology.h"
+#include "utils/epoch.h"
 #include "utils/mutex.h"
 #include "utils/static_thread_pool.h"
+#include "utils/work_stealing_thread_pool.h"
 
 using std::deque;
 using std::map;
 using std::string;
 
-// The TxnProcessor supports five different execution modes, corresponding to
-// the four parts of assignment 2, plus a simple serial (non-concurrent) mode.
+// Default number of worker threads executing transactions.
+#define THREAD_COUNT 8
+
+// Default placement of the scheduler and worker threads on the machine's CPUs.
+#define PIN_POLICY PIN_COMPACT
+
+// Lock manager of LOCKING mode: a DenseLockManager with one lock header per
+// key of the bounded key range (true), or LockManagerB (false).
+#define DENSE_LOCK_MANAGER false
+
+// Number of lock partitions, each with its own CC thread, in P_LOCKING mode.
+// At most 64.
+#define LOCK_PARTITIONS 4
+
+// Type of the per-key lock serializing writers in the MVCC storage (MVCC,
+// SNAPSHOT and SNAPSHOT_VALIDATED modes): Mutex, TTASLock, TicketLock or
+// MCSLock.
+#define MVCC_KEY_LOCK TTASLock
+
+// Number of keys the MVCC garbage collector visits at a time, and how long it
+// pauses between two such slices, in microseconds.
+#define GC_SLICE_KEYS 4096
+#define GC_INTERVAL_US 100
+
+// Storage of the single-version modes other than SERIAL: ArrayStorage, a flat
+// array over the key range (true), or the base Storage's ConcurrentMap
+// (false). SERIAL always runs on the base Storage, and SILO, TICTOC and P_OCC
+// with P_OCC_RECORD_LOCKS always on ArrayStorage, whose record locks they use.
+#define ARRAY_STORAGE true
+
+// Whether P_OCC validates txns by locking the records they write and checking
+// the records they read (true), or against the write sets of all the txns in
+// 'active_set_' (false).
+#define P_OCC_RECORD_LOCKS true
+
+// Interval between two advances of the global epoch in SILO mode, in
+// microseconds, and the position of the epoch in a TID.
+#define SILO_EPOCH_US 40000
+#define SILO_EPOCH_SHIFT 32
+
+// The TxnProcessor's execution modes: the four parts of assignment 2 and a
+// simple serial (non-concurrent) mode, plus further locking, OCC and
+// multiversion schemes.
 enum CCMode
 {
     SERIAL                 = 0,  // Serial transaction execution (no concurrency)
@@ -29,17 +75,42 @@ enum CCMode
     OCC                    = 3,  // Part 2
     P_OCC                  = 4,  // Part 3
     MVCC                   = 5,  // Part 4
+    P_LOCKING              = 6,  // Part 1B, with the lock table partitioned
+                                 // across LOCK_PARTITIONS CC threads
+    VLL                    = 7,  // Very lightweight locking: lock counters
+                                 // kept with each record, no lock table
+    SNAPSHOT               = 8,  // Snapshot isolation on the MVCC storage
+    SILO                   = 9,  // Silo-style OCC: workers validate and
+                                 // commit on their own, ordered by epochs
+    TICTOC                 = 10,  // OCC with commit timestamps computed from
+                                  // each record's read/write timestamps
+    LOCKING_NO_WAIT        = 11,  // Non-deterministic 2PL, workers locking keys
+                                  // as they read them; conflicts abort
+    LOCKING_WAIT_DIE       = 12,  // As above; older txns wait, younger abort
+    LOCKING_WOUND_WAIT     = 13,  // As above; older txns abort younger ones
+    SNAPSHOT_VALIDATED     = 14,  // SNAPSHOT, plus serializable readset
+                                  // validation of update txns at commit
 };
 
 // Returns a human-readable string naming of the providing mode.
 string ModeToString(CCMode mode);
 
+// Counters of the MVCC garbage collector.
+struct GCStats
+{
+    GCStats() : passes_(0), reclaimed_versions_(0), reclaimed_bytes_(0) {}
+    uint64 passes_;              // Full passes over the keys completed
+    VersionStats last_pass_;     // What the last full pass left behind
+    uint64 reclaimed_versions_;  // Versions freed so far
+    uint64 reclaimed_bytes_;
+};
+
 class TxnProcessor
 {
    public:
     // The TxnProcessor's constructor starts the TxnProcessor running in the
-    // background.
-    explicit TxnProcessor(CCMode mode);
+    // background, with 'thread_count' worker threads placed according to 'pin'.
+    explicit TxnProcessor(CCMode mode, int thread_count = THREAD_COUNT, PinPolicy pin = PIN_POLICY);
 
     // The TxnProcessor's destructor stops all background threads and deallocates
     // all objects currently owned by the TxnProcessor, except for Txn objects.
@@ -49,28 +120,119 @@ class TxnProcessor
     // Ownership of '*txn' is transfered to the TxnProcessor.
     void NewTxnRequest(Txn* txn);
 
-    // Returns a pointer to the next COMMITTED or ABORTED Txn. The caller takes
-    // ownership of the returned Txn.
+    // As above, but instead of being returned by GetTxnResult(s), the txn is
+    // handed to 'callback(txn, arg)' as soon as it commits or aborts. The
+    // callback runs on one of the TxnProcessor's threads, so it should be short.
+    void NewTxnRequest(Txn* txn, TxnCallback callback, void* arg);
+
+    // Registers the 'n' txn requests in 'txns' at once, reserving a block of
+    // consecutive ids for them with a single atomic add. Ownership of the txns
+    // is transfered to the TxnProcessor.
+    void NewTxnRequests(Txn** txns, int n);
+
+    // Returns a pointer to the next COMMITTED or ABORTED Txn, blocking until
+    // one is available. The caller takes ownership of the returned Txn.
     Txn* GetTxnResult();
 
+    // Waits until at least one COMMITTED or ABORTED Txn is available, then
+    // appends up to 'max' of them to '*results' and returns how many were
+    // appended. The caller takes ownership of the returned Txns.
+    int GetTxnResults(vector<Txn*>* results, int max);
+
     // Main loop implementing all concurrency control/thread scheduling.
     void RunScheduler();
 
     static void* StartScheduler(void* arg);
 
+    static void* StartLockPartition(void* arg);
+
+    static void* StartGarbageCollection(void* arg);
+
+    static void* StartEpochAdvancer(void* arg);
+
+    // Returns the MVCC garbage collector's counters so far.
+    GCStats GarbageCollectionStats();
+
+    // Returns the counters of the lock manager in LOCKING_NO_WAIT,
+    // LOCKING_WAIT_DIE and LOCKING_WOUND_WAIT modes so far.
+    LockingStats OnlineLockingStats();
+
+    // Returns how many times txns failed validation and were run again in the
+    // optimistic and multiversion modes so far.
+    uint64 Restarts();
+
+    // Returns the CPU the scheduler thread (first entry) and each of the
+    // 'thread_count' workers are pinned to under 'pin'. The scheduler gets a
+    // CPU of its own whenever the machine has more than one; workers share the
+    // remaining CPUs if there are more workers than CPUs.
+    static vector<int> CpuLayout(int thread_count, PinPolicy pin);
+
+    // As above, on 'topology' rather than the machine's.
+    static vector<int> CpuLayout(const CpuTopology& topology, int thread_count, PinPolicy pin);
+
    private:
+    // Thread pool task that runs one of the member functions below on a txn.
+    typedef MethodTask<TxnProcessor, Txn*> TxnTask;
+
     // Serial validation
     bool SerialValidate(Txn* txn);
 
     // Parallel executtion/validation for OCC
     void ExecuteTxnParallel(Txn* txn);
 
+    // Validates a txn executed by ExecuteTxnParallel and applies its writes
+    // if it passes. Returns false if it does not.
+    //
+    // With record locks, the txn locks the records in its writeset, then
+    // checks that no record it read has a newer version or is locked by
+    // another txn. Validators therefore only ever meet txns they conflict
+    // with, on the records they share.
+    bool CommitWithRecordLocks(Txn* txn);
+
+    // With the active set, the txn checks its sets against the writesets of
+    // the txns that started validating before it and have not finished yet.
+    bool CommitWithActiveSet(Txn* txn);
+
     // Serial version of scheduler.
     void RunSerialScheduler();
 
     // Locking version of scheduler.
     void RunLockingScheduler();
 
+    // Partitioned locking version of scheduler: hands each txn to the lock
+    // partitions owning its keys.
+    void RunPartitionedLockingScheduler();
+
+    // One partition of the key space in P_LOCKING mode. Its CC thread runs
+    // RunLockPartition() and is the only thread using 'lm_'.
+    struct LockPartition
+    {
+        explicit LockPartition(TxnProcessor* processor) : processor_(processor), lm_(&ready_txns_) {}
+        TxnProcessor* processor_;
+        deque<Txn*> ready_txns_;
+        LockManagerB lm_;
+        // Txns to acquire locks for, from the scheduler thread.
+        SPSCQueue<Txn*> lock_requests_;
+        // Txns to release locks for, one queue per worker thread.
+        vector<SPSCQueue<Txn*>*> releases_;
+        pthread_t thread_;
+    };
+
+    // Main loop of a lock partition's CC thread. Acquires and releases locks on
+    // the keys owned by 'partition', starts txns once every partition they
+    // touch has granted their locks, and returns them once every partition has
+    // released them.
+    void RunLockPartition(LockPartition* partition);
+
+    // Executes and commits a txn holding all of its locks in P_LOCKING mode,
+    // then sends it to its partitions to release them.
+    void ExecuteTxnPartitioned(Txn* txn);
+
+    // VLL version of scheduler: counts lock requests on each record, runs txns
+    // whose requests do not conflict right away, and otherwise waits until
+    // they are the oldest active txn.
+    void RunVLLScheduler();
+
     // OCC version of scheduler.
     void RunOCCScheduler();
 
@@ -84,6 +246,27 @@ class TxnProcessor
     // transaction logic.
     void ExecuteTxn(Txn* txn);
 
+    // Reads every key in the txn's readset and writeset from 'storage_' into
+    // txn->reads_ (the read phase shared by ExecuteTxn and its variants).
+    void ReadTxnKeys(Txn* txn);
+
+    // Returns the calling client thread's submission queue, registering one on
+    // its first request, or NULL if all kMaxClients queues are taken (the
+    // client then submits through the shared 'txn_requests_').
+    LockFreeQueue<Txn*>* ClientQueue();
+
+    // Pops the next txn request into '*txn' and returns true, or returns false
+    // if there is none. Client queues are visited round-robin, so each client's
+    // txns are scheduled in the order it submitted them. Scheduler thread only.
+    bool NextTxnRequest(Txn** txn);
+
+    // Delivers a COMMITTED or ABORTED txn to its callback, or queues it in
+    // 'txn_results_' and wakes up a client blocked in GetTxnResult(s).
+    void ReturnResult(Txn* txn);
+
+    // Blocks until 'txn_results_' appears non-empty.
+    void WaitForResults();
+
     // Applies all writes performed by '*txn' to 'storage_'.
     //
     // Requires: txn->Status() is COMPLETED_C.
@@ -98,23 +281,96 @@ class TxnProcessor
 
     void MVCCUnlockWriteKeys(Txn* txn);
 
+    // Main loop of the MVCC garbage collector thread. Computes the watermark,
+    // unlinks the versions no txn can read any more from the next slice of
+    // keys, and frees the versions unlinked before every reader that might
+    // have seen them had finished.
     void GarbageCollection();
 
+    // Snapshot isolation version of scheduler: hands every txn to a worker
+    // running SnapshotExecuteTxn.
+    void RunSnapshotScheduler();
+
+    // Runs a txn against the latest committed snapshot. Read-only txns commit
+    // right away; update txns commit if no other txn committed a write to
+    // their writeset since their snapshot (first committer wins), and are
+    // restarted otherwise.
+    void SnapshotExecuteTxn(Txn* txn);
+
+    // Silo version of scheduler: hands every txn to a worker running
+    // SiloExecuteTxn.
+    void RunSiloScheduler();
+
+    // Runs a txn, remembering the TID of every record it reads, then commits
+    // it on the worker: locks the writeset, takes the current epoch, checks
+    // that no record read has changed or is locked by another txn, and
+    // installs the writes under a new TID. Restarts the txn if the check
+    // fails.
+    void SiloExecuteTxn(Txn* txn);
+
+    // TicToc version of scheduler: hands every txn to a worker running
+    // TicTocExecuteTxn.
+    void RunTicTocScheduler();
+
+    // Runs a txn, remembering the timestamps of every record it reads, then
+    // commits it on the worker: locks the writeset, picks the smallest commit
+    // timestamp at which all its reads are still valid and its writes come
+    // after every read of the records they replace, extends the rts of the
+    // records read where needed, and installs the writes at that timestamp.
+    // Restarts the txn if some read cannot be extended.
+    void TicTocExecuteTxn(Txn* txn);
+
+    // Non-deterministic locking version of scheduler: hands every txn to a
+    // worker running OnlineLockingExecuteTxn.
+    void RunOnlineLockingScheduler();
+
+    // Runs a txn under strict two-phase locking, locking each key right before
+    // reading it and releasing all locks once its writes are applied. If the
+    // deadlock policy aborts it, releases its locks and runs it again.
+    void OnlineLockingExecuteTxn(Txn* txn);
+
+    // Main loop of the thread advancing 'silo_epoch_' every SILO_EPOCH_US.
+    void RunEpochAdvancer();
+
+    // Returns the smallest timestamp that a running or future MVCC or
+    // SNAPSHOT txn can read at.
+    uint64 MVCCWatermark();
+
+    // Frees the versions in 'gc_limbo_' that were unlinked in epochs before
+    // 'safe_epoch'.
+    void FreeGarbage(uint64 safe_epoch);
+
     // Concurrency control mechanism the TxnProcessor is currently using.
     CCMode mode_;
 
     // Thread pool managing all threads used by TxnProcessor.
-    StaticThreadPool tp_;
+    ThreadPool* tp_;
 
     // Data storage used for all modes.
     Storage* storage_;
 
-    // Next valid unique_id, and a mutex to guard incoming txn requests.
-    int next_unique_id_;
-    Mutex mutex_;
+    // Next valid unique_id.
+    std::atomic<uint64> next_unique_id_;
+
+    // Distinguishes this TxnProcessor from every other one created by the
+    // process, so client threads never reuse a queue cached for a destroyed
+    // TxnProcessor that happened to live at the same address.
+    uint64 generation_;
+
+    // Per-client queues of incoming transaction requests. The first
+    // 'client_count_' entries (at most kMaxClients) have been claimed; an entry
+    // may still be NULL while its client is setting it up.
+    static const int kMaxClients          = 64;
+    static const int kClientQueueCapacity = 4096;
+    std::atomic<int> client_count_;
+    std::atomic<LockFreeQueue<Txn*>*> client_queues_[kMaxClients];
+
+    // Client queue NextTxnRequest() looks at first.
+    int next_client_;
 
-    // Queue of incoming transaction requests.
-    AtomicQueue<Txn*> txn_requests_;
+    // Queue of incoming transaction requests from clients beyond the first
+    // kMaxClients.
+    LockFreeQueue<Txn*> txn_requests_;
 
     // Queue of txns that have acquired all locks and are ready to be executed.
     //
@@ -123,22 +379,103 @@ class TxnProcessor
     deque<Txn*> ready_txns_;
 
     // Queue of completed (but not yet committed/aborted) transactions.
-    AtomicQueue<Txn*> completed_txns_;
+    LockFreeQueue<Txn*> completed_txns_;
 
     // Queue of transaction results (already committed or aborted) to be returned
     // to client.
-    AtomicQueue<Txn*> txn_results_;
+    LockFreeQueue<Txn*> txn_results_;
+
+    // Number of clients in WaitForResults() that may be sleeping on
+    // 'results_ready_' until 'txn_results_' becomes non-empty.
+    std::atomic<int> result_waiters_;
+    Futex results_ready_;
 
     // Set of transactions that are currently in the process of parallel
-    // validation.
-    AtomicSet<Txn*> active_set_;
+    // validation, keyed by the order in which they started validating.
+    AtomicSet<std::pair<uint64, Txn*> > active_set_;
 
-    // Used it for critical section in parallel occ.
+    // Used it for critical section in parallel occ: protects
+    // 'next_validation_seq_', so that txns join 'active_set_' in order.
     Mutex active_set_mutex_;
+    uint64 next_validation_seq_;
+
+    // Epochs in which MVCC workers read version lists, so that unlinked
+    // versions are only freed once no worker can still be reading them.
+    EpochManager mvcc_epochs_;
+
+    // Lower bound on the timestamp (or snapshot) of the txn each MVCC or
+    // SNAPSHOT worker is running, or ~0 if it is idle.
+    struct ActiveId
+    {
+        std::atomic<uint64> id_;
+        char pad_[CACHE_LINE_SIZE - sizeof(std::atomic<uint64>)];
+    };
+    ActiveId mvcc_active_ids_[EpochManager::kMaxThreads];
+
+    // Lists of unlinked versions, with the epoch they were unlinked in, oldest
+    // first. Garbage collector thread only.
+    deque<std::pair<uint64, vector<Version*> > > gc_limbo_;
+
+    // Commit timestamp of the next update txn in SNAPSHOT mode, and that of
+    // the latest one whose writes, and those of all its predecessors, are
+    // installed. New snapshots are taken at the latter.
+    std::atomic<uint64> next_commit_ts_;
+    std::atomic<uint64> snapshot_ts_;
+
+    // Lower bound on the commit timestamp each SNAPSHOT worker is installing
+    // writes at, or ~0 if it is installing none.
+    ActiveId snapshot_installing_[EpochManager::kMaxThreads];
+
+    // Advances snapshot_ts_ to just below the oldest commit still being
+    // installed. Called by every committer once it is done installing, so no
+    // committer ever waits for another.
+    void PublishSnapshot();
+
+    GCStats gc_stats_;
+    Mutex gc_stats_mutex_;
+    pthread_t gc_thread_;
+
+    // Global epoch in SILO mode, the thread advancing it, and the TID of the
+    // last txn each worker committed.
+    std::atomic<uint64> silo_epoch_;
+    pthread_t epoch_thread_;
+    struct WorkerTid
+    {
+        uint64 tid_;
+        char pad_[CACHE_LINE_SIZE - sizeof(uint64)];
+    };
+    WorkerTid silo_tids_[EpochManager::kMaxThreads];
+
+    // Restarts counted by each worker thread, by the id it has from
+    // worker_count_, and by the OCC scheduler thread, which has no such id.
+    struct WorkerRestarts
+    {
+        std::atomic<uint64> restarts_;
+        char pad_[CACHE_LINE_SIZE - sizeof(std::atomic<uint64>)];
+    };
+    WorkerRestarts restarts_[EpochManager::kMaxThreads];
+    WorkerRestarts scheduler_restarts_;
+
+    // Counts a restart of a txn by the calling worker thread.
+    void CountRestart();
+
+    // Stops the garbage collector and epoch threads.
+    std::atomic<bool> background_stopped_;
 
     // Lock Manager used for LOCKING concurrency implementations.
     LockManager* lm_;
 
+    // Lock manager shared by the workers in LOCKING_NO_WAIT, LOCKING_WAIT_DIE
+    // and LOCKING_WOUND_WAIT modes.
+    OnlineLockManager* online_lm_;
+
+    // Lock partitions used in P_LOCKING mode, the number of worker threads
+    // that have been assigned a release queue so far, and the flag stopping
+    // the partitions' CC threads.
+    vector<LockPartition*> partitions_;
+    std::atomic<int> worker_count_;
+    std::atomic<bool> partitions_stopped_;
+
     // Used for stopping the continuous loop that runs in the scheduler thread
     bool stopped_;
 
@@ -1,11 +1,30 @@
 
 #include "txn/txn_processor.h"
 
+#include <stdlib.h>
+#include <atomic>
+#include <new>
 #include <vector>
 
 #include "txn/txn_types.h"
 #include "utils/testing.h"
 
+// Number of heap allocations made by threads other than the benchmark's client
+// thread, i.e. by the TxnProcessor's scheduler and worker threads. Allocations
+// made while generating and freeing txns on the client thread are not counted.
+static std::atomic<uint64_t> processor_allocs(0);
+static thread_local bool client_thread = false;
+
+void* operator new(size_t size)
+{
+    if (!client_thread) processor_allocs.fetch_add(1, std::memory_order_relaxed);
+    void* ptr = malloc(size == 0 ? 1 : size);
+    if (ptr == NULL) throw std::bad_alloc();
+    return ptr;
+}
+
+void operator delete(void* ptr) noexcept { free(ptr); }
+
 // Returns a human-readable string naming of the providing mode.
 string ModeToString(CCMode mode)
 {
@@ -16,13 +35,31 @@ string ModeToString(CCMode mode)
         case LOCKING_EXCLUSIVE_ONLY:
             return " Locking A";
         case LOCKING:
-            return " Locking B";
+            return DENSE_LOCK_MANAGER ? " Locking D" : " Locking B";
         case OCC:
             return " OCC      ";
         case P_OCC:
             return " OCC-P    ";
         case MVCC:
             return " MVCC     ";
+        case P_LOCKING:
+            return " Locking P";
+        case VLL:
+            return " VLL      ";
+        case SNAPSHOT:
+            return " Snapshot ";
+        case SILO:
+            return " Silo     ";
+        case TICTOC:
+            return " TicToc   ";
+        case LOCKING_NO_WAIT:
+            return " NoWait   ";
+        case LOCKING_WAIT_DIE:
+            return " WaitDie  ";
+        case LOCKING_WOUND_WAIT:
+            return " WoundWait";
+        case SNAPSHOT_VALIDATED:
+            return " SnapValid";
         default:
             return "INVALID MODE";
     }
@@ -77,6 +114,11 @@ class RMWLoadGen2 : public LoadGen
     double wait_time_;
 };
 
+// Worker thread count and CPU placement used for every TxnProcessor the
+// benchmark creates. Set from the command line in main().
+int thread_count     = THREAD_COUNT;
+PinPolicy pin_policy = PIN_POLICY;
+
 void Benchmark(const vector<LoadGen*>& lg)
 {
     // Number of transaction requests that can be active at any given time.
@@ -84,11 +126,17 @@ void Benchmark(const vector<LoadGen*>& lg)
     deque<Txn*> doneTxns;
 
     // For each MODE...
-    for (CCMode mode = SERIAL; mode <= MVCC; mode = static_cast<CCMode>(mode + 1))
+    for (CCMode mode = SERIAL; mode <= SNAPSHOT_VALIDATED; mode = static_cast<CCMode>(mode + 1))
     {
         // Print out mode name.
         cout << ModeToString(mode) << flush;
 
+        uint64_t mode_allocs = 0;
+        uint64_t mode_txns   = 0;
+        GCStats gc;
+        LockingStats locking;
+        uint64 restarts = 0;
+
         // For each experiment, run 3 times and get the average.
         for (uint32 exp = 0; exp < lg.size(); exp++)
         {
@@ -98,36 +146,64 @@ void Benchmark(const vector<LoadGen*>& lg)
                 int txn_count = 0;
 
                 // Create TxnProcessor in next mode.
-                TxnProcessor* p = new TxnProcessor(mode);
+                TxnProcessor* p = new TxnProcessor(mode, thread_count, pin_policy);
 
                 // Record start time.
-                double start = GetTime();
+                double start         = GetTime();
+                uint64_t start_alloc = processor_allocs.load();
 
                 // Start specified number of txns running.
-                for (int i = 0; i < active_txns; i++) p->NewTxnRequest(lg[exp]->NewTxn());
+                vector<Txn*> batch;
+                for (int i = 0; i < active_txns; i++) batch.push_back(lg[exp]->NewTxn());
+                p->NewTxnRequests(batch.data(), batch.size());
 
                 // Keep 100 active txns at all times for the first full second.
+                // Results are collected in batches, and every finished txn is
+                // replaced by a new one.
+                vector<Txn*> results;
                 while (GetTime() < start + 0.5)
                 {
-                    Txn* txn = p->GetTxnResult();
-                    doneTxns.push_back(txn);
-                    txn_count++;
-                    p->NewTxnRequest(lg[exp]->NewTxn());
+                    results.clear();
+                    int n = p->GetTxnResults(&results, active_txns);
+                    doneTxns.insert(doneTxns.end(), results.begin(), results.end());
+                    txn_count += n;
+                    batch.clear();
+                    for (int i = 0; i < n; i++) batch.push_back(lg[exp]->NewTxn());
+                    p->NewTxnRequests(batch.data(), n);
                 }
 
                 // Wait for all of them to finish.
-                for (int i = 0; i < active_txns; i++)
+                for (int remaining = active_txns; remaining > 0;)
                 {
-                    Txn* txn = p->GetTxnResult();
-                    doneTxns.push_back(txn);
-                    txn_count++;
+                    results.clear();
+                    int n = p->GetTxnResults(&results, remaining);
+                    doneTxns.insert(doneTxns.end(), results.begin(), results.end());
+                    txn_count += n;
+                    remaining -= n;
                 }
 
                 // Record end time.
                 double end = GetTime();
+                mode_allocs += processor_allocs.load() - start_alloc;
+                mode_txns += txn_count;
 
                 throughput[round] = txn_count / (end - start);
 
+                if (mode == MVCC || mode == SNAPSHOT || mode == SNAPSHOT_VALIDATED)
+                {
+                    GCStats stats = p->GarbageCollectionStats();
+                    gc.passes_ += stats.passes_;
+                    gc.reclaimed_versions_ += stats.reclaimed_versions_;
+                    gc.reclaimed_bytes_ += stats.reclaimed_bytes_;
+                    if (stats.passes_ > 0) gc.last_pass_ = stats.last_pass_;
+                }
+
+                LockingStats stats = p->OnlineLockingStats();
+                locking.attempts_ += stats.attempts_;
+                locking.aborts_ += stats.aborts_;
+                locking.waits_ += stats.waits_;
+                restarts += p->Restarts();
+
                 for (auto it = doneTxns.begin(); it != doneTxns.end(); ++it)
                 {
                     delete *it;
@@ -141,16 +217,62 @@ void Benchmark(const vector<LoadGen*>& lg)
             cout << "\t" << (throughput[0] + throughput[1]) / 2 << "\t" << flush;
         }
 
-        cout << endl;
+        // Print heap allocations per txn made by the TxnProcessor itself.
+        cout << "\t" << static_cast<double>(mode_allocs) / mode_txns << endl;
+
+        // Print what the MVCC garbage collector did, and the version lists it
+        // left behind in the last run.
+        if (mode == MVCC || mode == SNAPSHOT || mode == SNAPSHOT_VALIDATED)
+        {
+            cout << "          GC: " << gc.passes_ << " passes, " << gc.reclaimed_versions_ << " versions ("
+                 << gc.reclaimed_bytes_ / 1024 << " KB) reclaimed, " << gc.last_pass_.versions_
+                 << " versions left, keys by list length 1/2/4/.../more:";
+            for (int i = 0; i < VersionStats::kChainBuckets; i++)
+            {
+                cout << (i ? "/" : " ") << gc.last_pass_.chain_lengths_[i];
+            }
+            cout << endl;
+        }
+
+        // Print how often the deadlock policy aborted (and so retried) txns,
+        // and how often lock requests waited.
+        if (locking.attempts_ > 0)
+        {
+            uint64 committed = locking.attempts_ - locking.aborts_;
+            cout << "          2PL: " << 100.0 * locking.aborts_ / locking.attempts_ << "% of attempts aborted, "
+                 << static_cast<double>(locking.aborts_) / committed << " retries/txn, "
+                 << static_cast<double>(locking.waits_) / locking.attempts_ << " waits/attempt" << endl;
+        }
+
+        // Print how often optimistic txns failed validation and were retried.
+        if (mode == OCC || mode == P_OCC || mode == MVCC || mode == SNAPSHOT || mode == SILO || mode == TICTOC ||
+            mode == SNAPSHOT_VALIDATED)
+        {
+            cout << "          Restarts: " << restarts << ", " << static_cast<double>(restarts) / mode_txns
+                 << " retries/txn" << endl;
+        }
     }
 }
 
+// Usage: txn_processor_test [threads] [none|compact|scatter|smt]
 int main(int argc, char** argv)
 {
+    client_thread = true;
+    if (argc > 1) thread_count = atoi(argv[1]);
+    if (argc > 2) pin_policy = StringToPinPolicy(argv[2], PIN_POLICY);
+    if (thread_count < 1) thread_count = THREAD_COUNT;
+
+    vector<int> cpus = TxnProcessor::CpuLayout(thread_count, pin_policy);
+    cout << "Topology: " << CpuTopology::Get().Describe() << endl;
+    cout << "Threads:  " << thread_count << " workers, pinning " << PinPolicyToString(pin_policy) << endl;
+    cout << "Mapping:  scheduler -> " << DescribeLayout(vector<int>(cpus.begin(), cpus.begin() + 1))
+         << ", workers -> " << DescribeLayout(vector<int>(cpus.begin() + 1, cpus.end())) << endl;
+    cout << endl;
+
     cout << "\t\t--------------------------------------" << endl;
     cout << "\t\t    Average Transaction Duration" << endl;
     cout << "\t\t--------------------------------------" << endl;
-    cout << "\t\t0.1ms\t\t1ms\t\t10ms" << endl;
+    cout << "\t\t0.1ms\t\t1ms\t\t10ms\t\tallocs/txn" << endl;
     cout << "\t\t--------------------------------------" << endl;
 
     vector<LoadGen*> lg;
@@ -0,0 +1,59 @@
+
+#include "txn/txn_types.h"
+
+RMW::RMW(int dbsize, int readsetsize, int writesetsize, double time) : time_(time)
+{
+    // Make sure we can find enough unique keys.
+    DCHECK(dbsize >= readsetsize + writesetsize);
+
+    // Find readsetsize unique read keys.
+    for (int i = 0; i < readsetsize; i++)
+    {
+        Key key;
+        do
+        {
+            key = rand() % dbsize;
+        } while (readset_.count(key));
+        readset_.insert(key);
+    }
+
+    // Find writesetsize unique write keys.
+    for (int i = 0; i < writesetsize; i++)
+    {
+        Key key;
+        do
+        {
+            key = rand() % dbsize;
+        } while (readset_.count(key) || writeset_.count(key));
+        writeset_.insert(key);
+    }
+}
+
+void RMW::Run()
+{
+    Value result;
+    // Read everything in readset.
+    for (KeySet::iterator it = readset_.begin(); it != readset_.end(); ++it) Read(*it, &result);
+
+    // Increment length of everything in writeset.
+    for (KeySet::iterator it = writeset_.begin(); it != writeset_.end(); ++it)
+    {
+        result = 0;
+        Read(*it, &result);
+        Write(*it, result + 1);
+    }
+
+    // Run while loop to simulate the txn logic(duration is time_).
+    double begin = CycleClock::Now();
+    while (CycleClock::Now() - begin < time_)
+    {
+        for (int i = 0; i < 1000; i++)
+        {
+            int x = 100;
+            x     = x + 2;
+            x     = x * x;
+        }
+    }
+
+    COMMIT;
+}
@@ -7,6 +7,7 @@
 #include <string>
 
 #include "txn/txn.h"
+#include "utils/clock.h"
 
 // Immediately commits.
 class Noop : public Txn
@@ -95,33 +96,7 @@ class RMW : public Txn
     }
 
     // Constructor with randomized read/write sets
-    RMW(int dbsize, int readsetsize, int writesetsize, double time = 0) : time_(time)
-    {
-        // Make sure we can find enough unique keys.
-        DCHECK(dbsize >= readsetsize + writesetsize);
-
-        // Find readsetsize unique read keys.
-        for (int i = 0; i < readsetsize; i++)
-        {
-            Key key;
-            do
-            {
-                key = rand() % dbsize;
-            } while (readset_.count(key));
-            readset_.insert(key);
-        }
-
-        // Find writesetsize unique write keys.
-        for (int i = 0; i < writesetsize; i++)
-        {
-            Key key;
-            do
-            {
-                key = rand() % dbsize;
-            } while (readset_.count(key) || writeset_.count(key));
-            writeset_.insert(key);
-        }
-    }
+    RMW(int dbsize, int readsetsize, int writesetsize, double time = 0);
 
     RMW* clone() const
     {  // Virtual constructor (copying)
@@ -130,34 +105,7 @@ class RMW : public Txn
         return clone;
     }
 
-    virtual void Run()
-    {
-        Value result;
-        // Read everything in readset.
-        for (set<Key>::iterator it = readset_.begin(); it != readset_.end(); ++it) Read(*it, &result);
-
-        // Increment length of everything in writeset.
-        for (set<Key>::iterator it = writeset_.begin(); it != writeset_.end(); ++it)
-        {
-            result = 0;
-            Read(*it, &result);
-            Write(*it, result + 1);
-        }
-
-        // Run while loop to simulate the txn logic(duration is time_).
-        double begin = GetTime();
-        while (GetTime() - begin < time_)
-        {
-            for (int i = 0; i < 1000; i++)
-            {
-                int x = 100;
-                x     = x + 2;
-                x     = x * x;
-            }
-        }
-
-        COMMIT;
-    }
+    virtual void Run();
 
    private:
     double time_;
@@ -1,6 +1,10 @@
 
 #include "txn/txn.h"
 
+#include <stdio.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <atomic>
 #include <string>
 
 #include "txn/txn_processor.h"
@@ -72,9 +76,171 @@ TEST(PutMultipleTest)
     END;
 }
 
+// Completion callback that records the txn and how many have completed.
+void CountCompletion(Txn* txn, void* arg)
+{
+    std::atomic<int>* completed = reinterpret_cast<std::atomic<int>*>(arg);
+    EXPECT_EQ(COMMITTED, txn->Status());
+    delete txn;
+    completed->fetch_add(1);
+}
+
+TEST(ResultDeliveryTest)
+{
+    TxnProcessor p(SERIAL);
+
+    // Batched results.
+    for (int i = 0; i < 100; i++) p.NewTxnRequest(new Noop());
+    vector<Txn*> results;
+    while (results.size() < 100) p.GetTxnResults(&results, 100 - results.size());
+    EXPECT_EQ(100, static_cast<int>(results.size()));
+    for (size_t i = 0; i < results.size(); i++)
+    {
+        EXPECT_EQ(COMMITTED, results[i]->Status());
+        delete results[i];
+    }
+
+    // Callbacks, interleaved with txns returned through GetTxnResult.
+    std::atomic<int> completed(0);
+    for (int i = 0; i < 100; i++) p.NewTxnRequest(new Noop(), CountCompletion, &completed);
+    p.NewTxnRequest(new Noop());
+    delete p.GetTxnResult();
+    while (completed.load() < 100) usleep(100);
+    EXPECT_EQ(100, completed.load());
+
+    END;
+}
+
+// Submits 1000 Noops to the TxnProcessor passed as 'arg', alternating between
+// single and batched requests.
+void* SubmitNoops(void* arg)
+{
+    TxnProcessor* p = reinterpret_cast<TxnProcessor*>(arg);
+    for (int i = 0; i < 100; i++)
+    {
+        Txn* batch[9];
+        for (int j = 0; j < 9; j++) batch[j] = new Noop();
+        p->NewTxnRequests(batch, 9);
+        p->NewTxnRequest(new Noop());
+    }
+    return NULL;
+}
+
+TEST(MultiClientSubmissionTest)
+{
+    TxnProcessor p(SERIAL);
+
+    pthread_t clients[4];
+    for (int i = 0; i < 4; i++) pthread_create(&clients[i], NULL, SubmitNoops, &p);
+    for (int i = 0; i < 4; i++) pthread_join(clients[i], NULL);
+
+    // Every txn comes back exactly once, with a distinct id.
+    set<uint64> ids;
+    for (int i = 0; i < 4000; i++)
+    {
+        Txn* t = p.GetTxnResult();
+        EXPECT_EQ(COMMITTED, t->Status());
+        ids.insert(t->UniqueId());
+        delete t;
+    }
+    EXPECT_EQ(4000, static_cast<int>(ids.size()));
+
+    END;
+}
+
+TEST(RMWAllModesTest)
+{
+    // Each RMW adds 1 to every key it writes, so whatever order a mode runs
+    // them in, a serializable one leaves each key at the number of txns that
+    // wrote it.
+    for (CCMode mode = SERIAL; mode <= SNAPSHOT_VALIDATED; mode = static_cast<CCMode>(mode + 1))
+    {
+        TxnProcessor p(mode);
+        map<Key, Value> expected;
+        for (Key key = 0; key < 20; key++) expected[key] = 0;
+
+        srand(mode);
+        for (int i = 0; i < 1000; i++)
+        {
+            set<Key> readset, writeset;
+            while (writeset.size() < 4) writeset.insert(rand() % 20);
+            while (readset.size() < 2)
+            {
+                Key key = rand() % 20;
+                if (!writeset.count(key)) readset.insert(key);
+            }
+            for (set<Key>::iterator it = writeset.begin(); it != writeset.end(); ++it) expected[*it]++;
+            p.NewTxnRequest(new RMW(readset, writeset));
+        }
+
+        int committed = 0;
+        for (int i = 0; i < 1000; i++)
+        {
+            Txn* t = p.GetTxnResult();
+            if (t->Status() == COMMITTED) committed++;
+            delete t;
+        }
+        EXPECT_EQ(1000, committed);
+
+        p.NewTxnRequest(new Expect(expected));
+        Txn* t = p.GetTxnResult();
+        EXPECT_EQ(COMMITTED, t->Status());
+        delete t;
+    }
+
+    END;
+}
+
+// Creates a sysfs-style CPU directory under /tmp for one socket of 'cores'
+// cores with two hardware threads each, CPU i and i + 'cores' sharing a core.
+static string FakeSysfs(int cores)
+{
+    char dir[]  = "/tmp/cpu_layout_testXXXXXX";
+    string root = string(mkdtemp(dir)) + "/";
+    FILE* f     = fopen((root + "online").c_str(), "w");
+    fprintf(f, "0-%d\n", 2 * cores - 1);
+    fclose(f);
+    for (int cpu = 0; cpu < 2 * cores; cpu++)
+    {
+        string path = root + "cpu" + std::to_string(cpu);
+        mkdir(path.c_str(), 0700);
+        mkdir((path + "/topology").c_str(), 0700);
+        f = fopen((path + "/topology/thread_siblings_list").c_str(), "w");
+        fprintf(f, "%d,%d\n", cpu % cores, cpu % cores + cores);
+        fclose(f);
+    }
+    return root;
+}
+
+TEST(CpuLayoutTest)
+{
+    // The scheduler gets the first CPU in policy order, and the workers the
+    // ones after it, starting over once they run out.
+    CpuTopology topology(FakeSysfs(4), false);
+    EXPECT_EQ("0,1,2,3", DescribeLayout(TxnProcessor::CpuLayout(topology, 3, PIN_COMPACT)));
+    EXPECT_EQ("0,4,1,5", DescribeLayout(TxnProcessor::CpuLayout(topology, 3, PIN_SMT)));
+    EXPECT_EQ("0,1,2,3,4,5,6,7,1,2", DescribeLayout(TxnProcessor::CpuLayout(topology, 9, PIN_COMPACT)));
+    EXPECT_EQ("any,any,any", DescribeLayout(TxnProcessor::CpuLayout(topology, 2, PIN_NONE)));
+
+    // On a single CPU, everything shares it.
+    char dir[]  = "/tmp/cpu_layout_testXXXXXX";
+    string root = string(mkdtemp(dir)) + "/";
+    FILE* f     = fopen((root + "online").c_str(), "w");
+    fprintf(f, "0\n");
+    fclose(f);
+    CpuTopology single(root, false);
+    EXPECT_EQ("0,0,0", DescribeLayout(TxnProcessor::CpuLayout(single, 2, PIN_COMPACT)));
+
+    END;
+}
+
 int main(int argc, char** argv)
 {
     NoopTest();
     PutTest();
     PutMultipleTest();
+    ResultDeliveryTest();
+    MultiClientSubmissionTest();
+    RMWAllModesTest();
+    CpuLayoutTest();
 }
@@ -0,0 +1,69 @@
+
+#include "txn/vll_storage.h"
+
+#include <string.h>
+
+VLLStorage::VLLStorage(Key key_count) : key_count_(key_count)
+{
+    void* mem;
+    if (posix_memalign(&mem, CACHE_LINE_SIZE, key_count_ * sizeof(Record)) != 0) DIE("out of memory");
+    memset(mem, 0, key_count_ * sizeof(Record));
+    records_ = reinterpret_cast<Record*>(mem);
+}
+
+VLLStorage::~VLLStorage() { free(records_); }
+bool VLLStorage::Read(Key key, Value* result, uint64 txn_unique_id)
+{
+    if (key >= key_count_) return Storage::Read(key, result, txn_unique_id);
+    *result = records_[key].value_;
+    return true;
+}
+
+void VLLStorage::Write(Key key, Value value, uint64 txn_unique_id)
+{
+    if (key >= key_count_)
+    {
+        Storage::Write(key, value, txn_unique_id);
+        return;
+    }
+    records_[key].value_ = value;
+}
+
+VLLStorage::Record* VLLStorage::Counters(Key key)
+{
+    if (key < key_count_) return &records_[key];
+    return &others_[key];
+}
+
+void VLLStorage::Prune(Key key, Record* record)
+{
+    if (key >= key_count_ && record->exclusive_ == 0 && record->shared_ == 0) others_.erase(key);
+}
+
+bool VLLStorage::RequestExclusive(Key key)
+{
+    Record* record = Counters(key);
+    record->exclusive_++;
+    return record->exclusive_ == 1 && record->shared_ == 0;
+}
+
+bool VLLStorage::RequestShared(Key key)
+{
+    Record* record = Counters(key);
+    record->shared_++;
+    return record->exclusive_ == 0;
+}
+
+void VLLStorage::ReleaseExclusive(Key key)
+{
+    Record* record = Counters(key);
+    record->exclusive_--;
+    Prune(key, record);
+}
+
+void VLLStorage::ReleaseShared(Key key)
+{
+    Record* record = Counters(key);
+    record->shared_--;
+    Prune(key, record);
+}
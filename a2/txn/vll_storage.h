@@ -0,0 +1,71 @@
+
+#ifndef _VLL_STORAGE_H_
+#define _VLL_STORAGE_H_
+
+#include <unordered_map>
+
+#include "txn/storage.h"
+
+using std::unordered_map;
+
+// Storage for Very Lightweight Locking (VLL, Ren, Thomson and Abadi, VLDB
+// 2012). Instead of a separate lock table, each record carries the number of
+// active txns that requested an EXCLUSIVE or a SHARED lock on it, next to its
+// value. Records with keys in [0, key_count) live in a flat array indexed by
+// key; other keys keep their values in the base Storage and their counters in
+// a hash map.
+//
+// Values are read by the worker threads. The counters, and everything else
+// except Read(), belong to the scheduler thread.
+class VLLStorage : public Storage
+{
+   public:
+    explicit VLLStorage(Key key_count = STORAGE_KEYS);
+    virtual ~VLLStorage();
+
+    virtual bool Read(Key key, Value* result, uint64 txn_unique_id = 0);
+    virtual void Write(Key key, Value value, uint64 txn_unique_id = 0);
+
+    // Records are updated in place, without versions.
+    virtual uint64 Timestamp(Key key) { return 0; }
+    // Registers a txn's request for an EXCLUSIVE lock on 'key'. Returns true
+    // if no other active txn has requested any lock on it.
+    bool RequestExclusive(Key key);
+
+    // Registers a txn's request for a SHARED lock on 'key'. Returns true if no
+    // active txn has requested an EXCLUSIVE lock on it.
+    bool RequestShared(Key key);
+
+    // Withdraw a request registered by one of the calls above, once its txn
+    // has finished.
+    void ReleaseExclusive(Key key);
+    void ReleaseShared(Key key);
+
+   private:
+    // A record with its lock counters.
+    struct Record
+    {
+        Value value_;
+        uint32 exclusive_;  // Active txns that requested an EXCLUSIVE lock.
+        uint32 shared_;     // Active txns that requested a SHARED lock.
+    };
+
+    // Returns the record holding the counters for 'key'.
+    Record* Counters(Key key);
+
+    // Drops the counters of a key outside the array once they are both zero.
+    void Prune(Key key, Record* record);
+
+    // Disallow copying.
+    VLLStorage(const VLLStorage&);
+    VLLStorage& operator=(const VLLStorage&);
+
+    Key key_count_;
+    Record* records_;
+
+    // Counters of keys outside the array that some active txn requested a lock
+    // on. Their value_ fields are unused.
+    unordered_map<Key, Record> others_;
+};
+
+#endif  // _VLL_STORAGE_H_
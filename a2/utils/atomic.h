@@ -2,11 +2,19 @@
 #ifndef _DB_UTILS_ATOMIC_H_
 #define _DB_UTILS_ATOMIC_H_
 
+#include <atomic>
+#include <new>
 #include <queue>
 #include <set>
+#include <type_traits>
 #include <unordered_map>
+#include <utility>
 
 #include <assert.h>
+#include <sched.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
 #include "utils/mutex.h"
 
 using std::queue;
@@ -16,9 +24,10 @@ using std::unordered_map;
 /// @class AtomicMap<K, V>
 ///
 /// Atomically readable, atomically mutable unordered associative container.
-/// Implemented as a std::unordered_map guarded by a pthread rwlock.
+/// Implemented as a std::unordered_map guarded by a rwlock (by default a
+/// pthread rwlock; any type with MutexRW's interface works).
 /// Supports CRUD operations only. Iterators are NOT supported.
-template <typename K, typename V>
+template <typename K, typename V, typename RWLock = MutexRW>
 class AtomicMap
 {
    public:
@@ -80,15 +89,17 @@ class AtomicMap
 
    private:
     unordered_map<K, V> map_;
-    MutexRW mutex_;
+    RWLock mutex_;
 };
 
 /// @class AtomicSet<K>
 ///
 /// Atomically readable, atomically mutable container.
-/// Implemented as a std::set guarded by a pthread rwlock.
-/// Supports CRUD operations only. Iterators are NOT supported.
-template <typename V>
+/// Implemented as a std::set guarded by a rwlock (by default a pthread rwlock;
+/// any type with MutexRW's interface works).
+/// Supports CRUD operations, and in-order iteration through ForEach.
+/// Iterators are NOT supported.
+template <typename V, typename RWLock = MutexRW>
 class AtomicSet
 {
    public:
@@ -135,6 +146,20 @@ class AtomicSet
         return first;
     }
 
+    // Calls 'f(value)' on the elements in order until it returns false,
+    // without copying the set. The read lock is held throughout, so 'f' must
+    // be short and must not modify the set.
+    template <typename F>
+    void ForEach(F f)
+    {
+        mutex_.ReadLock();
+        for (typename set<V>::const_iterator it = set_.begin(); it != set_.end(); ++it)
+        {
+            if (!f(*it)) break;
+        }
+        mutex_.Unlock();
+    }
+
     // Returns a copy of the underlying set.
     set<V> GetSet()
     {
@@ -146,15 +171,15 @@ class AtomicSet
 
    private:
     set<V> set_;
-    MutexRW mutex_;
+    RWLock mutex_;
 };
 
 /// @class AtomicQueue<T>
 ///
-/// Queue with atomic push and pop operations.
-///
-/// @TODO(alex): This should use lower-contention synchronization.
-template <typename T>
+/// Queue with atomic push and pop operations, guarded by a mutex of type
+/// 'Lock' (Mutex, or one of the spinlocks in utils/mutex.h). See
+/// LockFreeQueue below for a lower-contention alternative.
+template <typename T, typename Lock = Mutex>
 class AtomicQueue
 {
    public:
@@ -196,6 +221,30 @@ class AtomicQueue
         }
     }
 
+    // Atomically pushes the 'n' items starting at 'items' onto the queue, in
+    // order.
+    void PushBulk(const T* items, int n)
+    {
+        mutex_.Lock();
+        for (int i = 0; i < n; i++) queue_.push(items[i]);
+        mutex_.Unlock();
+    }
+
+    // Atomically pops up to 'max' front elements into 'results' and returns the
+    // number of elements popped.
+    int PopBulk(T* results, int max)
+    {
+        mutex_.Lock();
+        int n = 0;
+        while (n < max && !queue_.empty())
+        {
+            results[n++] = queue_.front();
+            queue_.pop();
+        }
+        mutex_.Unlock();
+        return n;
+    }
+
     // If mutex is immediately acquired, pushes and returns true, else immediately
     // returns false.
     bool PushNonBlocking(const T& item)
@@ -239,12 +288,357 @@ class AtomicQueue
 
    private:
     queue<T> queue_;
-    Mutex mutex_;
+    Lock mutex_;
 };
 
-// An atomically modifiable object. T is required to be a simple numeric type
-// or simple struct.
+/// @class LockFreeQueue<T>
+///
+/// Bounded multi-producer multi-consumer queue with the same interface as
+/// AtomicQueue, implemented as a ring of sequence-numbered slots (Dmitry
+/// Vyukov's bounded MPMC queue). Producers and consumers each claim a position
+/// with a single CAS on their own cache line and then only touch the claimed
+/// slot, so no operation ever blocks another one that is in progress.
+///
+/// Unlike AtomicQueue, the capacity is fixed at construction (rounded up to a
+/// power of two). 'Push' spins while the queue is full; 'PushNonBlocking'
+/// returns false instead.
 template <typename T>
+class LockFreeQueue
+{
+   public:
+    explicit LockFreeQueue(size_t capacity = 16384)
+    {
+        size_t size = 2;
+        while (size < capacity) size <<= 1;
+        mask_ = size - 1;
+
+        void* mem;
+        if (posix_memalign(&mem, CACHE_LINE_SIZE, size * sizeof(Slot)) != 0) abort();
+        slots_ = reinterpret_cast<Slot*>(mem);
+        for (size_t i = 0; i < size; i++)
+        {
+            new (&slots_[i]) Slot();
+            slots_[i].sequence_.store(i, std::memory_order_relaxed);
+        }
+
+        head_.store(0, std::memory_order_relaxed);
+        tail_.store(0, std::memory_order_relaxed);
+    }
+
+    ~LockFreeQueue()
+    {
+        for (size_t i = 0; i <= mask_; i++) slots_[i].~Slot();
+        free(slots_);
+    }
+
+    // Returns the number of elements currently in the queue. Only a snapshot if
+    // other threads are pushing or popping concurrently. Slots a producer has
+    // claimed but not yet filled count too, so Pop may find fewer elements.
+    int Size()
+    {
+        size_t tail = tail_.load(std::memory_order_acquire);
+        size_t head = head_.load(std::memory_order_acquire);
+        return head > tail ? static_cast<int>(head - tail) : 0;
+    }
+
+    // Pushes 'item' onto the queue, waiting for a free slot if it is full.
+    void Push(const T& item)
+    {
+        while (!PushNonBlocking(item)) sched_yield();
+    }
+
+    void Push(T&& item)
+    {
+        while (!PushNonBlocking(std::move(item))) sched_yield();
+    }
+
+    // If the queue is non-empty, sets '*result' equal to the front element,
+    // pops the front element from the queue, and returns true, otherwise
+    // returns false.
+    bool Pop(T* result) { return PopNonBlocking(result); }
+
+    // Pushes the 'n' items starting at 'items' onto the queue, in order (with
+    // respect to each other; other producers' items may be interleaved).
+    void PushBulk(const T* items, int n)
+    {
+        while (n > 0)
+        {
+            int pushed = TryPushBulk(items, n);
+            if (pushed == 0) sched_yield();
+            items += pushed;
+            n -= pushed;
+        }
+    }
+
+    // Pops up to 'max' front elements into 'results' and returns the number of
+    // elements popped.
+    int PopBulk(T* results, int max)
+    {
+        size_t pos = tail_.load(std::memory_order_relaxed);
+        while (true)
+        {
+            // Count how many consecutive slots starting at 'pos' are full.
+            int n = 0;
+            while (n < max)
+            {
+                Slot* slot = &slots_[(pos + n) & mask_];
+                if (slot->sequence_.load(std::memory_order_acquire) != pos + n + 1) break;
+                n++;
+            }
+
+            if (n == 0)
+            {
+                // Either the queue is empty or another consumer moved 'tail_'.
+                size_t current = tail_.load(std::memory_order_relaxed);
+                if (current == pos) return 0;
+                pos = current;
+            }
+            else if (tail_.compare_exchange_weak(pos, pos + n, std::memory_order_relaxed))
+            {
+                for (int i = 0; i < n; i++)
+                {
+                    Slot* slot = &slots_[(pos + i) & mask_];
+                    results[i] = std::move(slot->item_);
+                    slot->sequence_.store(pos + i + mask_ + 1, std::memory_order_release);
+                }
+                return n;
+            }
+        }
+    }
+
+    // If a slot is immediately available, pushes and returns true, else
+    // (the queue is full) immediately returns false.
+    bool PushNonBlocking(const T& item)
+    {
+        size_t pos;
+        Slot* slot = ClaimPushSlot(&pos);
+        if (slot == NULL) return false;
+        slot->item_ = item;
+        slot->sequence_.store(pos + 1, std::memory_order_release);
+        return true;
+    }
+
+    // As above, but moves 'item' into the queue. 'item' is left untouched if
+    // the queue is full.
+    bool PushNonBlocking(T&& item)
+    {
+        size_t pos;
+        Slot* slot = ClaimPushSlot(&pos);
+        if (slot == NULL) return false;
+        slot->item_ = std::move(item);
+        slot->sequence_.store(pos + 1, std::memory_order_release);
+        return true;
+    }
+
+    // If the queue is nonempty, pops and returns true, else returns false.
+    bool PopNonBlocking(T* result)
+    {
+        size_t pos = tail_.load(std::memory_order_relaxed);
+        while (true)
+        {
+            Slot* slot   = &slots_[pos & mask_];
+            size_t seq   = slot->sequence_.load(std::memory_order_acquire);
+            intptr_t dif = static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos + 1);
+            if (dif == 0)
+            {
+                if (tail_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                {
+                    *result = std::move(slot->item_);
+                    slot->sequence_.store(pos + mask_ + 1, std::memory_order_release);
+                    return true;
+                }
+            }
+            else if (dif < 0)
+            {
+                return false;
+            }
+            else
+            {
+                pos = tail_.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+   private:
+    // Claims as many consecutive free slots as possible (up to 'n') with a
+    // single CAS, fills them, and returns how many items were pushed.
+    int TryPushBulk(const T* items, int n)
+    {
+        size_t pos = head_.load(std::memory_order_relaxed);
+        while (true)
+        {
+            int free_slots = 0;
+            while (free_slots < n)
+            {
+                Slot* slot = &slots_[(pos + free_slots) & mask_];
+                if (slot->sequence_.load(std::memory_order_acquire) != pos + free_slots) break;
+                free_slots++;
+            }
+
+            if (free_slots == 0)
+            {
+                size_t current = head_.load(std::memory_order_relaxed);
+                if (current == pos) return 0;
+                pos = current;
+            }
+            else if (head_.compare_exchange_weak(pos, pos + free_slots, std::memory_order_relaxed))
+            {
+                for (int i = 0; i < free_slots; i++)
+                {
+                    Slot* slot  = &slots_[(pos + i) & mask_];
+                    slot->item_ = items[i];
+                    slot->sequence_.store(pos + i + 1, std::memory_order_release);
+                }
+                return free_slots;
+            }
+        }
+    }
+
+    // Each slot sits on its own cache line(s), so producers and consumers
+    // working on neighbouring slots don't false-share.
+    struct Slot
+    {
+        std::atomic<size_t> sequence_;
+        T item_;
+        char pad_[CACHE_LINE_SIZE - (sizeof(std::atomic<size_t>) + sizeof(T)) % CACHE_LINE_SIZE];
+    };
+
+    // Claims the next free slot for a push, sets '*claimed' to its position and
+    // returns it, or returns NULL if the queue is full. The caller must fill
+    // the slot and then publish it by setting its sequence to '*claimed' + 1.
+    Slot* ClaimPushSlot(size_t* claimed)
+    {
+        size_t pos = head_.load(std::memory_order_relaxed);
+        while (true)
+        {
+            Slot* slot   = &slots_[pos & mask_];
+            size_t seq   = slot->sequence_.load(std::memory_order_acquire);
+            intptr_t dif = static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos);
+            if (dif == 0)
+            {
+                if (head_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                {
+                    *claimed = pos;
+                    return slot;
+                }
+            }
+            else if (dif < 0)
+            {
+                return NULL;
+            }
+            else
+            {
+                pos = head_.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    // Disallow copying.
+    LockFreeQueue(const LockFreeQueue&);
+    LockFreeQueue& operator=(const LockFreeQueue&);
+
+    char pad0_[CACHE_LINE_SIZE];
+    Slot* slots_;
+    size_t mask_;
+    char pad1_[CACHE_LINE_SIZE - sizeof(Slot*) - sizeof(size_t)];
+
+    // Next position to push to.
+    std::atomic<size_t> head_;
+    char pad2_[CACHE_LINE_SIZE - sizeof(std::atomic<size_t>)];
+
+    // Next position to pop from.
+    std::atomic<size_t> tail_;
+    char pad3_[CACHE_LINE_SIZE - sizeof(std::atomic<size_t>)];
+};
+
+/// @class SPSCQueue<T>
+///
+/// Bounded queue for exactly one producer thread and one consumer thread. Each
+/// side owns its index and keeps a cached copy of the other side's, so a push
+/// or pop normally touches only its own cache line and the slot, with no
+/// atomic read-modify-write at all.
+template <typename T>
+class SPSCQueue
+{
+   public:
+    explicit SPSCQueue(size_t capacity = 1024) : head_(0), cached_tail_(0), tail_(0), cached_head_(0)
+    {
+        size_t size = 2;
+        while (size < capacity) size <<= 1;
+        mask_  = size - 1;
+        items_ = new T[size];
+    }
+
+    ~SPSCQueue() { delete[] items_; }
+    // Returns the number of elements currently in the queue. Only a snapshot if
+    // the other side is running concurrently.
+    int Size()
+    {
+        return static_cast<int>(head_.load(std::memory_order_acquire) - tail_.load(std::memory_order_acquire));
+    }
+
+    // Pushes 'item' onto the queue, waiting for a free slot if it is full.
+    // Producer only.
+    void Push(const T& item)
+    {
+        while (!PushNonBlocking(item)) sched_yield();
+    }
+
+    // If a slot is immediately available, pushes and returns true, else
+    // (the queue is full) immediately returns false. Producer only.
+    bool PushNonBlocking(const T& item)
+    {
+        size_t head = head_.load(std::memory_order_relaxed);
+        if (head - cached_tail_ > mask_)
+        {
+            cached_tail_ = tail_.load(std::memory_order_acquire);
+            if (head - cached_tail_ > mask_) return false;
+        }
+        items_[head & mask_] = item;
+        head_.store(head + 1, std::memory_order_release);
+        return true;
+    }
+
+    // If the queue is nonempty, pops and returns true, else returns false.
+    // Consumer only.
+    bool Pop(T* result)
+    {
+        size_t tail = tail_.load(std::memory_order_relaxed);
+        if (tail == cached_head_)
+        {
+            cached_head_ = head_.load(std::memory_order_acquire);
+            if (tail == cached_head_) return false;
+        }
+        *result = std::move(items_[tail & mask_]);
+        tail_.store(tail + 1, std::memory_order_release);
+        return true;
+    }
+
+   private:
+    // Disallow copying.
+    SPSCQueue(const SPSCQueue&);
+    SPSCQueue& operator=(const SPSCQueue&);
+
+    T* items_;
+    size_t mask_;
+    char pad0_[CACHE_LINE_SIZE - sizeof(T*) - sizeof(size_t)];
+
+    // Producer side: next position to push to, and the last 'tail_' it saw.
+    std::atomic<size_t> head_;
+    size_t cached_tail_;
+    char pad1_[CACHE_LINE_SIZE - sizeof(std::atomic<size_t>) - sizeof(size_t)];
+
+    // Consumer side: next position to pop from, and the last 'head_' it saw.
+    std::atomic<size_t> tail_;
+    size_t cached_head_;
+    char pad2_[CACHE_LINE_SIZE - sizeof(std::atomic<size_t>) - sizeof(size_t)];
+};
+
+// An atomically modifiable object. This generic version guards the value with
+// a mutex and is only used for types that are not trivially copyable; numeric
+// types, pointers and plain structs get the std::atomic-backed specializations
+// below.
+template <typename T, typename Enable = void>
 class Atomic
 {
    public:
@@ -319,8 +713,6 @@ class Atomic
     // Checks if the value is equal to 'old_value'. If so, atomically sets the
     // value to 'new_value' and returns true, otherwise sets '*old_value' equal
     // to the value at the time of the comparison and returns false.
-    //
-    // TODO(alex): Use C++ <atomic> library to improve performance?
     bool CAS(T* old_value, T new_value)
     {
         mutex_.Lock();
@@ -343,4 +735,172 @@ class Atomic
     Mutex mutex_;
 };
 
+/// @class AtomicBase<T>
+///
+/// Operations shared by all std::atomic-backed versions of Atomic<T>. Every
+/// operation takes an explicit memory order; the defaults give acquire
+/// semantics to loads, release semantics to stores, and acquire-release
+/// semantics to read-modify-write operations.
+template <typename T>
+class AtomicBase
+{
+   public:
+    AtomicBase() {}
+    AtomicBase(T init) : value_(init) {}
+    // Returns the current value.
+    T operator*() { return Load(); }
+    T Load(std::memory_order order = std::memory_order_acquire) const { return value_.load(order); }
+    // Atomically assigns the value to equal 'x'.
+    void operator=(T x) { Store(x); }
+    void Store(T x, std::memory_order order = std::memory_order_release) { value_.store(x, order); }
+    // Atomically sets the value to 'x' and returns the previous value.
+    T Exchange(T x, std::memory_order order = std::memory_order_acq_rel) { return value_.exchange(x, order); }
+    // Checks if the value is equal to 'old_value'. If so, atomically sets the
+    // value to 'new_value' and returns true, otherwise sets '*old_value' equal
+    // to the value at the time of the comparison and returns false.
+    bool CAS(T* old_value, T new_value, std::memory_order success = std::memory_order_acq_rel,
+             std::memory_order failure = std::memory_order_acquire)
+    {
+        return value_.compare_exchange_strong(*old_value, new_value, success, failure);
+    }
+
+    // Same as 'CAS', but may fail spuriously (i.e. return false even though the
+    // value was equal to '*old_value'). Cheaper on some platforms when called in
+    // a retry loop.
+    bool CASWeak(T* old_value, T new_value, std::memory_order success = std::memory_order_acq_rel,
+                 std::memory_order failure = std::memory_order_acquire)
+    {
+        return value_.compare_exchange_weak(*old_value, new_value, success, failure);
+    }
+
+   protected:
+    std::atomic<T> value_;
+};
+
+// Type by which an Atomic<T> is incremented: T itself for integers, ptrdiff_t
+// (in units of the pointee) for pointers.
+template <typename T>
+struct AtomicDelta
+{
+    typedef T type;
+};
+template <typename T>
+struct AtomicDelta<T*>
+{
+    typedef ptrdiff_t type;
+};
+
+// Atomic<T> for integral and pointer types. Increments and decrements compile to
+// single hardware read-modify-write instructions; the remaining arithmetic
+// operators use a CAS loop.
+template <typename T>
+class Atomic<T, typename std::enable_if<std::is_integral<T>::value || std::is_pointer<T>::value>::type>
+    : public AtomicBase<T>
+{
+   public:
+    typedef typename AtomicDelta<T>::type Delta;
+
+    Atomic() {}
+    Atomic(T init) : AtomicBase<T>(init) {}
+    using AtomicBase<T>::operator=;
+
+    // Atomically adds 'x' to the value and returns the previous value.
+    T FetchAdd(Delta x, std::memory_order order = std::memory_order_acq_rel) { return this->value_.fetch_add(x, order); }
+    // Atomically subtracts 'x' from the value and returns the previous value.
+    T FetchSub(Delta x, std::memory_order order = std::memory_order_acq_rel) { return this->value_.fetch_sub(x, order); }
+    // Atomically increments the value.
+    void operator++() { FetchAdd(1); }
+    // Atomically increments the value by 'x'.
+    void operator+=(Delta x) { FetchAdd(x); }
+    // Atomically decrements the value.
+    void operator--() { FetchSub(1); }
+    // Atomically decrements the value by 'x'.
+    void operator-=(Delta x) { FetchSub(x); }
+    // Atomically multiplies the value by 'x'.
+    void operator*=(T x)
+    {
+        T old = this->Load(std::memory_order_relaxed);
+        while (!this->CASWeak(&old, old * x))
+        {
+        }
+    }
+
+    // Atomically divides the value by 'x'.
+    void operator/=(T x)
+    {
+        T old = this->Load(std::memory_order_relaxed);
+        while (!this->CASWeak(&old, old / x))
+        {
+        }
+    }
+
+    // Atomically %'s the value by 'x'.
+    void operator%=(T x)
+    {
+        T old = this->Load(std::memory_order_relaxed);
+        while (!this->CASWeak(&old, old % x))
+        {
+        }
+    }
+};
+
+// Atomic<T> for all other trivially copyable types (floating point numbers and
+// simple structs). Loads, stores and CAS map directly onto std::atomic<T>; the
+// arithmetic operators are CAS loops and only compile if T supports them.
+template <typename T>
+class Atomic<T, typename std::enable_if<std::is_trivially_copyable<T>::value && !std::is_integral<T>::value &&
+                                        !std::is_pointer<T>::value>::type> : public AtomicBase<T>
+{
+   public:
+    Atomic() {}
+    Atomic(T init) : AtomicBase<T>(init) {}
+    using AtomicBase<T>::operator=;
+
+    // Atomically adds 'x' to the value and returns the previous value.
+    T FetchAdd(T x)
+    {
+        T old = this->Load(std::memory_order_relaxed);
+        while (!this->CASWeak(&old, old + x))
+        {
+        }
+        return old;
+    }
+
+    // Atomically subtracts 'x' from the value and returns the previous value.
+    T FetchSub(T x)
+    {
+        T old = this->Load(std::memory_order_relaxed);
+        while (!this->CASWeak(&old, old - x))
+        {
+        }
+        return old;
+    }
+
+    // Atomically increments the value.
+    void operator++() { FetchAdd(1); }
+    // Atomically increments the value by 'x'.
+    void operator+=(T x) { FetchAdd(x); }
+    // Atomically decrements the value.
+    void operator--() { FetchSub(1); }
+    // Atomically decrements the value by 'x'.
+    void operator-=(T x) { FetchSub(x); }
+    // Atomically multiplies the value by 'x'.
+    void operator*=(T x)
+    {
+        T old = this->Load(std::memory_order_relaxed);
+        while (!this->CASWeak(&old, old * x))
+        {
+        }
+    }
+
+    // Atomically divides the value by 'x'.
+    void operator/=(T x)
+    {
+        T old = this->Load(std::memory_order_relaxed);
+        while (!this->CASWeak(&old, old / x))
+        {
+        }
+    }
+};
+
 #endif  // _DB_UTILS_ATOMIC_H_
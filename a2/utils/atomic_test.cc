@@ -0,0 +1,342 @@
+#include "utils/atomic.h"
+
+#include <pthread.h>
+#include <sched.h>
+#include <stdint.h>
+
+#include <string>
+#include <vector>
+
+#include "utils/testing.h"
+
+TEST(LockFreeQueue_FullAndEmpty)
+{
+    // Capacity rounds up to a power of two.
+    LockFreeQueue<int> queue(3);
+    int value;
+    EXPECT_FALSE(queue.Pop(&value));
+
+    // Fill and drain it a few times, so that positions wrap around the ring.
+    bool ok = true;
+    for (int round = 0; round < 5; round++)
+    {
+        for (int i = 0; i < 4; i++) ok = ok && queue.PushNonBlocking(10 * round + i);
+        EXPECT_FALSE(queue.PushNonBlocking(-1));
+        EXPECT_EQ(4, queue.Size());
+        for (int i = 0; i < 4; i++) ok = ok && queue.Pop(&value) && value == 10 * round + i;
+        EXPECT_FALSE(queue.PopNonBlocking(&value));
+        EXPECT_EQ(0, queue.Size());
+    }
+    EXPECT_TRUE(ok);
+
+    END;
+}
+
+TEST(LockFreeQueue_Bulk)
+{
+    LockFreeQueue<int> queue(16);
+    int items[16];
+    for (int i = 0; i < 16; i++) items[i] = i;
+
+    // Bulk pops stop at 'max', and at the end of what was pushed.
+    queue.PushBulk(items, 10);
+    int results[16];
+    EXPECT_EQ(4, queue.PopBulk(results, 4));
+    EXPECT_EQ(0, results[0]);
+    EXPECT_EQ(3, results[3]);
+    EXPECT_EQ(6, queue.PopBulk(results, 16));
+    EXPECT_EQ(4, results[0]);
+    EXPECT_EQ(9, results[5]);
+    EXPECT_EQ(0, queue.PopBulk(results, 16));
+
+    // A bulk push across the end of the ring, mixed with single pops.
+    queue.PushBulk(items, 16);
+    EXPECT_FALSE(queue.PushNonBlocking(16));
+    int value;
+    EXPECT_TRUE(queue.Pop(&value));
+    EXPECT_EQ(0, value);
+    EXPECT_EQ(15, queue.PopBulk(results, 16));
+    EXPECT_EQ(15, results[14]);
+
+    END;
+}
+
+const int kProducers      = 4;
+const int kConsumers      = 4;
+const int kItemsPerThread = 100000;
+
+struct QueueState
+{
+    LockFreeQueue<int>* queue_;
+    std::atomic<int> next_producer_;
+    std::atomic<int> popped_;
+    std::atomic<int> seen_[kProducers * kItemsPerThread];
+};
+
+static void* ProduceItems(void* arg)
+{
+    QueueState* state = reinterpret_cast<QueueState*>(arg);
+    int first         = state->next_producer_++ * kItemsPerThread;
+
+    // Alternate between single and bulk pushes.
+    for (int i = 0; i < kItemsPerThread;)
+    {
+        if (i % 2 == 0)
+        {
+            state->queue_->Push(first + i);
+            i++;
+        }
+        else
+        {
+            int batch[7];
+            int n = 0;
+            while (n < 7 && i < kItemsPerThread) batch[n++] = first + i++;
+            state->queue_->PushBulk(batch, n);
+        }
+    }
+    return NULL;
+}
+
+static void* ConsumeItems(void* arg)
+{
+    QueueState* state = reinterpret_cast<QueueState*>(arg);
+    const int total   = kProducers * kItemsPerThread;
+    int batch[5];
+    while (state->popped_.load() < total)
+    {
+        int n = state->queue_->PopBulk(batch, 5);
+        if (n == 0 && state->queue_->Pop(&batch[0])) n = 1;
+        if (n == 0) sched_yield();
+        for (int i = 0; i < n; i++) state->seen_[batch[i]]++;
+        state->popped_ += n;
+    }
+    return NULL;
+}
+
+TEST(LockFreeQueue_ManyProducersAndConsumers)
+{
+    // A small queue, so that producers regularly find it full and consumers
+    // find it empty.
+    QueueState* state = new QueueState();
+    state->queue_     = new LockFreeQueue<int>(64);
+    state->next_producer_.store(0);
+    state->popped_.store(0);
+    for (int i = 0; i < kProducers * kItemsPerThread; i++) state->seen_[i].store(0);
+
+    pthread_t threads[kProducers + kConsumers];
+    for (int i = 0; i < kConsumers; i++) pthread_create(&threads[i], NULL, ConsumeItems, state);
+    for (int i = 0; i < kProducers; i++) pthread_create(&threads[kConsumers + i], NULL, ProduceItems, state);
+    for (int i = 0; i < kProducers + kConsumers; i++) pthread_join(threads[i], NULL);
+
+    // Every item came out exactly once.
+    int wrong = 0;
+    for (int i = 0; i < kProducers * kItemsPerThread; i++)
+    {
+        if (state->seen_[i].load() != 1) wrong++;
+    }
+    EXPECT_EQ(0, wrong);
+    EXPECT_EQ(kProducers * kItemsPerThread, state->popped_.load());
+    EXPECT_EQ(0, state->queue_->Size());
+    delete state->queue_;
+    delete state;
+
+    END;
+}
+
+static void* ProduceInOrder(void* arg)
+{
+    SPSCQueue<int>* queue = reinterpret_cast<SPSCQueue<int>*>(arg);
+    for (int i = 0; i < kItemsPerThread; i++) queue->Push(i);
+    return NULL;
+}
+
+TEST(SPSCQueue_Order)
+{
+    SPSCQueue<int> queue(16);
+    int value;
+    EXPECT_FALSE(queue.Pop(&value));
+    for (int i = 0; i < 16; i++) queue.Push(i);
+    EXPECT_FALSE(queue.PushNonBlocking(16));
+    EXPECT_EQ(16, queue.Size());
+    for (int i = 0; i < 16; i++) queue.Pop(&value);
+
+    // The consumer sees the items in the order they were pushed.
+    pthread_t producer;
+    pthread_create(&producer, NULL, ProduceInOrder, &queue);
+    bool ordered = true;
+    for (int expected = 0; expected < kItemsPerThread;)
+    {
+        if (!queue.Pop(&value))
+        {
+            sched_yield();
+            continue;
+        }
+        ordered = ordered && value == expected;
+        expected++;
+    }
+    pthread_join(producer, NULL);
+    EXPECT_TRUE(ordered);
+    EXPECT_EQ(0, queue.Size());
+
+    END;
+}
+
+static void* TakeIds(void* arg)
+{
+    Atomic<uint64_t>* next_id = reinterpret_cast<Atomic<uint64_t>*>(arg);
+    uint64_t* ids             = new uint64_t[kItemsPerThread];
+    for (int i = 0; i < kItemsPerThread; i++) ids[i] = next_id->FetchAdd(1);
+    return ids;
+}
+
+TEST(Atomic_Integral)
+{
+    Atomic<int> value(10);
+    ++value;
+    value += 5;
+    --value;
+    value -= 3;
+    EXPECT_EQ(12, *value);
+    value *= 3;
+    value /= 2;
+    value %= 7;
+    EXPECT_EQ(4, *value);
+    EXPECT_EQ(4, value.FetchAdd(6));
+    EXPECT_EQ(10, value.FetchSub(2));
+    EXPECT_EQ(8, value.Exchange(1));
+    EXPECT_EQ(1, value.Load());
+
+    // A failed CAS reports the value it found.
+    int expected = 2;
+    EXPECT_FALSE(value.CAS(&expected, 3));
+    EXPECT_EQ(1, expected);
+    EXPECT_TRUE(value.CAS(&expected, 3));
+    EXPECT_EQ(3, *value);
+    expected = 3;
+    while (!value.CASWeak(&expected, 9))
+    {
+    }
+    EXPECT_EQ(9, *value);
+
+    // Ids handed out by FetchAdd from several threads are all distinct.
+    Atomic<uint64_t> next_id(0);
+    pthread_t threads[kProducers];
+    for (int i = 0; i < kProducers; i++) pthread_create(&threads[i], NULL, TakeIds, &next_id);
+    vector<bool> taken(kProducers * kItemsPerThread, false);
+    int duplicates = 0;
+    for (int i = 0; i < kProducers; i++)
+    {
+        void* result;
+        pthread_join(threads[i], &result);
+        uint64_t* ids = reinterpret_cast<uint64_t*>(result);
+        for (int j = 0; j < kItemsPerThread; j++)
+        {
+            if (ids[j] >= taken.size() || taken[ids[j]]) duplicates++;
+            else taken[ids[j]] = true;
+        }
+        delete[] ids;
+    }
+    EXPECT_EQ(0, duplicates);
+    EXPECT_EQ(static_cast<uint64_t>(kProducers * kItemsPerThread), *next_id);
+
+    END;
+}
+
+TEST(Atomic_Pointer)
+{
+    // Pointers move in units of the pointee.
+    int array[8];
+    Atomic<int*> pointer(array);
+    ++pointer;
+    pointer += 3;
+    EXPECT_TRUE(*pointer == array + 4);
+    EXPECT_TRUE(pointer.FetchSub(2) == array + 4);
+    --pointer;
+    EXPECT_TRUE(*pointer == array + 1);
+
+    int* expected = array;
+    EXPECT_FALSE(pointer.CAS(&expected, array + 7));
+    EXPECT_TRUE(expected == array + 1);
+    EXPECT_TRUE(pointer.CAS(&expected, array + 7));
+    EXPECT_TRUE(pointer.Exchange(NULL) == array + 7);
+    EXPECT_TRUE(*pointer == NULL);
+
+    END;
+}
+
+struct Extent
+{
+    int32_t offset_;
+    int32_t length_;
+};
+
+TEST(Atomic_TriviallyCopyable)
+{
+    Atomic<double> value(1.5);
+    value += 2;
+    ++value;
+    value *= 2;
+    value -= 1;
+    value /= 2;
+    EXPECT_EQ(4, *value);
+    EXPECT_EQ(4, value.FetchSub(0.5));
+    EXPECT_EQ(3.5, value.FetchAdd(0.25));
+    EXPECT_EQ(3.75, value.Exchange(0));
+
+    // Structs are compared bytewise by CAS.
+    Extent first = {0, 16};
+    Atomic<Extent> extent(first);
+    Extent expected = {0, 8};
+    Extent next     = {16, 32};
+    EXPECT_FALSE(extent.CAS(&expected, next));
+    EXPECT_EQ(16, expected.length_);
+    EXPECT_TRUE(extent.CAS(&expected, next));
+    EXPECT_EQ(16, extent.Load().offset_);
+    EXPECT_EQ(32, extent.Exchange(first).length_);
+    EXPECT_EQ(16, extent.Load().length_);
+
+    END;
+}
+
+static void* AppendChars(void* arg)
+{
+    Atomic<string>* text = reinterpret_cast<Atomic<string>*>(arg);
+    for (int i = 0; i < 1000; i++) *text += "x";
+    return NULL;
+}
+
+TEST(Atomic_MutexFallback)
+{
+    // Types that are not trivially copyable get the mutex-guarded version.
+    static_assert(!std::is_trivially_copyable<string>::value, "string should use the generic Atomic");
+    Atomic<string> text(string("ab"));
+    text += "cd";
+    EXPECT_EQ("abcd", *text);
+
+    string expected = "ab";
+    EXPECT_FALSE(text.CAS(&expected, "ef"));
+    EXPECT_EQ("abcd", expected);
+    EXPECT_TRUE(text.CAS(&expected, "ef"));
+    EXPECT_EQ("ef", *text);
+
+    // Concurrent updates are not lost.
+    text = string();
+    pthread_t threads[kProducers];
+    for (int i = 0; i < kProducers; i++) pthread_create(&threads[i], NULL, AppendChars, &text);
+    for (int i = 0; i < kProducers; i++) pthread_join(threads[i], NULL);
+    EXPECT_EQ(static_cast<size_t>(kProducers * 1000), (*text).size());
+
+    END;
+}
+
+int main(int argc, char** argv)
+{
+    LockFreeQueue_FullAndEmpty();
+    LockFreeQueue_Bulk();
+    LockFreeQueue_ManyProducersAndConsumers();
+    SPSCQueue_Order();
+    Atomic_Integral();
+    Atomic_Pointer();
+    Atomic_TriviallyCopyable();
+    Atomic_MutexFallback();
+}
@@ -0,0 +1,34 @@
+
+#include "utils/clock.h"
+
+// Returns CLOCK_MONOTONIC in seconds.
+static double MonotonicSeconds()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// Measures the tick rate over about 10ms.
+static double CalibrateSecondsPerTick()
+{
+#if defined(__x86_64__) || defined(__i386__)
+    double begin_seconds = MonotonicSeconds();
+    uint64_t begin_ticks = CycleClock::Ticks();
+    double end_seconds;
+    do
+    {
+        end_seconds = MonotonicSeconds();
+    } while (end_seconds - begin_seconds < 0.01);
+    uint64_t end_ticks = CycleClock::Ticks();
+    return (end_seconds - begin_seconds) / (end_ticks - begin_ticks);
+#else
+    return 1e-9;
+#endif
+}
+
+double CycleClock::SecondsPerTick()
+{
+    static const double seconds_per_tick = CalibrateSecondsPerTick();
+    return seconds_per_tick;
+}
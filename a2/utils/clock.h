@@ -0,0 +1,61 @@
+
+#ifndef _DB_UTILS_CLOCK_H_
+#define _DB_UTILS_CLOCK_H_
+
+#include <stdint.h>
+#include <time.h>
+#include <atomic>
+
+#include "utils/mutex.h"
+
+/// @class CycleClock
+///
+/// Cheap monotonic clock for measuring short intervals. On x86 it reads the
+/// time-stamp counter, which takes a few nanoseconds and no system call, and
+/// converts ticks to seconds with a rate calibrated against CLOCK_MONOTONIC on
+/// first use. Elsewhere, a tick is a nanosecond of CLOCK_MONOTONIC.
+///
+/// Assumes an invariant TSC (constant rate, synchronized across cores), as on
+/// any x86 server of the last decade.
+class CycleClock
+{
+   public:
+    // Returns the current tick count.
+    static inline uint64_t Ticks()
+    {
+#if defined(__x86_64__) || defined(__i386__)
+        return __builtin_ia32_rdtsc();
+#else
+        struct timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return ts.tv_sec * 1000000000ull + ts.tv_nsec;
+#endif
+    }
+
+    // Returns the current time in seconds, since an arbitrary point in the
+    // past.
+    static inline double Now() { return Ticks() * SecondsPerTick(); }
+    // Returns the length of a tick in seconds.
+    static double SecondsPerTick();
+};
+
+/// @class LogicalClock
+///
+/// Monotonic logical time: a counter that every update advances by one. An
+/// update stamped with Tick() compares greater than any earlier Now(), so
+/// "did anything change since time t" is one integer comparison, with none
+/// of the cost or resolution limits of a wall clock.
+class LogicalClock
+{
+   public:
+    LogicalClock() : now_(0) {}
+    // Returns the current time.
+    uint64_t Now() const { return now_.load(std::memory_order_acquire); }
+    // Advances the clock and returns the new time.
+    uint64_t Tick() { return now_.fetch_add(1, std::memory_order_acq_rel) + 1; }
+   private:
+    std::atomic<uint64_t> now_;
+    char pad_[CACHE_LINE_SIZE - sizeof(std::atomic<uint64_t>)];
+};
+
+#endif  // _DB_UTILS_CLOCK_H_
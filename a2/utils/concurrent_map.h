@@ -0,0 +1,452 @@
+
+#ifndef _DB_UTILS_CONCURRENT_MAP_H_
+#define _DB_UTILS_CONCURRENT_MAP_H_
+
+#include <atomic>
+#include <functional>
+#include <type_traits>
+#include <vector>
+
+#include <sched.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include "utils/atomic.h"
+#include "utils/epoch.h"
+
+using std::vector;
+
+/// @class ConcurrentMap<K, V>
+///
+/// Concurrent unordered associative container with the same CRUD interface as
+/// AtomicMap, plus InsertIfAbsent and ComputeIfPresent.
+///
+/// Keys are hashed into a fixed number of shards, each an open-addressing
+/// (linear probing) table guarded by a sequence lock. Writers serialize per
+/// shard by making the shard's version odd for the duration of the update.
+/// Readers never write shared memory: they snapshot the version, probe the
+/// table, and retry if the version changed underneath them. A shard that is
+/// mostly tombstones is rehashed in place; a table outgrown by its shard is
+/// retired and freed through an EpochManager once no reader can still be
+/// probing it.
+///
+/// K and V must be trivially copyable, since readers may copy them while a
+/// writer is modifying them (the copy is then discarded and retried).
+/// Iterators are NOT supported.
+template <typename K, typename V, typename Hash = std::hash<K> >
+class ConcurrentMap
+{
+   public:
+    static_assert(std::is_trivially_copyable<K>::value, "ConcurrentMap keys must be trivially copyable");
+    static_assert(std::is_trivially_copyable<V>::value, "ConcurrentMap values must be trivially copyable");
+
+    // 'shard_count' is rounded up to a power of two. Each shard starts out with
+    // room for 'initial_shard_capacity' / 2 pairs before it has to grow.
+    explicit ConcurrentMap(int shard_count = 64, size_t initial_shard_capacity = 64)
+    {
+        shard_count_ = 1;
+        while (shard_count_ < shard_count) shard_count_ <<= 1;
+        size_t capacity = 8;
+        while (capacity < initial_shard_capacity) capacity <<= 1;
+
+        shards_ = new Shard[shard_count_];
+        for (int i = 0; i < shard_count_; i++)
+        {
+            shards_[i].version_.store(0, std::memory_order_relaxed);
+            shards_[i].table_.store(NewTable(capacity), std::memory_order_relaxed);
+            shards_[i].size_.store(0, std::memory_order_relaxed);
+            shards_[i].tombstones_ = 0;
+        }
+    }
+
+    ~ConcurrentMap()
+    {
+        for (int i = 0; i < shard_count_; i++)
+        {
+            FreeTable(shards_[i].table_.load(std::memory_order_relaxed));
+            for (size_t j = 0; j < shards_[i].retired_.size(); j++) FreeTable(shards_[i].retired_[j].table_);
+        }
+        delete[] shards_;
+    }
+
+    // Returns the number of key-value pairs currently stored in the map.
+    int Size()
+    {
+        int64_t size = 0;
+        for (int i = 0; i < shard_count_; i++) size += shards_[i].size_.load(std::memory_order_relaxed);
+        return static_cast<int>(size);
+    }
+
+    // Returns the number of tables replaced by resizes that have not been freed
+    // yet because a reader may still be probing them.
+    size_t RetiredTables()
+    {
+        size_t retired = 0;
+        for (int i = 0; i < shard_count_; i++)
+        {
+            uint64_t version = LockShard(&shards_[i]);
+            retired += shards_[i].retired_.size();
+            UnlockShard(&shards_[i], version);
+        }
+        return retired;
+    }
+
+    // Returns true if the map contains a pair with key equal to 'key'.
+    bool Contains(const K& key)
+    {
+        V value;
+        return Lookup(key, &value);
+    }
+
+    // If the map contains a pair with key 'key', sets '*value' equal to the
+    // associated value and returns true, else returns false.
+    bool Lookup(const K& key, V* value)
+    {
+        uint64_t hash = HashOf(key);
+        Shard* shard  = ShardOf(hash);
+        int thread    = EpochManager::ThreadId();
+        epochs_.Enter(thread);
+        while (true)
+        {
+            uint64_t version = shard->version_.load(std::memory_order_acquire);
+            if (version & 1)
+            {
+                // A writer is modifying this shard.
+                sched_yield();
+                continue;
+            }
+
+            // Sequentially consistent, so that a resize that did not see our
+            // epoch cannot have published its table before this load.
+            Table* table = shard->table_.load();
+            bool found   = false;
+            V result;
+            for (size_t i = 0, slot = hash & table->mask_; i <= table->mask_; i++, slot = (slot + 1) & table->mask_)
+            {
+                uint8_t state = table->states_[slot].load(std::memory_order_relaxed);
+                if (state == EMPTY) break;
+                if (state == FULL)
+                {
+                    K candidate = table->entries_[slot].key_;
+                    if (candidate == key)
+                    {
+                        result = table->entries_[slot].value_;
+                        found  = true;
+                        break;
+                    }
+                }
+            }
+
+            // Only trust what we read if no writer started in the meantime.
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if (shard->version_.load(std::memory_order_relaxed) == version)
+            {
+                epochs_.Exit(thread);
+                if (found) *value = result;
+                return found;
+            }
+        }
+    }
+
+    // Atomically inserts the pair (key, value) into the map (clobbering any
+    // previous pair with key equal to 'key'.
+    void Insert(const K& key, const V& value)
+    {
+        uint64_t hash    = HashOf(key);
+        Shard* shard     = ShardOf(hash);
+        uint64_t version = LockShard(shard);
+        Entry* entry     = FindOrInsert(shard, hash, key, NULL);
+        entry->value_    = value;
+        UnlockShard(shard, version);
+    }
+
+    // Synonym for 'Insert(key, value)'.
+    void Set(const K& key, const V& value) { Insert(key, value); }
+    // Atomically erases any pair with key 'key' from the map.
+    void Erase(const K& key)
+    {
+        uint64_t hash    = HashOf(key);
+        Shard* shard     = ShardOf(hash);
+        uint64_t version = LockShard(shard);
+        Table* table     = shard->table_.load(std::memory_order_relaxed);
+        size_t slot;
+        if (Find(table, hash, key, &slot))
+        {
+            table->states_[slot].store(DELETED, std::memory_order_relaxed);
+            shard->size_.store(shard->size_.load(std::memory_order_relaxed) - 1, std::memory_order_relaxed);
+            shard->tombstones_++;
+        }
+        UnlockShard(shard, version);
+    }
+
+    // If the map contains no pair with key 'key', atomically inserts (key,
+    // value) and returns true. Otherwise leaves the map unchanged, sets
+    // '*existing' (if non-NULL) to the value already associated with 'key', and
+    // returns false.
+    bool InsertIfAbsent(const K& key, const V& value, V* existing = NULL)
+    {
+        uint64_t hash    = HashOf(key);
+        Shard* shard     = ShardOf(hash);
+        uint64_t version = LockShard(shard);
+        bool inserted    = false;
+        Entry* entry     = FindOrInsert(shard, hash, key, &inserted);
+        if (inserted)
+        {
+            entry->value_ = value;
+        }
+        else if (existing != NULL)
+        {
+            *existing = entry->value_;
+        }
+        UnlockShard(shard, version);
+        return inserted;
+    }
+
+    // If the map contains a pair with key 'key', atomically calls 'f(&value)'
+    // on its value (which 'f' may modify in place) and returns true, else
+    // returns false without calling 'f'.
+    //
+    // Note: 'f' runs while the key's shard is locked, so it should be short and
+    // must not access this map.
+    template <typename F>
+    bool ComputeIfPresent(const K& key, F f)
+    {
+        uint64_t hash    = HashOf(key);
+        Shard* shard     = ShardOf(hash);
+        uint64_t version = LockShard(shard);
+        Table* table     = shard->table_.load(std::memory_order_relaxed);
+        size_t slot;
+        bool found = Find(table, hash, key, &slot);
+        if (found) f(&table->entries_[slot].value_);
+        UnlockShard(shard, version);
+        return found;
+    }
+
+   private:
+    // Slot states.
+    enum
+    {
+        EMPTY   = 0,
+        FULL    = 1,
+        DELETED = 2,
+    };
+
+    struct Entry
+    {
+        K key_;
+        V value_;
+    };
+
+    struct Table
+    {
+        size_t mask_;
+        std::atomic<uint8_t>* states_;
+        Entry* entries_;
+    };
+
+    // A table replaced by a resize, and the epoch it was unlinked in.
+    struct Retired
+    {
+        Table* table_;
+        uint64_t epoch_;
+    };
+
+    struct Shard
+    {
+        // Sequence lock: odd while a writer is modifying the shard.
+        std::atomic<uint64_t> version_;
+        std::atomic<Table*> table_;
+        std::atomic<int64_t> size_;
+        size_t tombstones_;
+
+        // Tables replaced by resizes that optimistic readers may still be
+        // probing.
+        vector<Retired> retired_;
+        char pad_[CACHE_LINE_SIZE];
+    };
+
+    static Table* NewTable(size_t capacity)
+    {
+        Table* table    = new Table();
+        table->mask_    = capacity - 1;
+        table->states_  = new std::atomic<uint8_t>[capacity];
+        table->entries_ = new Entry[capacity];
+        for (size_t i = 0; i < capacity; i++) table->states_[i].store(EMPTY, std::memory_order_relaxed);
+        return table;
+    }
+
+    static void FreeTable(Table* table)
+    {
+        delete[] table->states_;
+        delete[] table->entries_;
+        delete table;
+    }
+
+    // Mixes the user-supplied hash so that both the shard (high bits) and the
+    // slot (low bits) are well distributed even for identity hashes.
+    uint64_t HashOf(const K& key)
+    {
+        uint64_t h = static_cast<uint64_t>(Hash()(key));
+        h ^= h >> 33;
+        h *= 0xff51afd7ed558ccdULL;
+        h ^= h >> 33;
+        h *= 0xc4ceb9fe1a85ec53ULL;
+        h ^= h >> 33;
+        return h;
+    }
+
+    Shard* ShardOf(uint64_t hash) { return &shards_[(hash >> 48) & (shard_count_ - 1)]; }
+    // Spins until the shard's sequence lock is acquired. Returns the (even)
+    // version the shard had before locking.
+    uint64_t LockShard(Shard* shard)
+    {
+        while (true)
+        {
+            uint64_t version = shard->version_.load(std::memory_order_relaxed);
+            if ((version & 1) == 0 &&
+                shard->version_.compare_exchange_weak(version, version + 1, std::memory_order_acquire))
+            {
+                // Keep the writes that follow from becoming visible before the
+                // odd version.
+                std::atomic_thread_fence(std::memory_order_release);
+                return version;
+            }
+            sched_yield();
+        }
+    }
+
+    void UnlockShard(Shard* shard, uint64_t version) { shard->version_.store(version + 2, std::memory_order_release); }
+    // Looks up 'key' in 'table'. Requires the shard lock.
+    bool Find(Table* table, uint64_t hash, const K& key, size_t* slot)
+    {
+        for (size_t i = 0, s = hash & table->mask_; i <= table->mask_; i++, s = (s + 1) & table->mask_)
+        {
+            uint8_t state = table->states_[s].load(std::memory_order_relaxed);
+            if (state == EMPTY) return false;
+            if (state == FULL && table->entries_[s].key_ == key)
+            {
+                *slot = s;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // Returns the entry for 'key', creating it (with an unspecified value) if it
+    // does not exist yet. Sets '*inserted' accordingly if non-NULL. Requires the
+    // shard lock.
+    Entry* FindOrInsert(Shard* shard, uint64_t hash, const K& key, bool* inserted)
+    {
+        Table* table = shard->table_.load(std::memory_order_relaxed);
+        size_t slot;
+        if (Find(table, hash, key, &slot))
+        {
+            if (inserted != NULL) *inserted = false;
+            return &table->entries_[slot];
+        }
+
+        // Keep the load factor (including tombstones) at or below 1/2. If most
+        // of the occupied slots are tombstones, rehashing at the same capacity
+        // is enough.
+        size_t size     = shard->size_.load(std::memory_order_relaxed);
+        size_t capacity = table->mask_ + 1;
+        if (2 * (size + shard->tombstones_ + 1) > capacity)
+        {
+            if (4 * (size + 1) > capacity)
+            {
+                table = Resize(shard, table, 2 * capacity);
+            }
+            else
+            {
+                Rehash(shard, table);
+            }
+        }
+
+        // Take the first free (empty or deleted) slot along the probe sequence.
+        slot = hash & table->mask_;
+        while (table->states_[slot].load(std::memory_order_relaxed) == FULL) slot = (slot + 1) & table->mask_;
+        if (table->states_[slot].load(std::memory_order_relaxed) == DELETED) shard->tombstones_--;
+
+        table->entries_[slot].key_ = key;
+        table->states_[slot].store(FULL, std::memory_order_relaxed);
+        shard->size_.store(size + 1, std::memory_order_relaxed);
+        if (inserted != NULL) *inserted = true;
+        return &table->entries_[slot];
+    }
+
+    // Puts 'entry' into the first empty slot of its probe sequence in 'table'.
+    void Place(Table* table, const Entry& entry)
+    {
+        size_t slot = HashOf(entry.key_) & table->mask_;
+        while (table->states_[slot].load(std::memory_order_relaxed) == FULL) slot = (slot + 1) & table->mask_;
+        table->entries_[slot] = entry;
+        table->states_[slot].store(FULL, std::memory_order_relaxed);
+    }
+
+    // Rehashes the shard's live pairs into a new table with 'capacity' slots,
+    // publishes it, and returns it. The old table is freed as soon as no reader
+    // can be probing it. Requires the shard lock.
+    Table* Resize(Shard* shard, Table* old_table, size_t capacity)
+    {
+        Table* table = NewTable(capacity);
+        for (size_t i = 0; i <= old_table->mask_; i++)
+        {
+            if (old_table->states_[i].load(std::memory_order_relaxed) == FULL) Place(table, old_table->entries_[i]);
+        }
+
+        shard->table_.store(table);
+        shard->tombstones_ = 0;
+
+        Retired retired = {old_table, epochs_.Advance()};
+        shard->retired_.push_back(retired);
+        Reclaim(shard);
+        return table;
+    }
+
+    // Frees the shard's retired tables that no reader can be probing anymore.
+    // Requires the shard lock.
+    void Reclaim(Shard* shard)
+    {
+        uint64_t safe = epochs_.SafeEpoch();
+        size_t kept   = 0;
+        for (size_t i = 0; i < shard->retired_.size(); i++)
+        {
+            if (shard->retired_[i].epoch_ < safe)
+            {
+                FreeTable(shard->retired_[i].table_);
+            }
+            else
+            {
+                shard->retired_[kept++] = shard->retired_[i];
+            }
+        }
+        shard->retired_.resize(kept);
+    }
+
+    // Drops the shard's tombstones by rehashing its live pairs within the same
+    // table. Readers that overlap this see the shard locked and retry, so no
+    // table needs to be retired. Requires the shard lock.
+    void Rehash(Shard* shard, Table* table)
+    {
+        vector<Entry> live;
+        for (size_t i = 0; i <= table->mask_; i++)
+        {
+            if (table->states_[i].load(std::memory_order_relaxed) == FULL) live.push_back(table->entries_[i]);
+            table->states_[i].store(EMPTY, std::memory_order_relaxed);
+        }
+        for (size_t i = 0; i < live.size(); i++) Place(table, live[i]);
+        shard->tombstones_ = 0;
+        if (!shard->retired_.empty()) Reclaim(shard);
+    }
+
+    // Disallow copying.
+    ConcurrentMap(const ConcurrentMap&);
+    ConcurrentMap& operator=(const ConcurrentMap&);
+
+    int shard_count_;
+    Shard* shards_;
+
+    // Tells resizes when a retired table is no longer being probed.
+    EpochManager epochs_;
+};
+
+#endif  // _DB_UTILS_CONCURRENT_MAP_H_
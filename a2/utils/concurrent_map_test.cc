@@ -0,0 +1,132 @@
+#include "utils/concurrent_map.h"
+
+#include <pthread.h>
+#include <stdint.h>
+
+#include "utils/testing.h"
+
+TEST(ConcurrentMap_Basic)
+{
+    ConcurrentMap<uint64_t, uint64_t> map;
+    uint64_t value;
+    EXPECT_FALSE(map.Lookup(1, &value));
+
+    map.Insert(1, 10);
+    map.Insert(2, 20);
+    EXPECT_TRUE(map.Lookup(1, &value));
+    EXPECT_EQ(10, value);
+    EXPECT_EQ(2, map.Size());
+
+    // Insert clobbers, InsertIfAbsent does not.
+    map.Insert(1, 11);
+    EXPECT_FALSE(map.InsertIfAbsent(1, 12, &value));
+    EXPECT_EQ(11, value);
+    EXPECT_TRUE(map.InsertIfAbsent(3, 30));
+
+    EXPECT_TRUE(map.ComputeIfPresent(3, [](uint64_t* v) { (*v)++; }));
+    EXPECT_FALSE(map.ComputeIfPresent(4, [](uint64_t* v) { (*v)++; }));
+    EXPECT_TRUE(map.Lookup(3, &value));
+    EXPECT_EQ(31, value);
+
+    map.Erase(2);
+    map.Erase(4);
+    EXPECT_FALSE(map.Contains(2));
+    EXPECT_EQ(2, map.Size());
+
+    END;
+}
+
+TEST(ConcurrentMap_GrowthFreesOldTables)
+{
+    // One small shard, so that every insert below lands in a table that has to
+    // grow many times.
+    ConcurrentMap<uint64_t, uint64_t> map(1, 8);
+    const uint64_t kKeys = 100000;
+    for (uint64_t i = 0; i < kKeys; i++) map.Insert(i, 3 * i);
+    EXPECT_EQ(kKeys, map.Size());
+
+    bool intact = true;
+    uint64_t value;
+    for (uint64_t i = 0; i < kKeys; i++) intact = intact && map.Lookup(i, &value) && value == 3 * i;
+    EXPECT_TRUE(intact);
+
+    // With no reader around, every outgrown table was freed on the spot.
+    EXPECT_EQ(0, map.RetiredTables());
+
+    END;
+}
+
+TEST(ConcurrentMap_TombstonesRehashInPlace)
+{
+    ConcurrentMap<uint64_t, uint64_t> map(1, 64);
+    uint64_t value;
+    bool intact = true;
+    for (uint64_t i = 0; i < 100000; i++)
+    {
+        map.Insert(i, i);
+        if (i >= 4) map.Erase(i - 4);
+        intact = intact && map.Lookup(i, &value) && value == i && !map.Contains(i - 4);
+    }
+    EXPECT_TRUE(intact);
+    EXPECT_EQ(4, map.Size());
+    EXPECT_EQ(0, map.RetiredTables());
+
+    END;
+}
+
+const uint64_t kConcurrentKeys = 200000;
+
+struct ConcurrentMapState
+{
+    ConcurrentMap<uint64_t, uint64_t>* map_;
+    std::atomic<bool> done_;
+    std::atomic<int> bad_reads_;
+};
+
+static void* ReadKeys(void* arg)
+{
+    ConcurrentMapState* state = reinterpret_cast<ConcurrentMapState*>(arg);
+    uint64_t key              = 0;
+    uint64_t value;
+    while (!state->done_.load())
+    {
+        // Whatever a lookup returns must be the value written with the key.
+        if (state->map_->Lookup(key, &value) && value != 7 * key) state->bad_reads_++;
+        key = (key + 7919) % kConcurrentKeys;
+    }
+    return NULL;
+}
+
+TEST(ConcurrentMap_ReadersDuringGrowth)
+{
+    ConcurrentMap<uint64_t, uint64_t> map(1, 8);
+    ConcurrentMapState state;
+    state.map_ = &map;
+    state.done_.store(false);
+    state.bad_reads_.store(0);
+
+    const int kReaders = 4;
+    pthread_t readers[kReaders];
+    for (int i = 0; i < kReaders; i++) pthread_create(&readers[i], NULL, ReadKeys, &state);
+    for (uint64_t i = 0; i < kConcurrentKeys; i++) map.Insert(i, 7 * i);
+    state.done_.store(true);
+    for (int i = 0; i < kReaders; i++) pthread_join(readers[i], NULL);
+
+    EXPECT_EQ(0, state.bad_reads_.load());
+    EXPECT_EQ(kConcurrentKeys, map.Size());
+
+    // Tables the readers might still have been probing are freed by the next
+    // resize, now that they are gone.
+    for (uint64_t i = kConcurrentKeys; i < 2 * kConcurrentKeys; i++) map.Insert(i, 7 * i);
+    EXPECT_EQ(0, map.RetiredTables());
+
+    END;
+}
+
+int main(int argc, char** argv)
+{
+    ConcurrentMap_Basic();
+    ConcurrentMap_GrowthFreesOldTables();
+    ConcurrentMap_TombstonesRehashInPlace();
+    ConcurrentMap_ReadersDuringGrowth();
+}
@@ -0,0 +1,240 @@
+
+#include "utils/cpu_topology.h"
+
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <algorithm>
+#include <map>
+#include <set>
+#include <sstream>
+#include <utility>
+
+using std::map;
+using std::pair;
+using std::set;
+
+string PinPolicyToString(PinPolicy policy)
+{
+    switch (policy)
+    {
+        case PIN_NONE:
+            return "none";
+        case PIN_COMPACT:
+            return "compact";
+        case PIN_SCATTER:
+            return "scatter";
+        case PIN_SMT:
+            return "smt";
+        default:
+            return "INVALID POLICY";
+    }
+}
+
+PinPolicy StringToPinPolicy(const string& name, PinPolicy fallback)
+{
+    for (int p = PIN_NONE; p <= PIN_SMT; p++)
+    {
+        if (name == PinPolicyToString(static_cast<PinPolicy>(p))) return static_cast<PinPolicy>(p);
+    }
+    return fallback;
+}
+
+// Reads a single integer from a sysfs file. Returns false if it can't.
+static bool ReadSysfsInt(const string& path, int* value)
+{
+    FILE* f = fopen(path.c_str(), "r");
+    if (f == NULL) return false;
+    bool ok = fscanf(f, "%d", value) == 1;
+    fclose(f);
+    return ok;
+}
+
+// Parses a sysfs CPU list such as "0-3,8,10-11".
+static vector<int> ParseCpuList(const string& list)
+{
+    vector<int> cpus;
+    std::stringstream ss(list);
+    string range;
+    while (std::getline(ss, range, ','))
+    {
+        int first, last;
+        int n = sscanf(range.c_str(), "%d-%d", &first, &last);
+        if (n == 1) last = first;
+        if (n < 1) continue;
+        for (int cpu = first; cpu <= last; cpu++) cpus.push_back(cpu);
+    }
+    return cpus;
+}
+
+// Reads a CPU list file from sysfs. Returns an empty list if it can't.
+static vector<int> ReadSysfsCpuList(const string& path)
+{
+    FILE* f = fopen(path.c_str(), "r");
+    if (f == NULL) return vector<int>();
+    char buf[4096];
+    string list;
+    if (fgets(buf, sizeof(buf), f) != NULL) list = buf;
+    fclose(f);
+    return ParseCpuList(list);
+}
+
+const CpuTopology& CpuTopology::Get()
+{
+    static CpuTopology topology("/sys/devices/system/cpu/", true);
+    return topology;
+}
+
+CpuTopology::CpuTopology(const string& sysfs, bool affinity)
+{
+    vector<int> online = ReadSysfsCpuList(sysfs + "online");
+    if (online.empty())
+    {
+        int n = sysconf(_SC_NPROCESSORS_ONLN);
+        for (int i = 0; i < (n > 0 ? n : 1); i++) online.push_back(i);
+    }
+
+#if !defined(_MSC_VER) && !defined(__APPLE__)
+    // Only consider CPUs this process is allowed to run on.
+    cpu_set_t allowed;
+    CPU_ZERO(&allowed);
+    if (affinity && sched_getaffinity(0, sizeof(allowed), &allowed) == 0)
+    {
+        vector<int> usable;
+        for (size_t i = 0; i < online.size(); i++)
+        {
+            if (CPU_ISSET(online[i], &allowed)) usable.push_back(online[i]);
+        }
+        if (!usable.empty()) online = usable;
+    }
+#endif
+
+    // Physical cores are identified by (socket, first hardware thread).
+    map<pair<int, int>, int> core_ids;
+    for (size_t i = 0; i < online.size(); i++)
+    {
+        Cpu cpu;
+        cpu.id_           = online[i];
+        string topology   = sysfs + "cpu" + std::to_string(cpu.id_) + "/topology/";
+        vector<int> smt   = ReadSysfsCpuList(topology + "thread_siblings_list");
+        if (!ReadSysfsInt(topology + "physical_package_id", &cpu.socket_) || cpu.socket_ < 0) cpu.socket_ = 0;
+        if (smt.empty()) smt.push_back(cpu.id_);
+
+        pair<int, int> core(cpu.socket_, smt[0]);
+        if (core_ids.count(core) == 0)
+        {
+            int id = core_ids.size();
+            core_ids[core] = id;
+        }
+        cpu.core_ = core_ids[core];
+        cpu.smt_  = std::find(smt.begin(), smt.end(), cpu.id_) - smt.begin();
+        cpus_.push_back(cpu);
+    }
+}
+
+int CpuTopology::CoreCount() const
+{
+    set<int> cores;
+    for (size_t i = 0; i < cpus_.size(); i++) cores.insert(cpus_[i].core_);
+    return cores.size();
+}
+
+int CpuTopology::SocketCount() const
+{
+    set<int> sockets;
+    for (size_t i = 0; i < cpus_.size(); i++) sockets.insert(cpus_[i].socket_);
+    return sockets.size();
+}
+
+vector<int> CpuTopology::Order(PinPolicy policy) const
+{
+    // Sort key for each CPU; the policy decides which attribute dominates.
+    vector<pair<vector<int>, int> > keyed;
+    map<int, int> rank_in_socket;  // core -> rank among its socket's cores
+    map<int, int> cores_seen;      // socket -> cores ranked so far
+    for (size_t i = 0; i < cpus_.size(); i++)
+    {
+        if (rank_in_socket.count(cpus_[i].core_) == 0)
+        {
+            rank_in_socket[cpus_[i].core_] = cores_seen[cpus_[i].socket_]++;
+        }
+    }
+
+    for (size_t i = 0; i < cpus_.size(); i++)
+    {
+        const Cpu& cpu = cpus_[i];
+        int rank       = rank_in_socket[cpu.core_];
+        vector<int> key;
+        if (policy == PIN_SCATTER)
+        {
+            // Core 0 of every socket, then core 1 of every socket, ...
+            key.push_back(cpu.smt_);
+            key.push_back(rank);
+            key.push_back(cpu.socket_);
+        }
+        else if (policy == PIN_SMT)
+        {
+            // All hardware threads of a core before the next core.
+            key.push_back(cpu.socket_);
+            key.push_back(rank);
+            key.push_back(cpu.smt_);
+        }
+        else
+        {
+            // Every core of a socket before the next socket.
+            key.push_back(cpu.smt_);
+            key.push_back(cpu.socket_);
+            key.push_back(rank);
+        }
+        keyed.push_back(std::make_pair(key, cpu.id_));
+    }
+
+    std::sort(keyed.begin(), keyed.end());
+    vector<int> order;
+    for (size_t i = 0; i < keyed.size(); i++) order.push_back(keyed[i].second);
+    return order;
+}
+
+vector<int> CpuTopology::Layout(int nthreads, PinPolicy policy) const
+{
+    vector<int> layout(nthreads, -1);
+    if (policy == PIN_NONE || cpus_.empty()) return layout;
+
+    vector<int> order = Order(policy);
+    for (int i = 0; i < nthreads; i++) layout[i] = order[i % order.size()];
+    return layout;
+}
+
+string CpuTopology::Describe() const
+{
+    std::stringstream ss;
+    ss << SocketCount() << (SocketCount() == 1 ? " socket, " : " sockets, ") << CoreCount()
+       << (CoreCount() == 1 ? " core, " : " cores, ") << CpuCount() << (CpuCount() == 1 ? " CPU" : " CPUs");
+    return ss.str();
+}
+
+void SetThreadAffinity(pthread_attr_t* attr, int cpu)
+{
+#if !defined(_MSC_VER) && !defined(__APPLE__)
+    if (cpu < 0) return;
+    cpu_set_t cpuset;
+    CPU_ZERO(&cpuset);
+    CPU_SET(cpu, &cpuset);
+    pthread_attr_setaffinity_np(attr, sizeof(cpu_set_t), &cpuset);
+#endif
+}
+
+string DescribeLayout(const vector<int>& cpus)
+{
+    std::stringstream ss;
+    for (size_t i = 0; i < cpus.size(); i++)
+    {
+        if (i > 0) ss << ",";
+        if (cpus[i] < 0)
+            ss << "any";
+        else
+            ss << cpus[i];
+    }
+    return ss.str();
+}
@@ -0,0 +1,84 @@
+
+#ifndef _DB_UTILS_CPU_TOPOLOGY_H_
+#define _DB_UTILS_CPU_TOPOLOGY_H_
+
+#include <pthread.h>
+#include <string>
+#include <vector>
+
+using std::string;
+using std::vector;
+
+// How threads are mapped onto CPUs.
+enum PinPolicy
+{
+    PIN_NONE    = 0,  // Don't pin; the OS may run any thread on any CPU.
+    PIN_COMPACT = 1,  // One physical core per thread, filling a socket before
+                      // moving to the next. SMT siblings are only used once
+                      // every core has a thread.
+    PIN_SCATTER = 2,  // One physical core per thread, alternating between
+                      // sockets. SMT siblings are used last.
+    PIN_SMT     = 3,  // Fill both hardware threads of a core before moving on
+                      // to the next core.
+};
+
+// Returns a human-readable name for 'policy'.
+string PinPolicyToString(PinPolicy policy);
+
+// Parses a policy name as printed by PinPolicyToString ("none", "compact",
+// "scatter" or "smt"). Returns 'fallback' for anything else.
+PinPolicy StringToPinPolicy(const string& name, PinPolicy fallback);
+
+/// @class CpuTopology
+///
+/// The sockets, physical cores and hardware threads (CPUs) this process may
+/// run on, read from /sys/devices/system/cpu and restricted to the process's
+/// affinity mask. If sysfs is unavailable, every CPU is treated as its own core
+/// on a single socket.
+class CpuTopology
+{
+   public:
+    // Returns the topology of the machine, detected on first use.
+    static const CpuTopology& Get();
+
+    // Reads the topology from a directory laid out like
+    // /sys/devices/system/cpu/ ('sysfs', with the trailing slash), optionally
+    // restricted to the process's affinity mask.
+    CpuTopology(const string& sysfs, bool affinity);
+
+    int CpuCount() const { return cpus_.size(); }
+    int CoreCount() const;
+    int SocketCount() const;
+
+    // Returns the CPU each of 'nthreads' threads should be pinned to under
+    // 'policy', or -1 for each thread if 'policy' is PIN_NONE. If there are
+    // more threads than CPUs, CPUs are handed out again from the start.
+    vector<int> Layout(int nthreads, PinPolicy policy) const;
+
+    // E.g. "2 sockets, 16 cores, 32 CPUs".
+    string Describe() const;
+
+   private:
+    struct Cpu
+    {
+        int id_;
+        int socket_;
+        int core_;  // Identifies the physical core within the whole machine.
+        int smt_;   // Index of this CPU among the hardware threads of its core.
+    };
+
+    // Returns the CPUs in the order in which 'policy' hands them out.
+    vector<int> Order(PinPolicy policy) const;
+
+    vector<Cpu> cpus_;
+};
+
+// Restricts threads created with 'attr' to 'cpu'. Does nothing if 'cpu' is
+// negative or the platform doesn't support pinning.
+void SetThreadAffinity(pthread_attr_t* attr, int cpu);
+
+// Formats a thread-to-CPU mapping as returned by CpuTopology::Layout, e.g.
+// "1,2,3,4" (or "any" for unpinned threads).
+string DescribeLayout(const vector<int>& cpus);
+
+#endif  // _DB_UTILS_CPU_TOPOLOGY_H_
@@ -0,0 +1,80 @@
+#include "utils/cpu_topology.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/stat.h>
+
+#include "utils/testing.h"
+
+// Writes 'contents' to the file at 'path'.
+static void WriteFile(const string& path, const string& contents)
+{
+    FILE* f = fopen(path.c_str(), "w");
+    fputs(contents.c_str(), f);
+    fclose(f);
+}
+
+// Creates a sysfs-style CPU directory under /tmp with 'sockets' sockets of
+// 'cores' cores with two hardware threads each, numbered the way Linux does:
+// the first hardware threads of all cores, socket by socket, then the second
+// ones. Returns its path.
+static string FakeSysfs(int sockets, int cores)
+{
+    char dir[]  = "/tmp/cpu_topology_testXXXXXX";
+    string root = string(mkdtemp(dir)) + "/";
+    int threads = sockets * cores;
+    WriteFile(root + "online", "0-" + std::to_string(2 * threads - 1) + "\n");
+    for (int cpu = 0; cpu < 2 * threads; cpu++)
+    {
+        int first   = cpu % threads;
+        string path = root + "cpu" + std::to_string(cpu);
+        mkdir(path.c_str(), 0700);
+        mkdir((path + "/topology").c_str(), 0700);
+        WriteFile(path + "/topology/thread_siblings_list",
+                  std::to_string(first) + "," + std::to_string(first + threads) + "\n");
+        WriteFile(path + "/topology/physical_package_id", std::to_string(first / cores) + "\n");
+    }
+    return root;
+}
+
+TEST(CpuTopology_Parse)
+{
+    CpuTopology topology(FakeSysfs(2, 2), false);
+    EXPECT_EQ(8, topology.CpuCount());
+    EXPECT_EQ(4, topology.CoreCount());
+    EXPECT_EQ(2, topology.SocketCount());
+    EXPECT_EQ("2 sockets, 4 cores, 8 CPUs", topology.Describe());
+
+    // Without topology files, every CPU in a list with gaps is its own core.
+    char dir[]  = "/tmp/cpu_topology_testXXXXXX";
+    string root = string(mkdtemp(dir)) + "/";
+    WriteFile(root + "online", "0,2-3\n");
+    CpuTopology flat(root, false);
+    EXPECT_EQ(3, flat.CpuCount());
+    EXPECT_EQ(3, flat.CoreCount());
+    EXPECT_EQ(1, flat.SocketCount());
+    EXPECT_EQ("0,2,3", DescribeLayout(flat.Layout(3, PIN_COMPACT)));
+
+    END;
+}
+
+TEST(CpuTopology_Layout)
+{
+    // Socket 0 has cores {0,4} and {1,5}; socket 1 has {2,6} and {3,7}.
+    CpuTopology topology(FakeSysfs(2, 2), false);
+    EXPECT_EQ("0,1,2,3,4,5,6,7", DescribeLayout(topology.Layout(8, PIN_COMPACT)));
+    EXPECT_EQ("0,2,1,3,4,6,5,7", DescribeLayout(topology.Layout(8, PIN_SCATTER)));
+    EXPECT_EQ("0,4,1,5,2,6,3,7", DescribeLayout(topology.Layout(8, PIN_SMT)));
+    EXPECT_EQ("any,any,any", DescribeLayout(topology.Layout(3, PIN_NONE)));
+
+    // More threads than CPUs start over.
+    EXPECT_EQ("0,2,1,3,4,6,5,7,0,2", DescribeLayout(topology.Layout(10, PIN_SCATTER)));
+
+    END;
+}
+
+int main(int argc, char** argv)
+{
+    CpuTopology_Parse();
+    CpuTopology_Layout();
+}
@@ -0,0 +1,13 @@
+#include "utils/epoch.h"
+
+#include <stdlib.h>
+
+static_assert(EpochManager::kMaxThreads == MAX_THREAD_IDS, "epoch slots are indexed by thread id");
+
+int EpochManager::ThreadId()
+{
+    // More than kMaxThreads threads are running at the same time.
+    int id = ThisThreadId();
+    if (id < 0) abort();
+    return id;
+}
@@ -0,0 +1,77 @@
+
+#ifndef _DB_UTILS_EPOCH_H_
+#define _DB_UTILS_EPOCH_H_
+
+#include <assert.h>
+#include <stdint.h>
+#include <atomic>
+
+#include "utils/mutex.h"
+
+/// @class EpochManager
+///
+/// Epoch-based reclamation for structures that readers traverse without
+/// latches. Each reader thread, identified by a small id, brackets its
+/// accesses with Enter/Exit, which publish the global epoch it saw. A thread
+/// that unlinks an object calls Advance() and tags the object with the epoch
+/// it returns; the object can be freed once SafeEpoch() is larger than the
+/// tag, since every reader that might still hold a pointer to it entered no
+/// later than that epoch.
+///
+/// Enter and Exit touch only the caller's own cache line; Advance and
+/// SafeEpoch are meant for a single background thread. Threads without an id
+/// of their own can use ThreadId().
+class EpochManager
+{
+   public:
+    static const int kMaxThreads = 64;
+
+    // Returns an id below kMaxThreads for the calling thread that no other
+    // running thread holds. The id is handed back when the thread exits.
+    static int ThreadId();
+
+    EpochManager() : global_(1)
+    {
+        for (int i = 0; i < kMaxThreads; i++) slots_[i].epoch_.store(kIdle, std::memory_order_relaxed);
+    }
+
+    // Marks thread 'id' as reading shared data from now on.
+    inline void Enter(int id)
+    {
+        assert(id < kMaxThreads);
+        slots_[id].epoch_.store(global_.load());
+    }
+
+    // Marks thread 'id' as holding no pointers into shared data.
+    inline void Exit(int id) { slots_[id].epoch_.store(kIdle, std::memory_order_release); }
+    // Starts a new epoch and returns the one it ends, to tag objects that were
+    // unlinked before the call.
+    uint64_t Advance() { return global_.fetch_add(1); }
+    // Returns the oldest epoch a thread may still be reading in. Objects
+    // tagged with smaller epochs can be freed.
+    uint64_t SafeEpoch() const
+    {
+        uint64_t safe = global_.load();
+        for (int i = 0; i < kMaxThreads; i++)
+        {
+            uint64_t epoch = slots_[i].epoch_.load();
+            if (epoch < safe) safe = epoch;
+        }
+        return safe;
+    }
+
+   private:
+    static const uint64_t kIdle = ~0ull;
+
+    struct Slot
+    {
+        std::atomic<uint64_t> epoch_;
+        char pad_[CACHE_LINE_SIZE - sizeof(std::atomic<uint64_t>)];
+    };
+
+    std::atomic<uint64_t> global_;
+    char pad_[CACHE_LINE_SIZE - sizeof(std::atomic<uint64_t>)];
+    Slot slots_[kMaxThreads];
+};
+
+#endif  // _DB_UTILS_EPOCH_H_
@@ -0,0 +1,98 @@
+#include "utils/epoch.h"
+
+#include <pthread.h>
+#include <stdint.h>
+#include <set>
+
+#include "utils/testing.h"
+
+using std::set;
+
+TEST(EpochManager_SafeEpochStopsAtEnteredThreads)
+{
+    EpochManager epochs;
+
+    // With nobody inside, everything unlinked so far can be freed.
+    uint64_t tag = epochs.Advance();
+    EXPECT_TRUE(epochs.SafeEpoch() > tag);
+
+    // A thread that entered holds SafeEpoch at the epoch it saw, however far
+    // the epoch advances.
+    epochs.Enter(3);
+    uint64_t entered = epochs.Advance();
+    for (int i = 0; i < 10; i++) epochs.Advance();
+    EXPECT_EQ(entered, epochs.SafeEpoch());
+
+    // The oldest of several entered threads counts.
+    epochs.Enter(7);
+    epochs.Advance();
+    EXPECT_EQ(entered, epochs.SafeEpoch());
+
+    // Once it leaves, the other one holds SafeEpoch back, and then nobody.
+    epochs.Exit(3);
+    uint64_t safe = epochs.SafeEpoch();
+    EXPECT_TRUE(safe > entered);
+    uint64_t last = epochs.Advance();
+    EXPECT_EQ(safe, epochs.SafeEpoch());
+    epochs.Exit(7);
+    EXPECT_TRUE(epochs.SafeEpoch() > last);
+
+    END;
+}
+
+static void* RecordThreadId(void* arg)
+{
+    *reinterpret_cast<int*>(arg) = EpochManager::ThreadId();
+    return NULL;
+}
+
+const int kThreads = 8;
+pthread_barrier_t all_running;
+int running_ids[kThreads];
+
+// Records the thread's id and keeps it until every thread has one.
+static void* HoldThreadId(void* arg)
+{
+    running_ids[reinterpret_cast<intptr_t>(arg)] = EpochManager::ThreadId();
+    pthread_barrier_wait(&all_running);
+    return NULL;
+}
+
+TEST(EpochManager_ThreadIds)
+{
+    // A thread keeps its id.
+    int mine = EpochManager::ThreadId();
+    EXPECT_EQ(mine, EpochManager::ThreadId());
+
+    // Threads running at the same time get distinct ids.
+    pthread_barrier_init(&all_running, NULL, kThreads);
+    pthread_t threads[kThreads];
+    for (intptr_t i = 0; i < kThreads; i++) pthread_create(&threads[i], NULL, HoldThreadId, reinterpret_cast<void*>(i));
+    for (int i = 0; i < kThreads; i++) pthread_join(threads[i], NULL);
+    pthread_barrier_destroy(&all_running);
+    set<int> running(running_ids, running_ids + kThreads);
+    running.insert(mine);
+    EXPECT_EQ(kThreads + 1, running.size());
+
+    // Ids of exited threads are handed out again, so many short-lived threads
+    // never run out of them.
+    set<int> seen;
+    for (int i = 0; i < 4 * EpochManager::kMaxThreads; i++)
+    {
+        int id;
+        pthread_t thread;
+        pthread_create(&thread, NULL, RecordThreadId, &id);
+        pthread_join(thread, NULL);
+        seen.insert(id);
+    }
+    EXPECT_TRUE(static_cast<int>(seen.size()) < EpochManager::kMaxThreads);
+    EXPECT_EQ(0, seen.count(mine));
+
+    END;
+}
+
+int main(int argc, char** argv)
+{
+    EpochManager_SafeEpochStopsAtEnteredThreads();
+    EpochManager_ThreadIds();
+}
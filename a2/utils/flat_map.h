@@ -0,0 +1,144 @@
+
+#ifndef _DB_UTILS_FLAT_MAP_H_
+#define _DB_UTILS_FLAT_MAP_H_
+
+#include <algorithm>
+#include <map>
+#include <set>
+#include <utility>
+
+#include "utils/small_vector.h"
+
+/// @class FlatSet<T, N>
+///
+/// Sorted set stored in a SmallVector<T, N>, with the subset of the std::set
+/// interface used on txn read and write sets. A set of up to N elements lives
+/// entirely inside the object: no allocation, and iteration walks contiguous
+/// memory. Inserting and erasing shift the elements after the position, so
+/// FlatSet is meant for small sets.
+///
+/// Iterators are plain pointers and are invalidated by insert and erase.
+template <typename T, int N>
+class FlatSet
+{
+   public:
+    typedef const T* iterator;
+    typedef const T* const_iterator;
+
+    FlatSet() {}
+    FlatSet(const std::set<T>& s)
+    {
+        elements_.Reserve(s.size());
+        for (typename std::set<T>::const_iterator it = s.begin(); it != s.end(); ++it) elements_.push_back(*it);
+    }
+
+    iterator begin() const { return elements_.begin(); }
+    iterator end() const { return elements_.end(); }
+    int size() const { return elements_.size(); }
+    bool empty() const { return elements_.empty(); }
+    void clear() { elements_.clear(); }
+    iterator find(const T& value) const
+    {
+        iterator it = LowerBound(value);
+        return it != end() && *it == value ? it : end();
+    }
+
+    int count(const T& value) const { return find(value) != end(); }
+    // Inserts 'value' unless it is already present. Returns an iterator to the
+    // element and whether it was inserted.
+    std::pair<iterator, bool> insert(const T& value)
+    {
+        iterator it = LowerBound(value);
+        if (it != end() && *it == value) return std::make_pair(it, false);
+        return std::make_pair(elements_.insert(const_cast<T*>(it), value), true);
+    }
+
+    // Removes 'value' if present, and returns the number of elements removed.
+    int erase(const T& value)
+    {
+        iterator it = find(value);
+        if (it == end()) return 0;
+        elements_.erase(const_cast<T*>(it));
+        return 1;
+    }
+
+   private:
+    iterator LowerBound(const T& value) const { return std::lower_bound(begin(), end(), value); }
+    SmallVector<T, N> elements_;
+};
+
+/// @class FlatMap<K, V, N>
+///
+/// Sorted map stored in a SmallVector of N (first, second) entries, with the
+/// subset of the std::map interface used on txn read and write buffers. Like
+/// FlatSet, a map of up to N entries never allocates. K and V must be
+/// trivially copyable.
+///
+/// Iterators are plain pointers and are invalidated by operator[] (when it
+/// inserts) and erase.
+template <typename K, typename V, int N>
+class FlatMap
+{
+   public:
+    struct Entry
+    {
+        K first;
+        V second;
+    };
+    typedef Entry* iterator;
+    typedef const Entry* const_iterator;
+
+    FlatMap() {}
+    FlatMap(const std::map<K, V>& m)
+    {
+        entries_.Reserve(m.size());
+        for (typename std::map<K, V>::const_iterator it = m.begin(); it != m.end(); ++it)
+        {
+            Entry entry = {it->first, it->second};
+            entries_.push_back(entry);
+        }
+    }
+
+    iterator begin() { return entries_.begin(); }
+    iterator end() { return entries_.end(); }
+    const_iterator begin() const { return entries_.begin(); }
+    const_iterator end() const { return entries_.end(); }
+    int size() const { return entries_.size(); }
+    bool empty() const { return entries_.empty(); }
+    void clear() { entries_.clear(); }
+    iterator find(const K& key)
+    {
+        iterator it = LowerBound(key);
+        return it != end() && it->first == key ? it : end();
+    }
+
+    int count(const K& key) { return find(key) != end(); }
+    // Returns the value of 'key', inserting a value-initialized one first if
+    // there is none.
+    V& operator[](const K& key)
+    {
+        iterator it = LowerBound(key);
+        if (it == end() || it->first != key)
+        {
+            Entry entry = {key, V()};
+            it          = entries_.insert(it, entry);
+        }
+        return it->second;
+    }
+
+    // Removes 'key' if present, and returns the number of entries removed.
+    int erase(const K& key)
+    {
+        iterator it = find(key);
+        if (it == end()) return 0;
+        entries_.erase(it);
+        return 1;
+    }
+
+   private:
+    static bool KeyLess(const Entry& entry, const K& key) { return entry.first < key; }
+    iterator LowerBound(const K& key) { return std::lower_bound(begin(), end(), key, KeyLess); }
+    SmallVector<Entry, N> entries_;
+};
+
+#endif  // _DB_UTILS_FLAT_MAP_H_
@@ -0,0 +1,138 @@
+#include "utils/flat_map.h"
+
+#include <stdint.h>
+#include <map>
+#include <set>
+
+#include "utils/testing.h"
+
+TEST(FlatSet_SortedInsertErase)
+{
+    FlatSet<uint64_t, 4> s;
+    uint64_t values[] = {5, 1, 9, 3, 7, 1, 5};
+    for (int i = 0; i < 7; i++) s.insert(values[i]);
+
+    // Duplicates are dropped, and the set stays sorted past its inline size.
+    EXPECT_EQ(5, s.size());
+    EXPECT_FALSE(s.insert(9).second);
+    EXPECT_TRUE(s.insert(0).second);
+    uint64_t expected[] = {0, 1, 3, 5, 7, 9};
+    bool sorted         = true;
+    int i               = 0;
+    for (FlatSet<uint64_t, 4>::iterator it = s.begin(); it != s.end(); ++it) sorted = sorted && *it == expected[i++];
+    EXPECT_TRUE(sorted);
+    EXPECT_EQ(6, i);
+
+    EXPECT_EQ(1, s.erase(0));
+    EXPECT_EQ(1, s.erase(9));
+    EXPECT_EQ(0, s.erase(4));
+    EXPECT_EQ(4, s.size());
+    EXPECT_TRUE(*s.begin() == 1);
+    EXPECT_TRUE(*(s.end() - 1) == 7);
+
+    END;
+}
+
+TEST(FlatSet_FindAtBoundaries)
+{
+    FlatSet<uint64_t, 4> s;
+    EXPECT_TRUE(s.find(0) == s.end());
+    EXPECT_EQ(0, s.count(0));
+
+    std::set<uint64_t> source;
+    source.insert(10);
+    source.insert(20);
+    source.insert(30);
+    FlatSet<uint64_t, 4> t(source);
+
+    // The first and last elements, and values before, between and after them.
+    EXPECT_TRUE(t.find(10) == t.begin());
+    EXPECT_TRUE(t.find(30) == t.end() - 1);
+    EXPECT_EQ(1, t.count(10));
+    EXPECT_EQ(1, t.count(30));
+    EXPECT_EQ(0, t.count(5));
+    EXPECT_EQ(0, t.count(15));
+    EXPECT_EQ(0, t.count(35));
+
+    END;
+}
+
+TEST(FlatMap_SortedInsertErase)
+{
+    FlatMap<uint64_t, uint64_t, 2> m;
+    m[30] = 3;
+    m[10] = 1;
+    m[20] = 2;
+    m[10] += 10;
+    EXPECT_EQ(3, m.size());
+    EXPECT_EQ(11, m[10]);
+
+    uint64_t keys[] = {10, 20, 30};
+    bool sorted     = true;
+    int i           = 0;
+    for (FlatMap<uint64_t, uint64_t, 2>::iterator it = m.begin(); it != m.end(); ++it)
+    {
+        sorted = sorted && it->first == keys[i++];
+    }
+    EXPECT_TRUE(sorted);
+
+    // operator[] on a missing key inserts a zero.
+    EXPECT_EQ(0, m[25]);
+    EXPECT_EQ(4, m.size());
+    EXPECT_EQ(1, m.erase(25));
+    EXPECT_EQ(0, m.erase(25));
+    EXPECT_EQ(1, m.erase(10));
+    EXPECT_EQ(2, m.size());
+    EXPECT_TRUE(m.begin()->first == 20);
+
+    END;
+}
+
+TEST(FlatMap_FindAtBoundaries)
+{
+    std::map<uint64_t, uint64_t> source;
+    source[1]   = 100;
+    source[500] = 200;
+    FlatMap<uint64_t, uint64_t, 4> m(source);
+
+    EXPECT_TRUE(m.find(1) == m.begin());
+    EXPECT_TRUE(m.find(500) == m.end() - 1);
+    EXPECT_EQ(200, m.find(500)->second);
+    EXPECT_TRUE(m.find(0) == m.end());
+    EXPECT_TRUE(m.find(2) == m.end());
+    EXPECT_TRUE(m.find(501) == m.end());
+    EXPECT_EQ(0, m.count(499));
+
+    m.clear();
+    EXPECT_TRUE(m.empty());
+    EXPECT_TRUE(m.find(1) == m.end());
+
+    END;
+}
+
+TEST(FlatMap_CopyAndMove)
+{
+    FlatMap<uint64_t, uint64_t, 2> m;
+    for (uint64_t i = 0; i < 8; i++) m[i] = i * i;
+
+    FlatMap<uint64_t, uint64_t, 2> copy(m);
+    copy[3] = 0;
+    EXPECT_EQ(9, m[3]);
+    EXPECT_EQ(8, copy.size());
+
+    FlatMap<uint64_t, uint64_t, 2> moved(std::move(copy));
+    EXPECT_EQ(8, moved.size());
+    EXPECT_EQ(0, moved[3]);
+    EXPECT_EQ(49, moved[7]);
+
+    END;
+}
+
+int main(int argc, char** argv)
+{
+    FlatSet_SortedInsertErase();
+    FlatSet_FindAtBoundaries();
+    FlatMap_SortedInsertErase();
+    FlatMap_FindAtBoundaries();
+    FlatMap_CopyAndMove();
+}
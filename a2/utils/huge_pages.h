@@ -0,0 +1,31 @@
+
+#ifndef _DB_UTILS_HUGE_PAGES_H_
+#define _DB_UTILS_HUGE_PAGES_H_
+
+#include <stddef.h>
+#include <sys/mman.h>
+
+// Size of a huge page. Mappings are rounded up to a multiple of it.
+#define HUGE_PAGE_SIZE (2 * 1024 * 1024)
+
+/// Maps at least 'bytes' of zeroed memory, preferably backed by explicit huge
+/// pages, otherwise by transparent ones. Stores the size actually mapped in
+/// '*mapped_bytes' and returns the memory, or NULL if it cannot be mapped.
+static inline void* MapHugePages(size_t bytes, size_t* mapped_bytes)
+{
+    *mapped_bytes = (bytes + HUGE_PAGE_SIZE - 1) / HUGE_PAGE_SIZE * HUGE_PAGE_SIZE;
+
+    void* mem = mmap(NULL, *mapped_bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+    if (mem != MAP_FAILED) return mem;
+
+    mem = mmap(NULL, *mapped_bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (mem == MAP_FAILED) return NULL;
+#ifdef MADV_HUGEPAGE
+    madvise(mem, *mapped_bytes, MADV_HUGEPAGE);
+#endif
+    return mem;
+}
+
+/// Unmaps memory returned by MapHugePages.
+static inline void UnmapHugePages(void* mem, size_t mapped_bytes) { munmap(mem, mapped_bytes); }
+#endif  // _DB_UTILS_HUGE_PAGES_H_
@@ -0,0 +1,139 @@
+
+#ifndef _DB_UTILS_INLINE_TASK_H_
+#define _DB_UTILS_INLINE_TASK_H_
+
+#include <assert.h>
+#include <stddef.h>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+/// @class InlineTask<Capacity>
+///
+/// Move-only replacement for std::function<void()> that stores the callable in
+/// a fixed buffer of 'Capacity' bytes inside the task itself. Constructing,
+/// moving and running a task never allocates; a callable that does not fit is
+/// rejected at compile time instead of silently going to the heap.
+///
+/// A moved-from task is empty. Running an empty task is an error.
+template <size_t Capacity>
+class InlineTask
+{
+   public:
+    InlineTask() : ops_(NULL) {}
+
+    // Wraps any callable 'f' with signature void() that fits in 'Capacity'
+    // bytes.
+    template <typename F,
+              typename = typename std::enable_if<!std::is_same<typename std::decay<F>::type, InlineTask>::value>::type>
+    InlineTask(F&& f) : ops_(OpsFor<typename std::decay<F>::type>())
+    {
+        typedef typename std::decay<F>::type Fn;
+        static_assert(sizeof(Fn) <= Capacity, "callable is too large for this InlineTask");
+        static_assert(alignof(Fn) <= alignof(Storage), "callable is over-aligned for InlineTask");
+        new (&storage_) Fn(std::forward<F>(f));
+    }
+
+    InlineTask(InlineTask&& other) : ops_(other.ops_)
+    {
+        if (ops_ != NULL) ops_->move_(&storage_, &other.storage_);
+        other.ops_ = NULL;
+    }
+
+    InlineTask& operator=(InlineTask&& other)
+    {
+        if (this != &other)
+        {
+            Reset();
+            ops_ = other.ops_;
+            if (ops_ != NULL) ops_->move_(&storage_, &other.storage_);
+            other.ops_ = NULL;
+        }
+        return *this;
+    }
+
+    ~InlineTask() { Reset(); }
+
+    // Runs the wrapped callable.
+    void operator()()
+    {
+        assert(ops_ != NULL);
+        ops_->invoke_(&storage_);
+    }
+
+    // Returns true if the task holds a callable.
+    explicit operator bool() const { return ops_ != NULL; }
+
+    // Destroys the wrapped callable, leaving the task empty.
+    void Reset()
+    {
+        if (ops_ != NULL) ops_->destroy_(&storage_);
+        ops_ = NULL;
+    }
+
+   private:
+    typedef typename std::aligned_storage<Capacity, alignof(void*)>::type Storage;
+
+    // Type-erased operations on the stored callable.
+    struct Ops
+    {
+        void (*invoke_)(void* fn);
+        // Move-constructs the callable at 'dst' from the one at 'src', then
+        // destroys the one at 'src'.
+        void (*move_)(void* dst, void* src);
+        void (*destroy_)(void* fn);
+    };
+
+    template <typename Fn>
+    static void Invoke(void* fn)
+    {
+        (*reinterpret_cast<Fn*>(fn))();
+    }
+
+    template <typename Fn>
+    static void Move(void* dst, void* src)
+    {
+        new (dst) Fn(std::move(*reinterpret_cast<Fn*>(src)));
+        reinterpret_cast<Fn*>(src)->~Fn();
+    }
+
+    template <typename Fn>
+    static void Destroy(void* fn)
+    {
+        reinterpret_cast<Fn*>(fn)->~Fn();
+    }
+
+    template <typename Fn>
+    static const Ops* OpsFor()
+    {
+        static const Ops ops = {&Invoke<Fn>, &Move<Fn>, &Destroy<Fn>};
+        return &ops;
+    }
+
+    // Disallow copying.
+    InlineTask(const InlineTask&);
+    InlineTask& operator=(const InlineTask&);
+
+    const Ops* ops_;
+    Storage storage_;
+};
+
+/// @class MethodTask<C, A>
+///
+/// Callable that runs 'obj->method(arg)'. Two pointers plus a member function
+/// pointer, so it always fits in a ThreadPool::Task; e.g. a TxnProcessor hands
+/// a txn to a worker with MethodTask<TxnProcessor, Txn*>(this,
+/// &TxnProcessor::ExecuteTxn, txn).
+template <typename C, typename A>
+class MethodTask
+{
+   public:
+    MethodTask(C* obj, void (C::*method)(A), A arg) : obj_(obj), method_(method), arg_(arg) {}
+    void operator()() { (obj_->*method_)(arg_); }
+   private:
+    C* obj_;
+    void (C::*method_)(A);
+    A arg_;
+};
+
+#endif  // _DB_UTILS_INLINE_TASK_H_
@@ -0,0 +1,100 @@
+
+#include "utils/mutex.h"
+
+#include <limits.h>
+#include <stdint.h>
+#include <unistd.h>
+#if defined(__linux__)
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#endif
+
+#include "utils/clock.h"
+
+// Bit i is set while some running thread holds id i.
+static std::atomic<uint64_t> claimed_thread_ids(0);
+
+namespace
+{
+// Releases the calling thread's id when the thread exits.
+struct ThreadIdHolder
+{
+    int id_;
+    ThreadIdHolder() : id_(-1) {}
+    ~ThreadIdHolder()
+    {
+        if (id_ >= 0) claimed_thread_ids.fetch_and(~(1ull << id_));
+    }
+};
+}  // namespace
+
+static_assert(MAX_THREAD_IDS == 64, "thread ids are a 64-bit bitmap");
+
+int ClaimThreadId()
+{
+    static thread_local ThreadIdHolder holder;
+    if (holder.id_ >= 0) return holder.id_;
+
+    uint64_t claimed = claimed_thread_ids.load();
+    while (~claimed != 0)
+    {
+        int id = __builtin_ctzll(~claimed);
+        if (claimed_thread_ids.compare_exchange_weak(claimed, claimed | (1ull << id)))
+        {
+            holder.id_ = id;
+            return id;
+        }
+    }
+    return -1;
+}
+
+void ScalableMutexRW::ReadLockSlow()
+{
+    lock_.ReadLock();
+    if (!__atomic_load_n(&read_bias_, __ATOMIC_RELAXED) &&
+        CycleClock::Ticks() >= __atomic_load_n(&inhibit_until_, __ATOMIC_RELAXED))
+    {
+        __atomic_store_n(&read_bias_, true, __ATOMIC_SEQ_CST);
+    }
+}
+
+bool ScalableMutexRW::RevokeBias(bool wait)
+{
+    uint64_t start = CycleClock::Ticks();
+    __atomic_store_n(&read_bias_, false, __ATOMIC_SEQ_CST);
+    bool drained = true;
+    for (int i = 0; drained && i < MAX_THREAD_IDS; i++)
+    {
+        SpinWait spin;
+        while (__atomic_load_n(&readers_[i].count_, __ATOMIC_SEQ_CST) != 0)
+        {
+            if (!wait)
+            {
+                drained = false;
+                break;
+            }
+            spin.Wait();
+        }
+    }
+    uint64_t end = CycleClock::Ticks();
+    __atomic_store_n(&inhibit_until_, end + (end - start) * kInhibitFactor, __ATOMIC_RELAXED);
+    return drained;
+}
+
+#if defined(__linux__)
+void Futex::Wait(int expected)
+{
+    syscall(SYS_futex, reinterpret_cast<int*>(&word_), FUTEX_WAIT_PRIVATE, expected, NULL, NULL, 0);
+}
+
+void Futex::WakeOne() { syscall(SYS_futex, reinterpret_cast<int*>(&word_), FUTEX_WAKE_PRIVATE, 1, NULL, NULL, 0); }
+void Futex::WakeAll() { syscall(SYS_futex, reinterpret_cast<int*>(&word_), FUTEX_WAKE_PRIVATE, INT_MAX, NULL, NULL, 0); }
+#else
+void Futex::Wait(int expected)
+{
+    if (Load() == expected) usleep(50);
+}
+
+void Futex::WakeOne() {}
+void Futex::WakeAll() {}
+#endif
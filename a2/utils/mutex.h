@@ -3,6 +3,71 @@
 #define _DB_UTILS_MUTEX_H_
 
 #include <pthread.h>
+#include <sched.h>
+#include <stdint.h>
+#include <atomic>
+
+// Size of a cache line on the machines we run on. Used to pad hot atomics so
+// that they do not false-share with their neighbours.
+#define CACHE_LINE_SIZE 64
+
+// Number of thread ids ClaimThreadId() can hand out at the same time.
+#define MAX_THREAD_IDS 64
+
+// Claims an id below MAX_THREAD_IDS that no other running thread holds, or
+// returns -1 if all of them are taken. The id is handed back when the calling
+// thread exits. Use ThisThreadId() instead.
+int ClaimThreadId();
+
+// The calling thread's id from ClaimThreadId(), or -2 until ThisThreadId()
+// first asks for it. Each translation unit caches it separately.
+static thread_local int this_thread_id = -2;
+
+// Returns the calling thread's id from ClaimThreadId(), claiming it on the
+// first call.
+static inline int ThisThreadId()
+{
+    if (this_thread_id == -2) this_thread_id = ClaimThreadId();
+    return this_thread_id;
+}
+
+// Hints to the processor that the caller is spinning.
+static inline void CpuRelax()
+{
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#elif defined(__aarch64__)
+    asm volatile("yield");
+#endif
+}
+
+/// @class SpinWait
+///
+/// Bounded exponential backoff for spin loops: spins for 1, 2, 4, ... pause
+/// instructions, then falls back to yielding the processor so that spinning
+/// never starves the thread it is waiting for.
+class SpinWait
+{
+   public:
+    SpinWait() : count_(0) {}
+    inline void Wait()
+    {
+        if (count_ < kMaxSpinShift)
+        {
+            for (int i = 0; i < (1 << count_); i++) CpuRelax();
+            count_++;
+        }
+        else
+        {
+            sched_yield();
+        }
+    }
+
+    inline void Reset() { count_ = 0; }
+   private:
+    static const int kMaxSpinShift = 10;
+    int count_;
+};
 
 /// @class Mutex
 ///
@@ -29,6 +94,229 @@ class Mutex
     pthread_mutex_t mutex_;
 };
 
+// The following spinlocks are drop-in alternatives to Mutex (same Lock /
+// TryLock / Unlock interface) for critical sections that are only a few dozen
+// nanoseconds long, where futex syscalls and wakeup latency would dominate.
+// All of them back off with SpinWait, so a waiter yields the processor if the
+// holder has been descheduled.
+
+/// @class TTASLock
+///
+/// Test-and-test-and-set spinlock. Waiters spin on a plain load (which hits in
+/// their own cache) and only attempt the atomic exchange once the lock looks
+/// free. Unfair, and all waiters stampede when the lock is released.
+class TTASLock
+{
+   public:
+    TTASLock() : locked_(false) {}
+    inline void Lock()
+    {
+        SpinWait spin;
+        while (true)
+        {
+            if (!locked_.load(std::memory_order_relaxed) && !locked_.exchange(true, std::memory_order_acquire))
+            {
+                return;
+            }
+            spin.Wait();
+        }
+    }
+
+    inline bool TryLock()
+    {
+        return !locked_.load(std::memory_order_relaxed) && !locked_.exchange(true, std::memory_order_acquire);
+    }
+
+    inline void Unlock() { locked_.store(false, std::memory_order_release); }
+   private:
+    std::atomic<bool> locked_;
+};
+
+/// @class TicketLock
+///
+/// FIFO spinlock. Each waiter takes a ticket and waits until it is served, so
+/// the lock is fair, at the cost of every release invalidating every waiter's
+/// cached copy of 'now_serving_'.
+class TicketLock
+{
+   public:
+    TicketLock() : next_ticket_(0), now_serving_(0) {}
+    inline void Lock()
+    {
+        unsigned ticket = next_ticket_.fetch_add(1, std::memory_order_relaxed);
+        SpinWait spin;
+        while (now_serving_.load(std::memory_order_acquire) != ticket) spin.Wait();
+    }
+
+    inline bool TryLock()
+    {
+        unsigned ticket = now_serving_.load(std::memory_order_relaxed);
+        unsigned next   = ticket;
+        return next_ticket_.compare_exchange_strong(next, ticket + 1, std::memory_order_acquire,
+                                                    std::memory_order_relaxed);
+    }
+
+    inline void Unlock()
+    {
+        now_serving_.store(now_serving_.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+    }
+
+   private:
+    std::atomic<unsigned> next_ticket_;
+    char pad_[CACHE_LINE_SIZE - sizeof(std::atomic<unsigned>)];
+    std::atomic<unsigned> now_serving_;
+};
+
+/// @class MCSLock
+///
+/// Queue-based spinlock (Mellor-Crummey and Scott). Waiters form a linked
+/// queue and each spins on a flag in its own queue node, so a release
+/// invalidates exactly one waiter's cache line. FIFO like TicketLock.
+///
+/// Queue nodes come from a small per-thread free list, so callers use the same
+/// Lock/Unlock interface as Mutex instead of passing nodes around.
+class MCSLock
+{
+   public:
+    MCSLock() : tail_(NULL), holder_(NULL) {}
+    inline void Lock()
+    {
+        Node* node = AcquireNode();
+        Node* pred = tail_.exchange(node, std::memory_order_acq_rel);
+        if (pred != NULL)
+        {
+            pred->next_.store(node, std::memory_order_release);
+            SpinWait spin;
+            while (node->locked_.load(std::memory_order_acquire)) spin.Wait();
+        }
+        holder_ = node;
+    }
+
+    inline bool TryLock()
+    {
+        Node* node     = AcquireNode();
+        Node* expected = NULL;
+        if (tail_.compare_exchange_strong(expected, node, std::memory_order_acq_rel, std::memory_order_relaxed))
+        {
+            holder_ = node;
+            return true;
+        }
+        ReleaseNode(node);
+        return false;
+    }
+
+    inline void Unlock()
+    {
+        Node* node = holder_;
+        Node* next = node->next_.load(std::memory_order_acquire);
+        if (next == NULL)
+        {
+            // No known successor: try to swing the tail back to empty.
+            Node* expected = node;
+            if (tail_.compare_exchange_strong(expected, NULL, std::memory_order_acq_rel, std::memory_order_relaxed))
+            {
+                ReleaseNode(node);
+                return;
+            }
+
+            // A successor has swapped itself in but not linked itself yet.
+            SpinWait spin;
+            while ((next = node->next_.load(std::memory_order_acquire)) == NULL) spin.Wait();
+        }
+        next->locked_.store(false, std::memory_order_release);
+        ReleaseNode(node);
+    }
+
+   private:
+    struct Node
+    {
+        std::atomic<Node*> next_;
+        std::atomic<bool> locked_;
+        char pad_[CACHE_LINE_SIZE - sizeof(std::atomic<Node*>) - sizeof(std::atomic<bool>)];
+    };
+
+    // Per-thread free list of queue nodes, deleted when the thread exits.
+    struct NodeCache
+    {
+        NodeCache() : free_(NULL) {}
+        ~NodeCache()
+        {
+            while (free_ != NULL)
+            {
+                Node* next = free_->next_.load(std::memory_order_relaxed);
+                delete free_;
+                free_ = next;
+            }
+        }
+        Node* free_;
+    };
+
+    static inline NodeCache& ThisThreadNodes()
+    {
+        static thread_local NodeCache cache;
+        return cache;
+    }
+
+    // Returns a node ready to be enqueued.
+    static inline Node* AcquireNode()
+    {
+        NodeCache& cache = ThisThreadNodes();
+        Node* node       = cache.free_;
+        if (node != NULL)
+        {
+            cache.free_ = node->next_.load(std::memory_order_relaxed);
+        }
+        else
+        {
+            node = new Node();
+        }
+        node->next_.store(NULL, std::memory_order_relaxed);
+        node->locked_.store(true, std::memory_order_relaxed);
+        return node;
+    }
+
+    // Returns 'node' to the calling thread's free list. Once a lock has been
+    // handed off (or the queue emptied), no other thread references the node.
+    static inline void ReleaseNode(Node* node)
+    {
+        NodeCache& cache = ThisThreadNodes();
+        node->next_.store(cache.free_, std::memory_order_relaxed);
+        cache.free_ = node;
+    }
+
+    // Last node in the queue of holders/waiters, or NULL if the lock is free.
+    std::atomic<Node*> tail_;
+
+    // Queue node of the current holder. Only accessed by the holder.
+    Node* holder_;
+};
+
+/// @class Futex
+///
+/// A 32-bit word that threads can sleep on until another thread changes it, a
+/// thin wrapper around the Linux futex syscall (on other platforms, waiting
+/// degrades to a short sleep). Used to park idle threads instead of polling.
+class Futex
+{
+   public:
+    Futex() : word_(0) {}
+    /// Returns the current value of the word.
+    inline int Load() { return word_.load(std::memory_order_acquire); }
+    /// Increments the word and returns the new value. Combined with WakeOne or
+    /// WakeAll, this is how a waiter blocked on the old value is released.
+    inline int Increment() { return word_.fetch_add(1, std::memory_order_acq_rel) + 1; }
+    /// Blocks the caller as long as the word equals 'expected'. May return
+    /// spuriously, so callers re-check their condition in a loop.
+    void Wait(int expected);
+    /// Wakes at most one thread blocked in Wait().
+    void WakeOne();
+    /// Wakes all threads blocked in Wait().
+    void WakeAll();
+
+   private:
+    std::atomic<int> word_;
+};
+
 /// @class MutexRW
 ///
 /// A single-writer multiple-reader mutex, actually a thin wrapper around
@@ -57,4 +345,125 @@ class MutexRW
     pthread_rwlock_t rwlock_;
 };
 
+/// @class ScalableMutexRW
+///
+/// A reader-biased single-writer multiple-reader mutex with the same interface
+/// as MutexRW, after BRAVO (Dice and Kogan, 2019).
+///
+/// While the lock is read-biased, a reader announces itself in an indicator of
+/// its own, one cache line per ThisThreadId(), and then checks that the bias
+/// still holds: a store and a fence, with no read-modify-write on a line other
+/// readers write. Everything else goes through an underlying MutexRW. A writer
+/// takes that lock, revokes the bias and waits for the indicators to drain.
+/// Since that scan is expensive, the bias stays off for a while afterwards
+/// (kInhibitFactor times as long as the revocation took), so that
+/// write-heavy phases run at the speed of a plain MutexRW; the first reader on
+/// the slow path after that turns it back on.
+///
+/// The lock takes MAX_THREAD_IDS cache lines, so it suits read-mostly
+/// structures, not per-record locks. Threads beyond MAX_THREAD_IDS always take
+/// the slow path.
+///
+/// The bias and the indicators are accessed with the __atomic builtins rather
+/// than std::atomic, whose member functions are not inlined in our unoptimized
+/// builds and would cost the fast path more than the pthread call it replaces.
+class ScalableMutexRW
+{
+   public:
+    static const int kInhibitFactor = 9;
+
+    /// Mutexes come into the world unlocked.
+    ScalableMutexRW() : read_bias_(true), inhibit_until_(0)
+    {
+        for (int i = 0; i < MAX_THREAD_IDS; i++) readers_[i].count_ = 0;
+    }
+
+    /// Locks a mutex. Blocks until the mutex has been successfully acquired.
+    inline void ReadLock()
+    {
+        if (!TryFastReadLock()) ReadLockSlow();
+    }
+
+    /// Locks a mutex. Blocks until the mutex has been successfully acquired.
+    inline void WriteLock()
+    {
+        lock_.WriteLock();
+        if (__atomic_load_n(&read_bias_, __ATOMIC_RELAXED)) RevokeBias(true);
+    }
+
+    /// Attempts to acquire a read lock. If the mutex is not write-locked,
+    /// read-locks it and returns true, else returns false.
+    inline bool TryReadLock() { return TryFastReadLock() || lock_.TryReadLock(); }
+    /// Attempts to acquire a write lock. If the mutex is unlocked, write-locks
+    /// it and returns true, else returns false.
+    inline bool TryWriteLock()
+    {
+        if (!lock_.TryWriteLock()) return false;
+        if (!__atomic_load_n(&read_bias_, __ATOMIC_RELAXED) || RevokeBias(false)) return true;
+        lock_.Unlock();
+        return false;
+    }
+
+    /// Releases an already held lock on a mutex.
+    ///
+    /// Requires: A lock is already held on the mutex.
+    inline void Unlock()
+    {
+        // Only the thread itself writes its indicator, so a non-zero count
+        // means it holds a fast-path read lock.
+        int id = ThisThreadId();
+        if (id >= 0 && readers_[id].count_ > 0)
+        {
+            __atomic_store_n(&readers_[id].count_, readers_[id].count_ - 1, __ATOMIC_RELEASE);
+            return;
+        }
+        lock_.Unlock();
+    }
+
+   private:
+    // Read-locks the mutex through its indicator if it is read-biased.
+    inline bool TryFastReadLock()
+    {
+        int id = ThisThreadId();
+        if (id < 0 || !__atomic_load_n(&read_bias_, __ATOMIC_RELAXED)) return false;
+
+        // The store must be visible before we look at 'read_bias_' (and a
+        // writer's store to 'read_bias_' before it looks at our indicator),
+        // hence the sequentially consistent ordering.
+        int* count = &readers_[id].count_;
+        int held   = *count;
+        __atomic_store_n(count, held + 1, __ATOMIC_SEQ_CST);
+        if (__atomic_load_n(&read_bias_, __ATOMIC_SEQ_CST)) return true;
+        __atomic_store_n(count, held, __ATOMIC_RELEASE);
+        return false;
+    }
+
+    // Read-locks the underlying lock, and restores the bias if it has been off
+    // for long enough.
+    void ReadLockSlow();
+
+    // Turns the bias off and waits for fast-path readers to leave, or, if
+    // 'wait' is false, returns false if there are any. The caller holds the
+    // underlying write lock.
+    bool RevokeBias(bool wait);
+
+    struct ReaderSlot
+    {
+        int count_;
+        char pad_[CACHE_LINE_SIZE - sizeof(int)];
+    };
+
+    // Whether readers may take the fast path, and the CycleClock tick before
+    // which the slow path leaves it off. Read by every reader, written only
+    // when the bias changes.
+    bool read_bias_;
+    uint64_t inhibit_until_;
+    char pad_[CACHE_LINE_SIZE - sizeof(bool) - sizeof(uint64_t)];
+
+    // Fast-path read locks held by each thread, by ThisThreadId().
+    ReaderSlot readers_[MAX_THREAD_IDS];
+
+    MutexRW lock_;
+};
+
 #endif  // _DB_UTILS_MUTEX_H_
@@ -0,0 +1,289 @@
+
+#include "utils/mutex.h"
+
+#include <stdint.h>
+#include <time.h>
+#include <unistd.h>
+#include <vector>
+
+#include "utils/testing.h"
+
+using std::vector;
+
+// Returns a monotonic time in seconds.
+static double Now()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// State shared by the threads of one run.
+template <typename RWLock>
+struct RWLockRun
+{
+    RWLock lock;
+    uint64_t a;
+    uint64_t b;
+    int write_every;  // Every write_every-th operation is a write.
+    std::atomic<bool> stopped;
+    std::atomic<uint64_t> ops;
+    std::atomic<bool> torn;
+};
+
+// Each thread reads (a, b) under a read lock, checking that they are never
+// observed mid-update, and periodically increments both under a write lock.
+template <typename RWLock>
+void* RWLockWorker(void* arg)
+{
+    RWLockRun<RWLock>* run = reinterpret_cast<RWLockRun<RWLock>*>(arg);
+    uint64_t ops           = 0;
+    while (!run->stopped.load(std::memory_order_relaxed))
+    {
+        if (run->write_every > 0 && ops % run->write_every == 0)
+        {
+            run->lock.WriteLock();
+            run->a++;
+            run->b++;
+            run->lock.Unlock();
+        }
+        else
+        {
+            run->lock.ReadLock();
+            if (run->a != run->b) run->torn.store(true);
+            run->lock.Unlock();
+        }
+        ops++;
+    }
+    run->ops.fetch_add(ops);
+    return NULL;
+}
+
+// Runs 'threads' workers for 'duration' seconds and returns the throughput in
+// millions of lock acquisitions per second. Sets '*torn' if any reader saw a
+// partial update.
+template <typename RWLock>
+double RunRWLock(int threads, int write_every, double duration, bool* torn)
+{
+    RWLockRun<RWLock>* run = new RWLockRun<RWLock>();
+    run->a                 = 0;
+    run->b                 = 0;
+    run->write_every       = write_every;
+    run->stopped.store(false);
+    run->ops.store(0);
+    run->torn.store(false);
+
+    vector<pthread_t> tids(threads);
+    double start = Now();
+    for (int i = 0; i < threads; i++) pthread_create(&tids[i], NULL, RWLockWorker<RWLock>, run);
+    while (Now() < start + duration) usleep(1000);
+    run->stopped.store(true);
+    for (int i = 0; i < threads; i++) pthread_join(tids[i], NULL);
+    double end = Now();
+
+    *torn             = run->torn.load();
+    double throughput = run->ops.load() / (end - start) / 1e6;
+    delete run;
+    return throughput;
+}
+
+// State shared by the threads of one run.
+template <typename Lock>
+struct LockRun
+{
+    Lock lock;
+    uint64_t a;
+    uint64_t b;
+    std::atomic<bool> stopped;
+    std::atomic<uint64_t> ops;
+    std::atomic<bool> torn;
+};
+
+// Each thread repeatedly runs a tiny critical section that increments (a, b)
+// and checks that no other thread was inside at the same time.
+template <typename Lock>
+void* LockWorker(void* arg)
+{
+    LockRun<Lock>* run = reinterpret_cast<LockRun<Lock>*>(arg);
+    uint64_t ops       = 0;
+    while (!run->stopped.load(std::memory_order_relaxed))
+    {
+        run->lock.Lock();
+        uint64_t a = ++run->a;
+        if (++run->b != a) run->torn.store(true);
+        run->lock.Unlock();
+        ops++;
+    }
+    run->ops.fetch_add(ops);
+    return NULL;
+}
+
+// Runs 'threads' workers for 'duration' seconds and returns the throughput in
+// millions of critical sections per second. Sets '*torn' if mutual exclusion
+// was violated.
+template <typename Lock>
+double RunLock(int threads, double duration, bool* torn)
+{
+    LockRun<Lock>* run = new LockRun<Lock>();
+    run->a             = 0;
+    run->b             = 0;
+    run->stopped.store(false);
+    run->ops.store(0);
+    run->torn.store(false);
+
+    vector<pthread_t> tids(threads);
+    double start = Now();
+    for (int i = 0; i < threads; i++) pthread_create(&tids[i], NULL, LockWorker<Lock>, run);
+    while (Now() < start + duration) usleep(1000);
+    run->stopped.store(true);
+    for (int i = 0; i < threads; i++) pthread_join(tids[i], NULL);
+    double end = Now();
+
+    *torn             = run->torn.load() || run->a != run->ops.load();
+    double throughput = run->ops.load() / (end - start) / 1e6;
+    delete run;
+    return throughput;
+}
+
+template <typename Lock>
+void CheckLock()
+{
+    bool torn;
+    RunLock<Lock>(8, 0.1, &torn);
+    EXPECT_FALSE(torn);
+
+    Lock lock;
+    EXPECT_TRUE(lock.TryLock());
+    EXPECT_FALSE(lock.TryLock());
+    lock.Unlock();
+    lock.Lock();
+    EXPECT_FALSE(lock.TryLock());
+    lock.Unlock();
+    EXPECT_TRUE(lock.TryLock());
+    lock.Unlock();
+}
+
+TEST(SpinLocks_Exclusion)
+{
+    CheckLock<Mutex>();
+    CheckLock<TTASLock>();
+    CheckLock<TicketLock>();
+    CheckLock<MCSLock>();
+
+    END;
+}
+
+TEST(ScalableMutexRW_Exclusion)
+{
+    bool torn;
+    RunRWLock<ScalableMutexRW>(8, 10, 0.2, &torn);
+    EXPECT_FALSE(torn);
+
+    // More threads than there are thread ids, so that some read on the slow
+    // path while others use their indicators.
+    RunRWLock<ScalableMutexRW>(MAX_THREAD_IDS + 16, 10, 0.2, &torn);
+    EXPECT_FALSE(torn);
+
+    ScalableMutexRW lock;
+    EXPECT_TRUE(lock.TryReadLock());
+    EXPECT_TRUE(lock.TryReadLock());
+    EXPECT_FALSE(lock.TryWriteLock());
+    lock.Unlock();
+    lock.Unlock();
+    EXPECT_TRUE(lock.TryWriteLock());
+    EXPECT_FALSE(lock.TryReadLock());
+    lock.Unlock();
+    EXPECT_TRUE(lock.TryReadLock());
+    lock.Unlock();
+
+    END;
+}
+
+struct BiasedWriter
+{
+    ScalableMutexRW* lock_;
+    std::atomic<bool> done_;
+};
+
+static void* WriteOnce(void* arg)
+{
+    BiasedWriter* writer = reinterpret_cast<BiasedWriter*>(arg);
+    writer->lock_->WriteLock();
+    writer->done_.store(true);
+    writer->lock_->Unlock();
+    return NULL;
+}
+
+TEST(ScalableMutexRW_WriterWaitsForFastReaders)
+{
+    // A fresh lock is read-biased, so this read lock is only in the reader's
+    // indicator; the writer has to revoke the bias and wait for it.
+    ScalableMutexRW lock;
+    lock.ReadLock();
+    lock.ReadLock();
+    BiasedWriter writer;
+    writer.lock_ = &lock;
+    writer.done_.store(false);
+    pthread_t thread;
+    pthread_create(&thread, NULL, WriteOnce, &writer);
+    usleep(20000);
+    EXPECT_FALSE(writer.done_.load());
+    lock.Unlock();
+    usleep(20000);
+    EXPECT_FALSE(writer.done_.load());
+    lock.Unlock();
+    pthread_join(thread, NULL);
+    EXPECT_TRUE(writer.done_.load());
+
+    // Readers after the revocation take the slow path, and still exclude
+    // writers.
+    lock.ReadLock();
+    EXPECT_FALSE(lock.TryWriteLock());
+    lock.Unlock();
+    EXPECT_TRUE(lock.TryWriteLock());
+    lock.Unlock();
+
+    END;
+}
+
+// Read-mostly microbenchmark: pthread rwlock (MutexRW) against the
+// reader-biased ScalableMutexRW at 1-64 threads.
+void BenchmarkRWLocks()
+{
+    cout << "\t\tRead-mostly rwlock throughput (Mops/s, 1 write per 1000 ops)" << endl;
+    cout << "\t\t-----------------------------------------------------------" << endl;
+    cout << "Threads\t\tMutexRW\t\tScalableMutexRW" << endl;
+    for (int threads = 1; threads <= 64; threads *= 2)
+    {
+        bool torn;
+        double pthread_rw  = RunRWLock<MutexRW>(threads, 1000, 0.1, &torn);
+        double scalable_rw = RunRWLock<ScalableMutexRW>(threads, 1000, 0.1, &torn);
+        cout << threads << "\t\t" << pthread_rw << "\t\t" << scalable_rw << endl;
+    }
+}
+
+// Short-critical-section microbenchmark: pthread mutex against the spinlocks at
+// 1-64 threads.
+void BenchmarkLocks()
+{
+    cout << "\t\tShort critical section throughput (Mops/s)" << endl;
+    cout << "\t\t------------------------------------------" << endl;
+    cout << "Threads\t\tMutex\t\tTTASLock\tTicketLock\tMCSLock" << endl;
+    for (int threads = 1; threads <= 64; threads *= 2)
+    {
+        bool torn;
+        cout << threads << "\t\t" << RunLock<Mutex>(threads, 0.1, &torn) << "\t\t"
+             << RunLock<TTASLock>(threads, 0.1, &torn) << "\t\t" << RunLock<TicketLock>(threads, 0.1, &torn)
+             << "\t\t" << RunLock<MCSLock>(threads, 0.1, &torn) << endl;
+    }
+}
+
+int main(int argc, char** argv)
+{
+    SpinLocks_Exclusion();
+    ScalableMutexRW_Exclusion();
+    ScalableMutexRW_WriterWaitsForFastReaders();
+    BenchmarkLocks();
+    cout << endl;
+    BenchmarkRWLocks();
+}
@@ -0,0 +1,177 @@
+
+#include "utils/slab_allocator.h"
+
+#include <assert.h>
+#include <stdlib.h>
+
+#include "utils/mutex.h"
+
+// Block sizes of the size classes.
+static const size_t kClassSizes[] = {16, 32, 48, 64, 96, 128, 192, 256, 384, 512, 768, 1024, 1536, 2048};
+static const int kClasses         = sizeof(kClassSizes) / sizeof(kClassSizes[0]);
+
+// Size of the slabs that blocks are carved from.
+static const size_t kSlabSize = 64 * 1024;
+
+// Number of blocks moved between a thread cache and the central list at once,
+// and the number a thread cache holds before returning a batch.
+static const int kBatchBytes = 8 * 1024;
+static inline int BatchSize(int c) { return kBatchBytes / kClassSizes[c] < 8 ? 8 : kBatchBytes / kClassSizes[c]; }
+static inline int MaxCached(int c) { return 2 * BatchSize(c); }
+struct FreeBlock
+{
+    FreeBlock* next_;
+};
+
+// Blocks of one class that no thread cache holds.
+struct CentralList
+{
+    TTASLock lock_;
+    FreeBlock* head_;
+    int count_;
+    char pad_[CACHE_LINE_SIZE - sizeof(TTASLock) - sizeof(FreeBlock*) - sizeof(int)];
+};
+static CentralList central[kClasses];
+
+// Size class of each request size, in steps of 16 bytes.
+struct ClassTable
+{
+    ClassTable()
+    {
+        int c = 0;
+        for (size_t i = 0; i <= SlabAllocator::kMaxSize / 16; i++)
+        {
+            while (kClassSizes[c] < i * 16) c++;
+            classes_[i] = c;
+        }
+    }
+    unsigned char classes_[SlabAllocator::kMaxSize / 16 + 1];
+};
+static const ClassTable class_table;
+
+static inline int ClassOf(size_t size) { return class_table.classes_[(size + 15) / 16]; }
+// Pops up to 'n' blocks off '*head' and returns them as a list, setting '*taken'
+// to the number of blocks popped.
+static FreeBlock* TakeBlocks(FreeBlock** head, int n, int* taken)
+{
+    FreeBlock* first = *head;
+    FreeBlock* last  = NULL;
+    int count        = 0;
+    for (FreeBlock* block = first; block != NULL && count < n; block = block->next_)
+    {
+        last = block;
+        count++;
+    }
+    if (last != NULL)
+    {
+        *head       = last->next_;
+        last->next_ = NULL;
+    }
+    *taken = count;
+    return count > 0 ? first : NULL;
+}
+
+// Prepends the list 'blocks', of which 'last' is the last block, to '*head'.
+static inline void PutBlocks(FreeBlock** head, FreeBlock* blocks, FreeBlock* last)
+{
+    last->next_ = *head;
+    *head       = blocks;
+}
+
+// Returns the last block of the non-empty list 'blocks'.
+static FreeBlock* LastBlock(FreeBlock* blocks)
+{
+    while (blocks->next_ != NULL) blocks = blocks->next_;
+    return blocks;
+}
+
+// Free blocks held by one thread. Returned to the central lists when the
+// thread exits.
+struct ThreadCache
+{
+    ~ThreadCache()
+    {
+        for (int c = 0; c < kClasses; c++) Release(c, counts_[c]);
+    }
+
+    // Moves up to 'n' blocks of class 'c' to the central list.
+    void Release(int c, int n)
+    {
+        int taken;
+        FreeBlock* blocks = TakeBlocks(&lists_[c], n, &taken);
+        if (blocks == NULL) return;
+        counts_[c] -= taken;
+
+        FreeBlock* last = LastBlock(blocks);
+        central[c].lock_.Lock();
+        PutBlocks(&central[c].head_, blocks, last);
+        central[c].count_ += taken;
+        central[c].lock_.Unlock();
+    }
+
+    // Refills the empty list of class 'c' from the central list, or from a new
+    // slab if the central list is empty too.
+    void Refill(int c)
+    {
+        int taken;
+        central[c].lock_.Lock();
+        lists_[c] = TakeBlocks(&central[c].head_, BatchSize(c), &taken);
+        central[c].count_ -= taken;
+        central[c].lock_.Unlock();
+        counts_[c] = taken;
+        if (taken > 0) return;
+
+        void* slab;
+        if (posix_memalign(&slab, CACHE_LINE_SIZE, kSlabSize) != 0) abort();
+        int blocks = kSlabSize / kClassSizes[c];
+        for (int i = blocks - 1; i >= 0; i--)
+        {
+            FreeBlock* block = reinterpret_cast<FreeBlock*>(reinterpret_cast<char*>(slab) + i * kClassSizes[c]);
+            block->next_     = lists_[c];
+            lists_[c]        = block;
+        }
+        counts_[c] = blocks;
+    }
+
+    FreeBlock* lists_[kClasses];
+    int counts_[kClasses];
+};
+static thread_local ThreadCache cache;
+
+void* SlabAllocator::Allocate(size_t size)
+{
+    if (size > kMaxSize)
+    {
+        void* ptr = malloc(size);
+        if (ptr == NULL) abort();
+        return ptr;
+    }
+
+    int c = ClassOf(size);
+    if (cache.lists_[c] == NULL) cache.Refill(c);
+    FreeBlock* block = cache.lists_[c];
+    cache.lists_[c]  = block->next_;
+    cache.counts_[c]--;
+    return block;
+}
+
+void SlabAllocator::Free(void* ptr, size_t size)
+{
+    if (ptr == NULL) return;
+    if (size > kMaxSize)
+    {
+        free(ptr);
+        return;
+    }
+
+    // Make room before pushing, so the block just freed stays in this thread's
+    // cache while it is likely still in the CPU cache.
+    int c = ClassOf(size);
+    if (cache.counts_[c] >= MaxCached(c)) cache.Release(c, BatchSize(c));
+    FreeBlock* block = reinterpret_cast<FreeBlock*>(ptr);
+    block->next_     = cache.lists_[c];
+    cache.lists_[c]  = block;
+    cache.counts_[c]++;
+}
+
+size_t SlabAllocator::BlockSize(size_t size) { return size > kMaxSize ? 0 : kClassSizes[ClassOf(size)]; }
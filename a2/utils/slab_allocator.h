@@ -0,0 +1,43 @@
+
+#ifndef _DB_UTILS_SLAB_ALLOCATOR_H_
+#define _DB_UTILS_SLAB_ALLOCATOR_H_
+
+#include <stddef.h>
+
+/// @class SlabAllocator
+///
+/// Thread-caching allocator for small, frequently allocated objects. Requests
+/// are rounded up to one of a few size classes. Each thread keeps a free list
+/// per class and allocates and frees without synchronization. Blocks move
+/// between threads in batches through a central list per class, so a block
+/// may be freed by any thread, not just the one that allocated it. Blocks are
+/// carved out of 64KB slabs that are never returned to the system, so memory
+/// freed for one class is only reused by that class.
+///
+/// Requests larger than kMaxSize go to malloc. Blocks whose class is a
+/// multiple of CACHE_LINE_SIZE are cache-line aligned.
+///
+/// Classes adopt it with
+///
+///   static void* operator new(size_t size) { return SlabAllocator::Allocate(size); }
+///   static void operator delete(void* ptr, size_t size) { SlabAllocator::Free(ptr, size); }
+///
+/// The sized operator delete receives the size of the most derived type, as
+/// long as the destructor is virtual.
+class SlabAllocator
+{
+   public:
+    static const size_t kMaxSize = 2048;
+
+    // Returns a block of at least 'size' bytes.
+    static void* Allocate(size_t size);
+
+    // Frees 'ptr', which was returned by Allocate(size) on any thread.
+    static void Free(void* ptr, size_t size);
+
+    // Returns the size of the blocks handed out for requests of 'size' bytes,
+    // or 0 if those go to malloc.
+    static size_t BlockSize(size_t size);
+};
+
+#endif  // _DB_UTILS_SLAB_ALLOCATOR_H_
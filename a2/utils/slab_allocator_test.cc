@@ -0,0 +1,109 @@
+
+#include "utils/slab_allocator.h"
+
+#include <pthread.h>
+#include <stdint.h>
+#include <set>
+#include <vector>
+
+#include "utils/mutex.h"
+#include "utils/testing.h"
+
+using std::set;
+using std::vector;
+
+TEST(SlabAllocator_SizeClasses)
+{
+    EXPECT_EQ(16, SlabAllocator::BlockSize(1));
+    EXPECT_EQ(16, SlabAllocator::BlockSize(16));
+    EXPECT_EQ(64, SlabAllocator::BlockSize(64));
+    EXPECT_EQ(96, SlabAllocator::BlockSize(65));
+    EXPECT_EQ(2048, SlabAllocator::BlockSize(SlabAllocator::kMaxSize));
+    EXPECT_EQ(0, SlabAllocator::BlockSize(SlabAllocator::kMaxSize + 1));
+
+    // Cache-line sized blocks are cache-line aligned.
+    void* block = SlabAllocator::Allocate(64);
+    EXPECT_EQ(0, reinterpret_cast<uintptr_t>(block) % CACHE_LINE_SIZE);
+    SlabAllocator::Free(block, 64);
+
+    END;
+}
+
+TEST(SlabAllocator_BlocksDoNotOverlap)
+{
+    const int kBlocks = 10000;
+    vector<uint64_t*> blocks;
+    for (int i = 0; i < kBlocks; i++)
+    {
+        uint64_t* block = reinterpret_cast<uint64_t*>(SlabAllocator::Allocate(48));
+        for (int j = 0; j < 6; j++) block[j] = i;
+        blocks.push_back(block);
+    }
+
+    bool intact = true;
+    for (int i = 0; i < kBlocks; i++)
+    {
+        for (int j = 0; j < 6; j++) intact = intact && blocks[i][j] == static_cast<uint64_t>(i);
+    }
+    EXPECT_TRUE(intact);
+
+    // A freed block is handed out again before any new one.
+    SlabAllocator::Free(blocks.back(), 48);
+    EXPECT_EQ(reinterpret_cast<void*>(blocks.back()), SlabAllocator::Allocate(48));
+
+    for (int i = 0; i < kBlocks; i++) SlabAllocator::Free(blocks[i], 48);
+
+    END;
+}
+
+const int kHandoffBlocks = 100000;
+
+static void* AllocateBlocks(void* arg)
+{
+    vector<void*>* blocks = reinterpret_cast<vector<void*>*>(arg);
+    for (int i = 0; i < kHandoffBlocks; i++) blocks->push_back(SlabAllocator::Allocate(128));
+    return NULL;
+}
+
+static void* FreeBlocks(void* arg)
+{
+    vector<void*>* blocks = reinterpret_cast<vector<void*>*>(arg);
+    for (size_t i = 0; i < blocks->size(); i++) SlabAllocator::Free((*blocks)[i], 128);
+    return NULL;
+}
+
+TEST(SlabAllocator_CrossThreadFree)
+{
+    // One thread allocates the blocks, another one frees them.
+    vector<void*> blocks;
+    pthread_t thread;
+    pthread_create(&thread, NULL, AllocateBlocks, &blocks);
+    pthread_join(thread, NULL);
+    pthread_create(&thread, NULL, FreeBlocks, &blocks);
+    pthread_join(thread, NULL);
+
+    // The freeing thread returned them when it exited, so this thread gets
+    // them back instead of new ones, and never gets one twice.
+    set<void*> freed(blocks.begin(), blocks.end());
+    set<void*> allocated;
+    int reused = 0;
+    for (int i = 0; i < kHandoffBlocks; i++)
+    {
+        void* block = SlabAllocator::Allocate(128);
+        allocated.insert(block);
+        if (freed.count(block)) reused++;
+    }
+    EXPECT_EQ(kHandoffBlocks, allocated.size());
+    EXPECT_EQ(kHandoffBlocks, reused);
+
+    for (set<void*>::iterator it = allocated.begin(); it != allocated.end(); ++it) SlabAllocator::Free(*it, 128);
+
+    END;
+}
+
+int main(int argc, char** argv)
+{
+    SlabAllocator_SizeClasses();
+    SlabAllocator_BlocksDoNotOverlap();
+    SlabAllocator_CrossThreadFree();
+}
@@ -0,0 +1,114 @@
+
+#ifndef _DB_UTILS_SMALL_VECTOR_H_
+#define _DB_UTILS_SMALL_VECTOR_H_
+
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+#include <type_traits>
+#include <utility>
+
+/// @class SmallVector<T, N>
+///
+/// Vector that keeps its first N elements in a buffer inside the object, and
+/// only moves them to the heap once it grows beyond that. Elements are copied
+/// with memcpy, so T must be trivially copyable (keys, values, pointers and
+/// plain structs of them).
+template <typename T, int N>
+class SmallVector
+{
+   public:
+    typedef T* iterator;
+    typedef const T* const_iterator;
+
+    SmallVector() : data_(inline_), size_(0), capacity_(N) {}
+    SmallVector(const SmallVector& other) : data_(inline_), size_(0), capacity_(N) { *this = other; }
+    SmallVector(SmallVector&& other) : data_(inline_), size_(0), capacity_(N) { *this = std::move(other); }
+    ~SmallVector()
+    {
+        if (data_ != inline_) free(data_);
+    }
+
+    SmallVector& operator=(const SmallVector& other)
+    {
+        if (this == &other) return *this;
+        size_ = 0;
+        Reserve(other.size_);
+        memcpy(data_, other.data_, other.size_ * sizeof(T));
+        size_ = other.size_;
+        return *this;
+    }
+
+    // Takes over the heap buffer of 'other', if it has one.
+    SmallVector& operator=(SmallVector&& other)
+    {
+        if (this == &other) return *this;
+        if (other.data_ == other.inline_)
+        {
+            *this = static_cast<const SmallVector&>(other);
+        }
+        else
+        {
+            if (data_ != inline_) free(data_);
+            data_           = other.data_;
+            capacity_       = other.capacity_;
+            size_           = other.size_;
+            other.data_     = other.inline_;
+            other.capacity_ = N;
+        }
+        other.size_ = 0;
+        return *this;
+    }
+
+    iterator begin() { return data_; }
+    iterator end() { return data_ + size_; }
+    const_iterator begin() const { return data_; }
+    const_iterator end() const { return data_ + size_; }
+    int size() const { return size_; }
+    bool empty() const { return size_ == 0; }
+    T& operator[](int i) { return data_[i]; }
+    const T& operator[](int i) const { return data_[i]; }
+    void clear() { size_ = 0; }
+    void push_back(const T& value) { insert(end(), value); }
+    // Inserts 'value' before 'pos' and returns an iterator to it.
+    iterator insert(iterator pos, const T& value)
+    {
+        int i = pos - data_;
+        if (size_ == capacity_) Reserve(2 * capacity_);
+        memmove(data_ + i + 1, data_ + i, (size_ - i) * sizeof(T));
+        data_[i] = value;
+        size_++;
+        return data_ + i;
+    }
+
+    // Removes the element at 'pos' and returns an iterator to the one after it.
+    iterator erase(iterator pos)
+    {
+        int i = pos - data_;
+        memmove(data_ + i, data_ + i + 1, (size_ - i - 1) * sizeof(T));
+        size_--;
+        return data_ + i;
+    }
+
+    // Makes room for at least 'capacity' elements.
+    void Reserve(int capacity)
+    {
+        if (capacity <= capacity_) return;
+        T* data = reinterpret_cast<T*>(malloc(capacity * sizeof(T)));
+        assert(data != NULL);
+        memcpy(data, data_, size_ * sizeof(T));
+        if (data_ != inline_) free(data_);
+        data_     = data;
+        capacity_ = capacity;
+    }
+
+   private:
+    static_assert(std::is_trivially_copyable<T>::value, "SmallVector elements are copied with memcpy");
+
+    T* data_;
+    int size_;
+    int capacity_;
+    T inline_[N];
+};
+
+#endif  // _DB_UTILS_SMALL_VECTOR_H_
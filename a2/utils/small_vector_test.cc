@@ -0,0 +1,109 @@
+#include "utils/small_vector.h"
+
+#include <stdint.h>
+#include <utility>
+
+#include "utils/testing.h"
+
+// Returns true if 'v' keeps its elements in its inline buffer.
+template <typename V>
+static bool Inline(const V& v)
+{
+    const char* data = reinterpret_cast<const char*>(v.begin());
+    const char* self = reinterpret_cast<const char*>(&v);
+    return data >= self && data < self + sizeof(v);
+}
+
+TEST(SmallVector_GrowsFromInlineToHeap)
+{
+    SmallVector<uint64_t, 4> v;
+    for (uint64_t i = 0; i < 4; i++) v.push_back(i);
+    EXPECT_TRUE(Inline(v));
+
+    // The fifth element moves everything to the heap, in order.
+    v.push_back(4);
+    EXPECT_FALSE(Inline(v));
+    EXPECT_EQ(5, v.size());
+    bool ordered = true;
+    for (int i = 0; i < v.size(); i++) ordered = ordered && v[i] == static_cast<uint64_t>(i);
+    EXPECT_TRUE(ordered);
+
+    for (uint64_t i = 5; i < 1000; i++) v.push_back(i);
+    EXPECT_EQ(1000, v.size());
+    EXPECT_EQ(999, v[999]);
+
+    END;
+}
+
+TEST(SmallVector_InsertErase)
+{
+    SmallVector<int, 4> v;
+    v.push_back(1);
+    v.push_back(3);
+    v.insert(v.begin() + 1, 2);
+    v.insert(v.begin(), 0);
+    v.insert(v.end(), 4);
+    EXPECT_EQ(5, v.size());
+    bool ordered = true;
+    for (int i = 0; i < v.size(); i++) ordered = ordered && v[i] == i;
+    EXPECT_TRUE(ordered);
+
+    // Erasing the first, a middle and the last element.
+    EXPECT_EQ(1, *v.erase(v.begin()));
+    EXPECT_EQ(3, *v.erase(v.begin() + 1));
+    EXPECT_TRUE(v.erase(v.end() - 1) == v.end());
+    EXPECT_EQ(2, v.size());
+    EXPECT_EQ(1, v[0]);
+    EXPECT_EQ(3, v[1]);
+
+    v.clear();
+    EXPECT_TRUE(v.empty());
+
+    END;
+}
+
+TEST(SmallVector_CopyAndMove)
+{
+    SmallVector<int, 4> small;
+    small.push_back(7);
+    SmallVector<int, 4> large;
+    for (int i = 0; i < 10; i++) large.push_back(i);
+
+    // Copies are independent of their source.
+    SmallVector<int, 4> small_copy(small);
+    SmallVector<int, 4> large_copy(large);
+    small_copy[0] = 8;
+    large_copy[9] = 100;
+    EXPECT_EQ(7, small[0]);
+    EXPECT_EQ(9, large[9]);
+    EXPECT_TRUE(Inline(small_copy));
+    EXPECT_EQ(10, large_copy.size());
+
+    // Moving a heap vector takes over its buffer; moving an inline one copies.
+    const int* buffer = large.begin();
+    SmallVector<int, 4> large_moved(std::move(large));
+    EXPECT_TRUE(large_moved.begin() == buffer);
+    EXPECT_EQ(0, large.size());
+    EXPECT_TRUE(Inline(large));
+
+    SmallVector<int, 4> small_moved;
+    small_moved = std::move(small);
+    EXPECT_TRUE(Inline(small_moved));
+    EXPECT_EQ(1, small_moved.size());
+    EXPECT_EQ(7, small_moved[0]);
+    EXPECT_EQ(0, small.size());
+
+    // Assigning over a heap vector.
+    large_copy = small_moved;
+    EXPECT_EQ(1, large_copy.size());
+    EXPECT_EQ(7, large_copy[0]);
+
+    END;
+}
+
+int main(int argc, char** argv)
+{
+    SmallVector_GrowsFromInlineToHeap();
+    SmallVector_InsertErase();
+    SmallVector_CopyAndMove();
+}
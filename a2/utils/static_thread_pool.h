@@ -10,6 +10,7 @@
 #include "pthread.h"
 #include "stdlib.h"
 #include "utils/atomic.h"
+#include "utils/cpu_topology.h"
 #include "utils/thread_pool.h"
 
 using std::queue;
@@ -21,26 +22,25 @@ using std::pair;
 class StaticThreadPool : public ThreadPool
 {
    public:
-    StaticThreadPool(int nthreads) : thread_count_(nthreads), stopped_(false) { Start(); }
+    // Thread i is pinned to cpus[i] if 'cpus' has an entry for it that is not
+    // negative (see CpuTopology::Layout), and left to the OS otherwise.
+    StaticThreadPool(int nthreads, const vector<int>& cpus = vector<int>())
+        : thread_count_(nthreads), cpus_(cpus), stopped_(false)
+    {
+        Start();
+    }
     ~StaticThreadPool()
     {
         stopped_ = true;
         for (int i = 0; i < thread_count_; i++) pthread_join(threads_[i], NULL);
+        delete[] queues_;
     }
 
     bool Active() { return !stopped_; }
     virtual void AddTask(Task&& task)
     {
         assert(!stopped_);
-        while (!queues_[rand() % thread_count_].PushNonBlocking(std::forward<Task>(task)))
-        {
-        }
-    }
-
-    virtual void AddTask(const Task& task)
-    {
-        assert(!stopped_);
-        while (!queues_[rand() % thread_count_].PushNonBlocking(task))
+        while (!queues_[rand() % thread_count_].PushNonBlocking(std::move(task)))
         {
         }
     }
@@ -50,27 +50,16 @@ class StaticThreadPool : public ThreadPool
     void Start()
     {
         threads_.resize(thread_count_);
-        queues_.resize(thread_count_);
-
-        pthread_attr_t attr;
-        pthread_attr_init(&attr);
-
-        #if !defined(_MSC_VER) && !defined(__APPLE__)
-        // Pin all threads in the thread pool to CPU Core 0 ~ 6
-        cpu_set_t cpuset;
-        CPU_ZERO(&cpuset);
-        for (int i = 0; i < 7; i++)
-        {
-            CPU_SET(i, &cpuset);
-        }
-
-        pthread_attr_setaffinity_np(&attr, sizeof(cpu_set_t), &cpuset);
-        #endif
+        queues_ = new LockFreeQueue<Task>[thread_count_];
 
         for (int i = 0; i < thread_count_; i++)
         {
+            pthread_attr_t attr;
+            pthread_attr_init(&attr);
+            if (i < static_cast<int>(cpus_.size())) SetThreadAffinity(&attr, cpus_[i]);
             pthread_create(&threads_[i], &attr, RunThread,
                            reinterpret_cast<void*>(new pair<int, StaticThreadPool*>(i, this)));
+            pthread_attr_destroy(&attr);
         }
     }
 
@@ -112,130 +101,11 @@ class StaticThreadPool : public ThreadPool
     }
 
     int thread_count_;
+    vector<int> cpus_;
     vector<pthread_t> threads_;
 
-    // Task queues.
-    vector<AtomicQueue<Task>> queues_;
-
-    bool stopped_;
-};
-
-#endif  // _DB_UTILS_STATIC_THREAD_POOL_H_
-/// @file
-/// @author Alexander Thomson <thomson@cs.yale.edu>
-// Modified by: Kun Ren (kun.ren@yale.edu)
-
-#ifndef _DB_UTILS_STATIC_THREAD_POOL_H_
-#define _DB_UTILS_STATIC_THREAD_POOL_H_
-
-#include <queue>
-#include <string>
-#include <utility>
-#include <vector>
-#include "assert.h"
-#include "pthread.h"
-#include "stdlib.h"
-#include "utils/atomic.h"
-#include "utils/thread_pool.h"
-
-using std::queue;
-using std::string;
-using std::vector;
-using std::pair;
-
-//
-class StaticThreadPool : public ThreadPool
-{
-   public:
-    StaticThreadPool(int nthreads) : thread_count_(nthreads), stopped_(false) { Start(); }
-    ~StaticThreadPool()
-    {
-        stopped_ = true;
-        for (int i = 0; i < thread_count_; i++) pthread_join(threads_[i], NULL);
-    }
-
-    bool Active() { return !stopped_; }
-    virtual void RunTask(Task* task)
-    {
-        assert(!stopped_);
-        while (!queues_[rand() % thread_count_].PushNonBlocking(task))
-        {
-        }
-    }
-
-    virtual int ThreadCount() { return thread_count_; }
-   private:
-    void Start()
-    {
-        threads_.resize(thread_count_);
-        queues_.resize(thread_count_);
-
-        pthread_attr_t attr;
-        pthread_attr_init(&attr);
-
-        #if !defined(_MSC_VER) && !defined(__APPLE__)
-        // Pin all threads in the thread pool to CPU Core 0 ~ 6
-        cpu_set_t cpuset;
-        CPU_ZERO(&cpuset);
-        for (int i = 0; i < 19; i++)
-        {
-            CPU_SET(i, &cpuset);
-        }
-
-        pthread_attr_setaffinity_np(&attr, sizeof(cpu_set_t), &cpuset);
-        #endif
-
-        for (int i = 0; i < thread_count_; i++)
-        {
-            pthread_create(&threads_[i], &attr, RunThread,
-                           reinterpret_cast<void*>(new pair<int, StaticThreadPool*>(i, this)));
-        }
-    }
-
-    // Function executed by each pthread.
-    static void* RunThread(void* arg)
-    {
-        int queue_id         = reinterpret_cast<pair<int, StaticThreadPool*>*>(arg)->first;
-        StaticThreadPool* tp = reinterpret_cast<pair<int, StaticThreadPool*>*>(arg)->second;
-
-        Task* task;
-        int sleep_duration = 1;  // in microseconds
-        while (true)
-        {
-            if (tp->queues_[queue_id].PopNonBlocking(&task))
-            {
-                task->Run();
-                delete task;
-                // Reset backoff.
-                sleep_duration = 1;
-            }
-            else
-            {
-                usleep(sleep_duration);
-                // Back off exponentially.
-                if (sleep_duration < 32) sleep_duration *= 2;
-            }
-
-            if (tp->stopped_)
-            {
-                // Go through ALL queues looking for a remaining task.
-                while (tp->queues_[queue_id].Pop(&task))
-                {
-                    task->Run();
-                    delete task;
-                }
-
-                break;
-            }
-        }
-        return NULL;
-    }
-
-    int thread_count_;
-    vector<pthread_t> threads_;
-
-    // Task queues.
-    vector<AtomicQueue<Task*>> queues_;
+    // Task queues, one per thread.
+    LockFreeQueue<Task>* queues_;
 
     bool stopped_;
 };
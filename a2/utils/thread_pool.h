@@ -2,19 +2,21 @@
 #ifndef _DB_UTILS_THREAD_POOL_H_
 #define _DB_UTILS_THREAD_POOL_H_
 
-#include <functional>
+#include "utils/inline_task.h"
 
 class ThreadPool
 {
    public:
-    using Task = std::function<void()>;
+    // Tasks hold their callable inline (up to 40 bytes of captures), so adding
+    // one never allocates. With its ops pointer a task takes 48 bytes, so a
+    // LockFreeQueue<Task> slot (8-byte sequence number, task, padding) takes
+    // exactly one cache line.
+    using Task = InlineTask<40>;
 
     virtual ~ThreadPool() {}
     // Causes 'task' to be scheduled for background by a thread in the threadpool.
     virtual void AddTask(Task&& task) = 0;
 
-    virtual void AddTask(const Task& task) = 0;
-
     // Returns the number of active physical pthreads currently consituting the
     // threadpool.
     virtual int ThreadCount() = 0;
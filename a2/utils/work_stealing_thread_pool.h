@@ -0,0 +1,391 @@
+
+#ifndef _DB_UTILS_WORK_STEALING_THREAD_POOL_H_
+#define _DB_UTILS_WORK_STEALING_THREAD_POOL_H_
+
+#include <atomic>
+#include <utility>
+#include <vector>
+#include "assert.h"
+#include "pthread.h"
+#include "stdint.h"
+#include "utils/atomic.h"
+#include "utils/cpu_topology.h"
+#include "utils/mutex.h"
+#include "utils/thread_pool.h"
+
+using std::vector;
+
+/// @class WorkStealingDeque<T>
+///
+/// Chase-Lev work-stealing deque. The owning thread pushes and pops at the
+/// bottom without any atomic read-modify-write in the common case; other
+/// threads steal from the top with a single CAS. The circular buffer grows as
+/// needed; buffers replaced by a grow are kept until the deque is destroyed,
+/// since a concurrent thief may still be reading them.
+///
+/// T must be trivially copyable (typically a pointer).
+template <typename T>
+class WorkStealingDeque
+{
+   public:
+    explicit WorkStealingDeque(int64_t capacity = 256) : top_(0), bottom_(0)
+    {
+        array_.store(new Array(capacity), std::memory_order_relaxed);
+    }
+
+    ~WorkStealingDeque()
+    {
+        delete array_.load(std::memory_order_relaxed);
+        for (size_t i = 0; i < retired_.size(); i++) delete retired_[i];
+    }
+
+    // Pushes 'item' at the bottom. Owner only.
+    void Push(T item)
+    {
+        int64_t b = bottom_.load(std::memory_order_relaxed);
+        int64_t t = top_.load(std::memory_order_acquire);
+        Array* a  = array_.load(std::memory_order_relaxed);
+        if (b - t > a->size_ - 1) a = Grow(a, t, b);
+        a->Put(b, item);
+        std::atomic_thread_fence(std::memory_order_release);
+        bottom_.store(b + 1, std::memory_order_relaxed);
+    }
+
+    // Pops the bottom item into '*item' and returns true, or returns false if
+    // the deque is empty. Owner only.
+    bool Pop(T* item)
+    {
+        int64_t b = bottom_.load(std::memory_order_relaxed) - 1;
+        Array* a  = array_.load(std::memory_order_relaxed);
+        bottom_.store(b, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        int64_t t = top_.load(std::memory_order_relaxed);
+
+        bool found = false;
+        if (t <= b)
+        {
+            *item = a->Get(b);
+            found = true;
+            if (t == b)
+            {
+                // Last item: race against thieves for it.
+                if (!top_.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+                {
+                    found = false;
+                }
+                bottom_.store(b + 1, std::memory_order_relaxed);
+            }
+        }
+        else
+        {
+            bottom_.store(b + 1, std::memory_order_relaxed);
+        }
+        return found;
+    }
+
+    // Steals the top item into '*item' and returns true. Returns false if the
+    // deque is empty or another thread won the race for the item. Any thread.
+    bool Steal(T* item)
+    {
+        int64_t t = top_.load(std::memory_order_acquire);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        int64_t b = bottom_.load(std::memory_order_acquire);
+        if (t >= b) return false;
+
+        Array* a = array_.load(std::memory_order_acquire);
+        T stolen = a->Get(t);
+        if (!top_.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+        {
+            return false;
+        }
+        *item = stolen;
+        return true;
+    }
+
+    // Returns true if the deque appeared empty at the time of the call.
+    bool Empty()
+    {
+        return bottom_.load(std::memory_order_acquire) <= top_.load(std::memory_order_acquire);
+    }
+
+   private:
+    struct Array
+    {
+        explicit Array(int64_t size) : size_(size), items_(new std::atomic<T>[size]) {}
+        ~Array() { delete[] items_; }
+        T Get(int64_t i) { return items_[i & (size_ - 1)].load(std::memory_order_relaxed); }
+        void Put(int64_t i, T item) { items_[i & (size_ - 1)].store(item, std::memory_order_relaxed); }
+        int64_t size_;
+        std::atomic<T>* items_;
+    };
+
+    // Replaces 'a' by an array twice its size holding the items in [t, b).
+    Array* Grow(Array* a, int64_t t, int64_t b)
+    {
+        Array* bigger = new Array(2 * a->size_);
+        for (int64_t i = t; i < b; i++) bigger->Put(i, a->Get(i));
+        retired_.push_back(a);
+        array_.store(bigger, std::memory_order_release);
+        return bigger;
+    }
+
+    // Disallow copying.
+    WorkStealingDeque(const WorkStealingDeque&);
+    WorkStealingDeque& operator=(const WorkStealingDeque&);
+
+    std::atomic<int64_t> top_;
+    char pad0_[CACHE_LINE_SIZE - sizeof(std::atomic<int64_t>)];
+    std::atomic<int64_t> bottom_;
+    std::atomic<Array*> array_;
+    vector<Array*> retired_;
+};
+
+/// @class WorkStealingThreadPool
+///
+/// ThreadPool in which every worker owns a Chase-Lev deque for tasks it spawns
+/// itself and a lock-free inbox for tasks submitted by other threads (inboxes
+/// are filled round-robin). Spawned tasks live in a fixed array of slots owned
+/// by the spawning worker, and the deque holds slot numbers, so spawning never
+/// allocates. A worker runs its own tasks first and otherwise
+/// steals from randomly chosen victims, so a long task never strands short
+/// ones behind it while other workers are idle. Workers that find no work park
+/// on a futex and are woken by the next AddTask, instead of polling with
+/// sleeps.
+class WorkStealingThreadPool : public ThreadPool
+{
+   public:
+    // Worker i is pinned to cpus[i] if 'cpus' has an entry for it that is not
+    // negative (see CpuTopology::Layout), and left to the OS otherwise.
+    WorkStealingThreadPool(int nthreads, const vector<int>& cpus = vector<int>())
+        : thread_count_(nthreads), cpus_(cpus), stopped_(false), next_inbox_(0), sleepers_(0)
+    {
+        Start();
+    }
+
+    ~WorkStealingThreadPool()
+    {
+        stopped_.store(true, std::memory_order_seq_cst);
+        wake_.Increment();
+        wake_.WakeAll();
+        for (int i = 0; i < thread_count_; i++) pthread_join(threads_[i], NULL);
+        for (int i = 0; i < thread_count_; i++) delete workers_[i];
+    }
+
+    bool Active() { return !stopped_.load(std::memory_order_relaxed); }
+    virtual void AddTask(Task&& task)
+    {
+        assert(Active());
+        Worker* me = CurrentWorker();
+        int slot;
+        if (me != NULL && me->pool_ == this && (slot = me->FreeSlot()) >= 0)
+        {
+            me->slots_[slot].task_ = std::move(task);
+            me->slots_[slot].busy_.store(true, std::memory_order_relaxed);
+            me->deque_.Push(slot);
+        }
+        else if (me != NULL && me->pool_ == this)
+        {
+            // All of this worker's slots hold tasks that have not started yet.
+            me->inbox_.Push(std::move(task));
+        }
+        else
+        {
+            Worker* inbox = workers_[next_inbox_.fetch_add(1, std::memory_order_relaxed) % thread_count_];
+            inbox->inbox_.Push(std::move(task));
+        }
+        WakeWorker();
+    }
+
+    virtual int ThreadCount() { return thread_count_; }
+   private:
+    // Number of tasks a worker can have spawned and not yet started.
+    static const int kSlots = 256;
+
+    // A spawned task, and whether it is waiting to be taken off a deque.
+    struct Slot
+    {
+        Task task_;
+        std::atomic<bool> busy_;
+    };
+
+    // Per-worker state.
+    struct Worker
+    {
+        Worker(WorkStealingThreadPool* pool, int id) : pool_(pool), id_(id), next_slot_(0), seed_(id * 2654435761u + 1)
+        {
+            for (int i = 0; i < kSlots; i++) slots_[i].busy_.store(false, std::memory_order_relaxed);
+        }
+
+        // Returns a slot that no task occupies, or -1 if all are taken. Only
+        // the worker itself fills slots; whoever takes a slot number off the
+        // deque empties the slot.
+        int FreeSlot()
+        {
+            for (int i = 0; i < kSlots; i++)
+            {
+                int slot   = next_slot_;
+                next_slot_ = (next_slot_ + 1) % kSlots;
+                if (!slots_[slot].busy_.load(std::memory_order_acquire)) return slot;
+            }
+            return -1;
+        }
+
+        // Moves the task out of 'slot' into '*task' and frees the slot.
+        void Take(int slot, Task* task)
+        {
+            *task = std::move(slots_[slot].task_);
+            slots_[slot].busy_.store(false, std::memory_order_release);
+        }
+
+        WorkStealingThreadPool* pool_;
+        int id_;
+        // Tasks spawned by this worker, and the deque of their slot numbers.
+        Slot slots_[kSlots];
+        int next_slot_;
+        WorkStealingDeque<int> deque_;
+        // Tasks submitted by other threads.
+        LockFreeQueue<Task> inbox_;
+        // State for choosing random steal victims.
+        uint32_t seed_;
+    };
+
+    // The Worker run by the calling thread, or NULL if it is not a worker.
+    static Worker*& CurrentWorker()
+    {
+        static thread_local Worker* worker = NULL;
+        return worker;
+    }
+
+    void Start()
+    {
+        threads_.resize(thread_count_);
+        workers_.resize(thread_count_);
+        for (int i = 0; i < thread_count_; i++) workers_[i] = new Worker(this, i);
+
+        for (int i = 0; i < thread_count_; i++)
+        {
+            pthread_attr_t attr;
+            pthread_attr_init(&attr);
+            if (i < static_cast<int>(cpus_.size())) SetThreadAffinity(&attr, cpus_[i]);
+            pthread_create(&threads_[i], &attr, RunThread, reinterpret_cast<void*>(workers_[i]));
+            pthread_attr_destroy(&attr);
+        }
+    }
+
+    // Wakes one parked worker, if any. The fence orders the caller's push
+    // before the read of 'sleepers_' (pairs with the fence in Park()).
+    void WakeWorker()
+    {
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (sleepers_.load(std::memory_order_relaxed) > 0)
+        {
+            wake_.Increment();
+            wake_.WakeOne();
+        }
+    }
+
+    // Finds a task for 'me': its own deque first, then its inbox, then other
+    // workers' deques and inboxes starting at a random victim.
+    bool FindTask(Worker* me, Task* task)
+    {
+        int spawned;
+        if (me->deque_.Pop(&spawned))
+        {
+            me->Take(spawned, task);
+            return true;
+        }
+        if (me->inbox_.PopNonBlocking(task)) return true;
+
+        me->seed_ ^= me->seed_ << 13;
+        me->seed_ ^= me->seed_ >> 17;
+        me->seed_ ^= me->seed_ << 5;
+        int start = me->seed_ % thread_count_;
+        for (int i = 0; i < thread_count_; i++)
+        {
+            Worker* victim = workers_[(start + i) % thread_count_];
+            if (victim == me) continue;
+            if (victim->deque_.Steal(&spawned))
+            {
+                victim->Take(spawned, task);
+                return true;
+            }
+            if (victim->inbox_.PopNonBlocking(task)) return true;
+        }
+        return false;
+    }
+
+    // Parks the calling worker until new work may be available.
+    void Park(Worker* me)
+    {
+        int epoch = wake_.Load();
+        sleepers_.fetch_add(1, std::memory_order_seq_cst);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+
+        // Re-check after announcing ourselves, so a task pushed concurrently
+        // with the announcement is not missed.
+        bool idle = !stopped_.load(std::memory_order_relaxed);
+        for (int i = 0; idle && i < thread_count_; i++)
+        {
+            idle = workers_[i]->deque_.Empty() && workers_[i]->inbox_.Size() == 0;
+        }
+        if (idle) wake_.Wait(epoch);
+        sleepers_.fetch_sub(1, std::memory_order_relaxed);
+    }
+
+    // Function executed by each pthread.
+    static void* RunThread(void* arg)
+    {
+        Worker* me                 = reinterpret_cast<Worker*>(arg);
+        WorkStealingThreadPool* tp = me->pool_;
+        CurrentWorker()            = me;
+
+        Task task;
+        SpinWait spin;
+        int idle_rounds = 0;
+        while (true)
+        {
+            task = Task();
+            if (tp->FindTask(me, &task))
+            {
+                task();
+                idle_rounds = 0;
+                spin.Reset();
+            }
+            else if (tp->stopped_.load(std::memory_order_acquire))
+            {
+                // No work left anywhere and no more will be added.
+                break;
+            }
+            else if (++idle_rounds < kSpinRounds)
+            {
+                spin.Wait();
+            }
+            else
+            {
+                tp->Park(me);
+                idle_rounds = 0;
+                spin.Reset();
+            }
+        }
+        return NULL;
+    }
+
+    // Number of unsuccessful searches for work before a worker parks.
+    static const int kSpinRounds = 16;
+
+    int thread_count_;
+    vector<int> cpus_;
+    vector<pthread_t> threads_;
+    vector<Worker*> workers_;
+
+    std::atomic<bool> stopped_;
+
+    // Inbox that the next task submitted by a non-worker thread goes to.
+    std::atomic<unsigned> next_inbox_;
+
+    // Number of workers parked (or about to park) on 'wake_'.
+    std::atomic<int> sleepers_;
+    Futex wake_;
+};
+
+#endif  // _DB_UTILS_WORK_STEALING_THREAD_POOL_H_
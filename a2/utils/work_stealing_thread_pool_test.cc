@@ -0,0 +1,173 @@
+#include "utils/work_stealing_thread_pool.h"
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <new>
+
+#include "utils/testing.h"
+
+// Number of heap allocations made by any thread.
+static std::atomic<uint64_t> allocs(0);
+
+void* operator new(size_t size)
+{
+    allocs.fetch_add(1, std::memory_order_relaxed);
+    void* ptr = malloc(size == 0 ? 1 : size);
+    if (ptr == NULL) throw std::bad_alloc();
+    return ptr;
+}
+
+void operator delete(void* ptr) noexcept { free(ptr); }
+
+// Tasks submitted by each external thread, and children each of them spawns
+// from inside the pool.
+const int kSubmitters = 4;
+const int kTasksPerSubmitter = 2000;
+const int kChildren = 3;
+const int kTaskCount = kSubmitters * kTasksPerSubmitter * (1 + kChildren);
+
+struct PoolState
+{
+    WorkStealingThreadPool* pool_;
+    std::atomic<int> runs_[kTaskCount];
+    std::atomic<int> finished_;
+};
+
+struct PoolTask
+{
+    PoolState* state_;
+    int id_;
+    void operator()()
+    {
+        state_->runs_[id_]++;
+
+        // Top-level tasks spawn their children from the worker, which puts
+        // them on the worker's own deque, where other workers steal them.
+        if (id_ % (1 + kChildren) == 0)
+        {
+            for (int i = 1; i <= kChildren; i++)
+            {
+                PoolTask child = {state_, id_ + i};
+                state_->pool_->AddTask(child);
+            }
+        }
+        state_->finished_++;
+    }
+};
+
+static void* SubmitTasks(void* arg)
+{
+    PoolState* state = reinterpret_cast<PoolState*>(arg);
+    static std::atomic<int> next_submitter(0);
+    int submitter = next_submitter++;
+    for (int i = 0; i < kTasksPerSubmitter; i++)
+    {
+        PoolTask task = {state, (submitter * kTasksPerSubmitter + i) * (1 + kChildren)};
+        state->pool_->AddTask(task);
+    }
+    return NULL;
+}
+
+TEST(WorkStealingThreadPool_RunsEveryTaskOnce)
+{
+    PoolState* state = new PoolState();
+    for (int i = 0; i < kTaskCount; i++) state->runs_[i].store(0);
+    state->finished_.store(0);
+    state->pool_ = new WorkStealingThreadPool(4);
+
+    pthread_t submitters[kSubmitters];
+    for (int i = 0; i < kSubmitters; i++) pthread_create(&submitters[i], NULL, SubmitTasks, state);
+    for (int i = 0; i < kSubmitters; i++) pthread_join(submitters[i], NULL);
+
+    // Children are only spawned while their parents run, so wait for all of
+    // them before shutting down.
+    while (state->finished_.load() < kTaskCount) usleep(100);
+    delete state->pool_;
+
+    int wrong = 0;
+    for (int i = 0; i < kTaskCount; i++)
+    {
+        if (state->runs_[i].load() != 1) wrong++;
+    }
+    EXPECT_EQ(0, wrong);
+    EXPECT_EQ(kTaskCount, state->finished_.load());
+    delete state;
+
+    END;
+}
+
+struct CountTask
+{
+    std::atomic<int>* count_;
+    void operator()()
+    {
+        usleep(10);
+        (*count_)++;
+    }
+};
+
+TEST(WorkStealingThreadPool_ShutdownDrains)
+{
+    // Tasks still queued when the pool is destroyed run before it returns.
+    std::atomic<int> count(0);
+    WorkStealingThreadPool* pool = new WorkStealingThreadPool(2);
+    for (int i = 0; i < 5000; i++)
+    {
+        CountTask task = {&count};
+        pool->AddTask(task);
+    }
+    delete pool;
+    EXPECT_EQ(5000, count.load());
+
+    END;
+}
+
+// A task with the largest capture a ThreadPool::Task holds.
+struct FullTask
+{
+    std::atomic<int>* count_;
+    char bytes_[32];
+    void operator()() { (*count_)++; }
+};
+
+TEST(WorkStealingThreadPool_AddTaskDoesNotAllocate)
+{
+    EXPECT_EQ(48, sizeof(ThreadPool::Task));
+    EXPECT_EQ(40, sizeof(FullTask));
+
+    PoolState* state = new PoolState();
+    for (int i = 0; i < kTaskCount; i++) state->runs_[i].store(0);
+    state->finished_.store(0);
+    state->pool_ = new WorkStealingThreadPool(4);
+    std::atomic<int> count(0);
+
+    // Once the pool is running, neither submitting tasks from outside it nor
+    // spawning them from its workers touches the heap.
+    uint64_t start = allocs.load();
+    for (int i = 0; i < kTasksPerSubmitter; i++)
+    {
+        PoolTask task = {state, i * (1 + kChildren)};
+        state->pool_->AddTask(task);
+        FullTask full;
+        full.count_ = &count;
+        state->pool_->AddTask(full);
+    }
+    while (state->finished_.load() < kTasksPerSubmitter * (1 + kChildren) || count.load() < kTasksPerSubmitter)
+    {
+        usleep(100);
+    }
+    EXPECT_EQ(0, allocs.load() - start);
+
+    delete state->pool_;
+    delete state;
+
+    END;
+}
+
+int main(int argc, char** argv)
+{
+    WorkStealingThreadPool_RunsEveryTaskOnce();
+    WorkStealingThreadPool_ShutdownDrains();
+    WorkStealingThreadPool_AddTaskDoesNotAllocate();
+}